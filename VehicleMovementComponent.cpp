@@ -4,10 +4,134 @@
 #include "PhysXIncludes.h"
 #include "PhysXPublic.h"
 #include "PhysicsEngine/BodyInstance.h"
+#include "Engine/World.h"
+#include "GameFramework/PlayerController.h"
+#include "PhysXVehicleManager.h"
+#include "Net/UnrealNetwork.h"
+#include "VehicleNWFleetSubsystem.h"
+#include "VehicleNWPrototypeCache.h"
+#include "VehicleNWDrivePool.h"
+#include "VehicleNWStats.h"
+#include "VehicleNWDrivetrain.h"
+#include "VehicleNWWheels.h"
+#include "VehicleNWTelemetryRecorder.h"
+#include "VehicleNWFrictionTable.h"
+#include "VehicleAnimInstance.h"
+#include "VehicleWheel.h"
+#include "TireConfig.h"
+
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Input Smoothing Cache Rebuilds"), STAT_VehicleNW_InputCacheRebuilds, STATGROUP_VehicleNW);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Input Smoothing Cache Hits"), STAT_VehicleNW_InputCacheHits, STATGROUP_VehicleNW);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Vehicles Full LOD"), STAT_VehicleNW_FullLOD, STATGROUP_VehicleNW);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Vehicles Reduced LOD"), STAT_VehicleNW_ReducedLOD, STATGROUP_VehicleNW);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Vehicles Rail LOD"), STAT_VehicleNW_RailLOD, STATGROUP_VehicleNW);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("LOD Transitions"), STAT_VehicleNW_LODTransitions, STATGROUP_VehicleNW);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Wheel Substeps"), STAT_VehicleNW_WheelSubsteps, STATGROUP_VehicleNW);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Auto Substep Changes"), STAT_VehicleNW_AutoSubstepChanges, STATGROUP_VehicleNW);
+DECLARE_CYCLE_STAT(TEXT("Save Snapshot"), STAT_VehicleNW_SaveSnapshot, STATGROUP_VehicleNW);
+DECLARE_CYCLE_STAT(TEXT("Restore Snapshot"), STAT_VehicleNW_RestoreSnapshot, STATGROUP_VehicleNW);
+DECLARE_CYCLE_STAT(TEXT("Resimulate"), STAT_VehicleNW_Resimulate, STATGROUP_VehicleNW);
+DECLARE_CYCLE_STAT(TEXT("Commit Tuning"), STAT_VehicleNW_CommitTuning, STATGROUP_VehicleNW);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Async Setups"), STAT_VehicleNW_AsyncSetups, STATGROUP_VehicleNW);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Vehicles Asleep"), STAT_VehicleNW_Asleep, STATGROUP_VehicleNW);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Vehicle Wake Ups"), STAT_VehicleNW_WakeUps, STATGROUP_VehicleNW);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Wheel Surface Changes"), STAT_VehicleNW_SurfaceChanges, STATGROUP_VehicleNW);
+
+static TAutoConsoleVariable<int32> CVarVehicleNWAsyncSetup(
+	TEXT("p.VehicleNW.AsyncSetup"),
+	1,
+	TEXT("Build the wheel and drive data of vehicles missing from the prototype cache on a background thread.\n")
+	TEXT("The vehicle is bound to its rigid body, and becomes ready, on a later tick."),
+	ECVF_Default);
+
+// Updates under half the slip tolerance before the auto substep count goes down.
+static const int32 AutoSubstepCalmUpdatesToDecrease = 30;
 
 UVehicleMovementComponentNW::UVehicleMovementComponentNW(const FObjectInitializer& ObjectInitializer) : Super(ObjectInitializer)
 {
+	// Force the steering table, smoothing data and drivetrain to be compiled on first use.
+	InputSmoothingVersion = 1;
+	DrivetrainVersion = 1;
+	CompiledDrivetrainVersion = 0;
+
+	PendingTuning = EVehicleNWTuningSection::None;
+	TuningDepth = 0;
+
+	Fleet = nullptr;
+	FleetIndex = INDEX_NONE;
+	bDrivenByTraffic = false;
+
+	FMemory::Memzero(PhysicsInputs);
+
+	// PhysX defaults, in Km/h rather than PhysX length units.
+	SubstepThresholdSpeed = 18.f;
+	LowSpeedSubstepCount = 3;
+	HighSpeedSubstepCount = 1;
+	bAutoSubstep = false;
+	AutoSubstepSlipTolerance = 0.1f;
+	AutoSubstepMinCount = 1;
+	AutoSubstepMaxCount = 8;
+	AutoSubstepCount = 1;
+	AutoSubstepCalmUpdates = 0;
+	bSubstepCountDirty = false;
+
+	bReplicateQuantizedState = false;
+	IdleNetUpdateFrequency = 2.f;
+	ActiveNetUpdateFrequency = 30.f;
+	ActiveNetSpeed = 10.f;
+	LastNetGear = 0;
+
+	bEnableSimulationLOD = false;
+	ReducedLODDistance = 10000.f;
+	RailLODDistance = 30000.f;
+	LODDistanceHysteresis = 1000.f;
+	LODEvaluationInterval = 0.25f;
+	bReduceLODWhenNotRendered = false;
+	ReducedLODSubstepCount = 1;
+	ReducedLODUpdateInterval = 2;
+	RailGroundTraceInterval = 4;
+
+	SimulationLOD = EVehicleNWSimulationLOD::Full;
+	LODEvaluationTimer = 0.f;
+	ReducedLODStepCounter = 0;
+	ReducedLODAccumulatedTime = 0.f;
+	RailVelocity = FVector::ZeroVector;
+	RailRideHeight = 0.f;
+	RailGroundPoint = FVector::ZeroVector;
+	RailGroundNormal = FVector::UpVector;
+	RailGroundTraceCounter = 0;
+	bRestoreRailDrivetrain = false;
+	RailSavedGear = 0;
+	RailSavedEngineRotationSpeed = 0.f;
+
+	bEnableSleep = false;
+	SleepLinearSpeed = 5.f;
+	SleepAngularSpeed = 2.f;
+	SleepDelay = 1.f;
+	ChangedSurfaceWheels = 0;
+	SpeedPublishStep = 1;
+	EngineRPMPublishStep = 50.f;
+	PublishedGear = 0;
+	PublishedSpeed = 0;
+	PublishedEngineRPM = 0.f;
+	bGearChanged = false;
+	bSpeedChanged = false;
+	bEngineRPMChanged = false;
+	bAsleep = false;
+	bPendingSleep = false;
+	RestTime = 0.f;
+	FMemory::Memzero(RestInputs);
+
+	SnapshotRingSize = 0;
+	bHeightfieldSuspension = false;
+	InputReplayOffset = 0;
+	FMemory::Memzero(InputReplayFrame);
+	InputReplayFrameIndex = 0;
+	InputReplayDivergentFrame = INDEX_NONE;
+
 #if WITH_PHYSX_VEHICLES
+	WheelsStates = nullptr;
+	ActiveTireModel = nullptr;
 
 	PxVehicleEngineData DefEngineData;
 	EngineSetup.MOI = DefEngineData.mMOI;
@@ -107,102 +231,121 @@ void UVehicleMovementComponentNW::PostEditChangeProperty(struct FPropertyChanged
 			SteeringCurve.GetRichCurve()->UpdateOrAddKey(SteerKeys[KeyIdx].Time, NewValue);
 		}
 	}
+
+	const FName MemberPropertyName = PropertyChangedEvent.MemberProperty ? PropertyChangedEvent.MemberProperty->GetFName() : NAME_None;
+	if (MemberPropertyName == GET_MEMBER_NAME_CHECKED(UVehicleMovementComponentNW, ThrottleInputRate)
+		|| MemberPropertyName == GET_MEMBER_NAME_CHECKED(UVehicleMovementComponentNW, BrakeInputRate)
+		|| MemberPropertyName == GET_MEMBER_NAME_CHECKED(UVehicleMovementComponentNW, HandbrakeInputRate)
+		|| MemberPropertyName == GET_MEMBER_NAME_CHECKED(UVehicleMovementComponentNW, SteeringInputRate))
+	{
+		MarkInputSmoothingDirty();
+	}
+	else if (MemberPropertyName == GET_MEMBER_NAME_CHECKED(UVehicleMovementComponentNW, SteeringCurve))
+	{
+		MarkTuningDirty(EVehicleNWTuningSection::Steering);
+	}
+	else if (MemberPropertyName == GET_MEMBER_NAME_CHECKED(UVehicleMovementComponentNW, EngineSetup))
+	{
+		MarkTuningDirty(EVehicleNWTuningSection::Engine);
+	}
+	else if (MemberPropertyName == GET_MEMBER_NAME_CHECKED(UVehicleMovementComponentNW, TransmissionSetup))
+	{
+		MarkTuningDirty(EVehicleNWTuningSection::Transmission);
+	}
+	else if (MemberPropertyName == GET_MEMBER_NAME_CHECKED(UVehicleMovementComponentNW, DifferentialSetup))
+	{
+		MarkTuningDirty(EVehicleNWTuningSection::Differential);
+	}
 }
 #endif // WITH_EDITOR
 
-#if WITH_PHYSX_VEHICLES
-static void GetVehicleDifferentialNWSetup(const FVehicleDifferentialNWData& Setup, PxVehicleDifferentialNWData& PxSetup)
+void UVehicleMovementComponentNW::SetSteeringCurve(const FRuntimeFloatCurve& NewSteeringCurve)
 {
-	for (int32 i = 0; i < Setup.DWheelData.Num(); i++)
-	{
-		PxSetup.setDrivenWheel(Setup.DWheelData[i].DrivenWheelIndex, Setup.DWheelData[i].IsDrivenWheel);
-	}
+	SteeringCurve = NewSteeringCurve;
+	MarkTuningDirty(EVehicleNWTuningSection::Steering);
 }
 
-float FVehicleEngineNWData::FindPeakTorque() const
+void UVehicleMovementComponentNW::SetDriverInputs(float Throttle, float Steering, float Brake)
 {
-	// Find max torque.
-	float PeakTorque = 0.f;
-	TArray<FRichCurveKey> TorqueKeys = TorqueCurve.GetRichCurveConst()->GetCopyOfKeys();
-	for (int32 KeyIdx = 0; KeyIdx < TorqueKeys.Num(); KeyIdx++)
+	RawThrottleInput = FMath::Clamp(Throttle, -1.f, 1.f);
+	RawSteeringInput = FMath::Clamp(Steering, -1.f, 1.f);
+	RawBrakeInput = FMath::Clamp(Brake, 0.f, 1.f);
+}
+
+void UVehicleMovementComponentNW::SetInputRates(const FVehicleInputRate& NewThrottleRate, const FVehicleInputRate& NewBrakeRate, const FVehicleInputRate& NewHandbrakeRate, const FVehicleInputRate& NewSteeringRate)
+{
+	ThrottleInputRate = NewThrottleRate;
+	BrakeInputRate = NewBrakeRate;
+	HandbrakeInputRate = NewHandbrakeRate;
+	SteeringInputRate = NewSteeringRate;
+	MarkInputSmoothingDirty();
+}
+
+const FVehicleNWDrivetrainBlob& UVehicleMovementComponentNW::GetDrivetrainBlob() const
+{
+	if (CompiledDrivetrainVersion != DrivetrainVersion)
 	{
-		FRichCurveKey& Key = TorqueKeys[KeyIdx];
-		PeakTorque = FMath::Max(PeakTorque, Key.Value);
+		DrivetrainBlob.Compile(EngineSetup, TransmissionSetup, DifferentialSetup);
+		CompiledDrivetrainVersion = DrivetrainVersion;
+
+		UE_LOG(LogVehicleNW, Verbose, TEXT("%s torque curve resampled to %d entries, max error %.2f%%"), *GetPathName(), DrivetrainBlob.NumTorqueSamples, DrivetrainBlob.TorqueResampleError * 100.f);
 	}
-	return PeakTorque;
+	return DrivetrainBlob;
 }
 
-static void GetVehicleEngineSetup(const FVehicleEngineNWData& Setup, PxVehicleEngineData& PxSetup)
+void UVehicleMovementComponentNW::CompileInputSmoothingCache()
 {
-	PxSetup.mMOI = M2ToCm2(Setup.MOI);
-	PxSetup.mMaxOmega = RPMToOmega(Setup.MaxRPM);
-	PxSetup.mDampingRateFullThrottle = M2ToCm2(Setup.DampingRateFullThrottle);
-	PxSetup.mDampingRateZeroThrottleClutchEngaged = M2ToCm2(Setup.DampingRateZeroThrottleClutchEngaged);
-	PxSetup.mDampingRateZeroThrottleClutchDisengaged = M2ToCm2(Setup.DampingRateZeroThrottleClutchDisengaged);
+	if (InputSmoothingCache.Version == InputSmoothingVersion)
+	{
+		INC_DWORD_STAT(STAT_VehicleNW_InputCacheHits);
+		return;
+	}
 
-	float PeakTorque = Setup.FindPeakTorque();  // In Nm.
-	PxSetup.mPeakTorque = M2ToCm2(PeakTorque);	// Convert Nm to (kg cm^2/s^2).
+	INC_DWORD_STAT(STAT_VehicleNW_InputCacheRebuilds);
 
-												// Convert from our curve to PhysX.
-	PxSetup.mTorqueCurve.clear();
-	TArray<FRichCurveKey> TorqueKeys = Setup.TorqueCurve.GetRichCurveConst()->GetCopyOfKeys();
-	int32 NumTorqueCurveKeys = FMath::Min<int32>(TorqueKeys.Num(), PxVehicleEngineData::eMAX_NB_ENGINE_TORQUE_CURVE_ENTRIES);
-	for (int32 KeyIdx = 0; KeyIdx < NumTorqueCurveKeys; KeyIdx++)
+	// Convert from our curve to the PxFixedSizeLookupTable layout.
+	const TArray<FRichCurveKey>& SteerKeys = SteeringCurve.GetRichCurveConst()->GetConstRefOfKeys();
+	InputSmoothingCache.NumSteerSamples = FMath::Min(FVehicleNWInputSmoothingCache::MaxSteeringSamples, SteerKeys.Num());
+	for (int32 KeyIdx = 0; KeyIdx < InputSmoothingCache.NumSteerSamples; KeyIdx++)
 	{
-		FRichCurveKey& Key = TorqueKeys[KeyIdx];
-		PxSetup.mTorqueCurve.addPair(FMath::Clamp(Key.Time / Setup.MaxRPM, 0.f, 1.f), Key.Value / PeakTorque); // Normalize torque to 0-1 range
+		const FRichCurveKey& Key = SteerKeys[KeyIdx];
+		InputSmoothingCache.SteerSpeeds[KeyIdx] = KmHToCmS(Key.Time);
+		InputSmoothingCache.SteerValues[KeyIdx] = FMath::Clamp(Key.Value, 0.f, 1.f);
 	}
-}
 
-static void GetVehicleGearSetup(const FVehicleTransmissionNWData& Setup, PxVehicleGearsData& PxSetup)
-{
-	PxSetup.mSwitchTime = Setup.GearSwitchTime;
-	PxSetup.mRatios[PxVehicleGearsData::eREVERSE] = Setup.ReverseGearRatio;
-	for (int32 i = 0; i < Setup.ForwardGears.Num(); i++)
+	// Same order as PxVehicleDriveNWControl: accel, brake, handbrake, steer left, steer right.
+	const FVehicleInputRate* Rates[FVehicleNWInputSmoothingCache::NumAnalogInputs] = { &ThrottleInputRate, &BrakeInputRate, &HandbrakeInputRate, &SteeringInputRate, &SteeringInputRate };
+	for (int32 InputIdx = 0; InputIdx < FVehicleNWInputSmoothingCache::NumAnalogInputs; InputIdx++)
 	{
-		PxSetup.mRatios[i + PxVehicleGearsData::eFIRST] = Setup.ForwardGears[i].Ratio;
+		InputSmoothingCache.RiseRates[InputIdx] = Rates[InputIdx]->RiseRate;
+		InputSmoothingCache.FallRates[InputIdx] = Rates[InputIdx]->FallRate;
 	}
-	PxSetup.mFinalRatio = Setup.FinalRatio;
-	PxSetup.mNbRatios = Setup.ForwardGears.Num() + PxVehicleGearsData::eFIRST;
+
+	InputSmoothingCache.Version = InputSmoothingVersion;
 }
 
-static void GetVehicleAutoBoxSetup(const FVehicleTransmissionNWData& Setup, PxVehicleAutoBoxData& PxSetup)
+float FVehicleEngineNWData::FindPeakTorque() const
 {
-	for (int32 i = 0; i < Setup.ForwardGears.Num(); i++)
+	// Find max torque.
+	float PeakTorque = 0.f;
+	for (const FRichCurveKey& Key : TorqueCurve.GetRichCurveConst()->GetConstRefOfKeys())
 	{
-		const FVehicleGearNWData& GearData = Setup.ForwardGears[i];
-		PxSetup.mUpRatios[i] = GearData.UpRatio;
-		PxSetup.mDownRatios[i] = GearData.DownRatio;
+		PeakTorque = FMath::Max(PeakTorque, Key.Value);
 	}
-	PxSetup.mUpRatios[PxVehicleGearsData::eNEUTRAL] = Setup.NeutralGearUpRatio;
-	PxSetup.setLatency(Setup.GearAutoBoxLatency);
+	return PeakTorque;
 }
 
+#if WITH_PHYSX_VEHICLES
 void SetupDriveHelper(const UVehicleMovementComponentNW* VehicleData, const PxVehicleWheelsSimData* PWheelsSimData, PxVehicleDriveSimDataNW& DriveData)
 {
-	PxVehicleDifferentialNWData DifferentialSetup;
-	GetVehicleDifferentialNWSetup(VehicleData->DifferentialSetup, DifferentialSetup);
-	DriveData.setDiffData(DifferentialSetup);
-
-	PxVehicleEngineData EngineSetup;
-	GetVehicleEngineSetup(VehicleData->EngineSetup, EngineSetup);
-	DriveData.setEngineData(EngineSetup);
-
-	PxVehicleClutchData ClutchSetup;
-	ClutchSetup.mStrength = M2ToCm2(VehicleData->TransmissionSetup.ClutchStrength);
-	DriveData.setClutchData(ClutchSetup);
-
-	PxVehicleGearsData GearSetup;
-	GetVehicleGearSetup(VehicleData->TransmissionSetup, GearSetup);
-	DriveData.setGearsData(GearSetup);
-
-	PxVehicleAutoBoxData AutoBoxSetup;
-	GetVehicleAutoBoxSetup(VehicleData->TransmissionSetup, AutoBoxSetup);
-	DriveData.setAutoBoxData(AutoBoxSetup);
+	VehicleData->GetDrivetrainBlob().Apply(DriveData);
 }
 
 void UVehicleMovementComponentNW::SetupVehicle()
 {
+	SCOPE_CYCLE_COUNTER(STAT_VehicleNW_SetupVehicle);
+	CSV_SCOPED_TIMING_STAT(VehicleNW, SetupVehicle);
+
 	if (!UpdatedPrimitive)
 	{
 		return;
@@ -224,7 +367,13 @@ void UVehicleMovementComponentNW::SetupVehicle()
 		}
 	}
 
-	UE_LOG(LogTemp, Warning, TEXT("OK SetupVehicle"));
+	// Rail vehicles are moved kinematically, they have no PhysX vehicle.
+	if (SimulationLOD == EVehicleNWSimulationLOD::Rail)
+	{
+		return;
+	}
+
+	UE_LOG(LogVehicleNW, Verbose, TEXT("SetupVehicle %s with %d wheels"), *GetPathName(), NumOfWheels);
 
 	// Setup the chassis and wheel shapes.
 	SetupVehicleShapes();
@@ -232,163 +381,1768 @@ void UVehicleMovementComponentNW::SetupVehicle()
 	// Setup mass properties.
 	SetupVehicleMass();
 
+	// Identical vehicles share their wheel and drive sim data.
+	FVehicleNWPrototypeCache& PrototypeCache = FVehicleNWPrototypeCache::Get();
+	const uint64 PrototypeKey = ComputePrototypeKey();
+	const FVehicleNWPrototype* Prototype = PrototypeCache.Find(PrototypeKey);
+	if (Prototype == nullptr && CVarVehicleNWAsyncSetup.GetValueOnGameThread() != 0)
+	{
+		// The worker only sees copies taken here, the component may be tuned or destroyed while it builds. TickComponent
+		// binds the vehicle once it is done.
+		FVehicleNWWheelsBlob WheelsBlob;
+		if (CaptureWheelsBlob(WheelsBlob))
+		{
+			PendingSetup = PrototypeCache.BuildAsync(PrototypeKey, NumOfWheels, [WheelsBlob, DrivetrainBlob = GetDrivetrainBlob()](PxVehicleWheelsSimData* PWheelsSimData, PxVehicleDriveSimDataNW& DriveData)
+			{
+				WheelsBlob.Apply(*PWheelsSimData);
+				DrivetrainBlob.Apply(DriveData);
+			});
+			INC_DWORD_STAT(STAT_VehicleNW_AsyncSetups);
+			return;
+		}
+	}
+
+	if (Prototype == nullptr)
+	{
+		Prototype = BuildPrototype(PrototypeKey);
+	}
+
+	if (Prototype != nullptr)
+	{
+		BindVehicle(*Prototype);
+	}
+}
+
+const FVehicleNWPrototype* UVehicleMovementComponentNW::BuildPrototype(uint64 PrototypeKey)
+{
+	FVehicleNWWheelsBlob WheelsBlob;
+	if (!CaptureWheelsBlob(WheelsBlob))
+	{
+		return nullptr;
+	}
+
 	// Setup the wheels.
 	PxVehicleWheelsSimData* PWheelsSimData = PxVehicleWheelsSimData::allocate(NumOfWheels);
-	SetupWheels(PWheelsSimData);
+	WheelsBlob.Apply(*PWheelsSimData);
 
 	// Setup drive data.
 	PxVehicleDriveSimDataNW DriveData;
 	SetupDriveHelper(this, PWheelsSimData, DriveData);
 
+	return FVehicleNWPrototypeCache::Get().Add(PrototypeKey, PWheelsSimData, DriveData);
+}
+
+bool UVehicleMovementComponentNW::CaptureWheelsBlob(FVehicleNWWheelsBlob& Blob)
+{
+	FMemory::Memzero(Blob);
+	Blob.NumWheels = NumOfWheels;
+
+	for (int32 WheelIdx = 0; WheelIdx < NumOfWheels; ++WheelIdx)
+	{
+		const FWheelSetup& WheelSetup = WheelSetups[WheelIdx];
+		const UVehicleWheel* Wheel = WheelSetup.WheelClass.GetDefaultObject();
+		if (Wheel == nullptr)
+		{
+			return false;
+		}
+
+		FVehicleNWWheelsBlob::FWheel& BlobWheel = Blob.Wheels[WheelIdx];
+		BlobWheel.Offset = GetWheelRestingPosition(WheelSetup);
+		BlobWheel.Radius = Wheel->ShapeRadius;
+		BlobWheel.Width = Wheel->ShapeWidth;
+		BlobWheel.Mass = Wheel->Mass;
+		BlobWheel.MaxSteer = WheelSetup.bDisableSteering ? 0.f : FMath::DegreesToRadians(Wheel->SteerAngle);
+		BlobWheel.MaxBrakeTorque = M2ToCm2(Wheel->MaxBrakeTorque);
+		BlobWheel.MaxHandBrakeTorque = Wheel->bAffectedByHandbrake ? M2ToCm2(Wheel->MaxHandBrakeTorque) : 0.f;
+		BlobWheel.DampingRate = M2ToCm2(Wheel->DampingRate);
+		BlobWheel.TireType = Wheel->TireConfig ? Wheel->TireConfig->GetTireConfigID() : 0;
+		BlobWheel.LatStiffX = Wheel->LatStiffMaxLoad;
+		BlobWheel.LatStiffY = Wheel->LatStiffValue;
+		BlobWheel.LongStiffness = Wheel->LongStiffValue;
+		BlobWheel.SuspensionMaxRaise = Wheel->SuspensionMaxRaise;
+		BlobWheel.SuspensionMaxDrop = Wheel->SuspensionMaxDrop;
+		BlobWheel.SuspensionNaturalFrequency = Wheel->SuspensionNaturalFrequency;
+		BlobWheel.SuspensionDampingRatio = Wheel->SuspensionDampingRatio;
+		BlobWheel.SuspensionForceOffset = Wheel->SuspensionForceOffset;
+	}
+
+	Blob.MinNormalizedTireLoad = MinNormalizedTireLoad;
+	Blob.MinNormalizedTireLoadFiltered = MinNormalizedTireLoadFiltered;
+	Blob.MaxNormalizedTireLoad = MaxNormalizedTireLoad;
+	Blob.MaxNormalizedTireLoadFiltered = MaxNormalizedTireLoadFiltered;
+
+	bool bHasBody = false;
+	FPhysicsCommand::ExecuteRead(UpdatedPrimitive->GetBodyInstance()->ActorHandle, [&](const FPhysicsActorHandle& Actor)
+	{
+		if (PxRigidDynamic* PRigidDynamic = FPhysicsInterface::GetPxRigidDynamic_AssumesLocked(Actor))
+		{
+			Blob.ChassisMass = PRigidDynamic->getMass();
+			Blob.LocalCOM = P2UVector(PRigidDynamic->getCMassLocalPose().p);
+			Blob.NumShapes = PRigidDynamic->getNbShapes();
+			bHasBody = Blob.NumShapes > NumOfWheels;
+		}
+	});
+	return bHasBody;
+}
+
+bool UVehicleMovementComponentNW::BindVehicle(const FVehicleNWPrototype& Prototype)
+{
 	// Create the vehicle.
-	PxVehicleDriveNW* PVehicleDriveNW = PxVehicleDriveNW::allocate(NumOfWheels);
+	PxVehicleDriveNW* PVehicleDriveNW = FVehicleNWDrivePool::Get().Acquire(NumOfWheels);
 	check(PVehicleDriveNW);
 
 	FBodyInstance* BodyInstance = UpdatedPrimitive->GetBodyInstance();
+	FVehicleNWLockTimer LockTimer;
 	FPhysicsCommand::ExecuteWrite(BodyInstance->ActorHandle, [&] (const FPhysicsActorHandle &Actor) {
+		LockTimer.Acquired();
+
 		PxRigidDynamic* PRigidDynamic = FPhysicsInterface::GetPxRigidDynamic_AssumesLocked(Actor);
 
 		if (!PRigidDynamic) {
+			// Nothing to bind to, the drive goes back to the pool.
+			FVehicleNWDrivePool::Get().Release(PVehicleDriveNW, NumOfWheels);
+			PVehicleDriveNW = nullptr;
 			return ;
 		}
 
-		PVehicleDriveNW->setup(GPhysXSDK, PRigidDynamic, *PWheelsSimData, DriveData, 0);
+		PVehicleDriveNW->setup(GPhysXSDK, PRigidDynamic, *Prototype.WheelsSimData, *Prototype.DriveData, 0);
+
+		// Wake events bring sleeping vehicles back on contacts and impulses.
+		if (bEnableSleep)
+		{
+			PRigidDynamic->setActorFlag(PxActorFlag::eSEND_SLEEP_NOTIFIES, true);
+		}
 		PVehicleDriveNW->setToRestState();
+		ApplySubstepCount_AssumesLocked(*PVehicleDriveNW);
+
+		// Picked up by GenerateTireForces from the next vehicle update on.
+		ActiveTireModel = TireModel != NAME_None ? FVehicleNWTireModels::Find(TireModel) : nullptr;
+		if (TireModel != NAME_None && ActiveTireModel == nullptr)
+		{
+			UE_LOG(LogVehicleNW, Warning, TEXT("%s: unknown tire model %s, using the PhysX one"), *GetPathName(), *TireModel.ToString());
+		}
 
-		// Cleanup.
-		PWheelsSimData->free();
+		// Coming back from the Rail LOD, pick up the drivetrain where it was left.
+		if (bRestoreRailDrivetrain)
+		{
+			PVehicleDriveNW->mDriveDynData.forceGearChange(RailSavedGear);
+			PVehicleDriveNW->mDriveDynData.setEngineRotationSpeed(RailSavedEngineRotationSpeed);
+			bRestoreRailDrivetrain = false;
+		}
+
+		// Wheel query filter data carries the owner id of the wheel shapes, take it from this actor rather than the prototype.
+		TArray<PxShape*, TInlineAllocator<32>> Shapes;
+		Shapes.AddZeroed(PRigidDynamic->getNbShapes());
+		PRigidDynamic->getShapes(Shapes.GetData(), Shapes.Num());
+		for (int32 WheelIdx = 0; WheelIdx < NumOfWheels; ++WheelIdx)
+		{
+			const PxI32 ShapeIdx = PVehicleDriveNW->mWheelsSimData.getWheelShapeMapping(WheelIdx);
+			if (Shapes.IsValidIndex(ShapeIdx))
+			{
+				PVehicleDriveNW->mWheelsSimData.setSceneQueryFilterData(WheelIdx, Shapes[ShapeIdx]->getQueryFilterData());
+			}
+		}
 	});
 
-	PWheelsSimData = nullptr;
+	if (PVehicleDriveNW == nullptr)
+	{
+		return false;
+	}
 
 	// Cache values.
 	PVehicle = PVehicleDriveNW;
 	PVehicleDrive = PVehicleDriveNW;
+	WheelsStates = nullptr;
+
+	// Every wheel starts in the air, the first step reports the surfaces they land on.
+	WheelSurfaceTypes.Init(MAX_uint32, NumOfWheels);
+	WheelSurfaceFrictions.Init(0.f, NumOfWheels);
+	ChangedSurfaceWheels = 0;
+
+	// A new drive starts awake.
+	bAsleep = false;
+	bPendingSleep = false;
+	RestTime = 0.f;
+
+	// Snapshots of a previous PhysX vehicle do not apply to this one.
+	if (SnapshotRing.GetCapacity() != SnapshotRingSize)
+	{
+		SnapshotRing.Allocate(SnapshotRingSize);
+	}
+	else
+	{
+		SnapshotRing.Reset();
+	}
 
 	SetUseAutoGears(TransmissionSetup.bUseGearAutoBox);
+
+	if (bEnableSleep)
+	{
+		BodyInstance->bGenerateWakeEvents = true;
+		UpdatedPrimitive->OnComponentWake.AddUniqueDynamic(this, &UVehicleMovementComponentNW::OnBodyWake);
+	}
+
+	// Compile the steering table and smoothing data now so the first update does not have to.
+	CompileInputSmoothingCache();
+
+	if (UVehicleNWFleetSubsystem::IsFleetUpdateEnabled())
+	{
+		if (UVehicleNWFleetSubsystem* FleetSubsystem = GetWorld()->GetSubsystem<UVehicleNWFleetSubsystem>())
+		{
+			FleetSubsystem->RegisterVehicle(this);
+		}
+	}
+	return true;
 }
 
-void UVehicleMovementComponentNW::UpdateSimulation(float DeltaTime)
+void UVehicleMovementComponentNW::FinishAsyncSetup()
 {
-	if (PVehicleDrive == nullptr)
+	TSharedPtr<FVehicleNWPendingPrototype> Setup = MoveTemp(PendingSetup);
+
+	if (UpdatedPrimitive == nullptr)
+	{
 		return;
+	}
 
-	FBodyInstance *BodyInstance = UpdatedPrimitive->GetBodyInstance();
-	FPhysicsCommand::ExecuteWrite(BodyInstance->ActorHandle, [&] (const FPhysicsActorHandle &) {
-		PxVehicleDriveNWRawInputData RawInputData;
-		RawInputData.setAnalogAccel(ThrottleInput);
-		RawInputData.setAnalogSteer(SteeringInput);
-		RawInputData.setAnalogBrake(BrakeInput);
-		RawInputData.setAnalogHandbrake(HandbrakeInput);
+	const FVehicleNWPrototype* Prototype = FVehicleNWPrototypeCache::Get().Resolve(*Setup);
+	if (Prototype == nullptr)
+	{
+		// The build was thrown away, the cache was emptied meanwhile.
+		UE_LOG(LogVehicleNW, Log, TEXT("%s: background setup discarded, building the vehicle synchronously"), *GetPathName());
+		Prototype = BuildPrototype(Setup->Key);
+	}
+	if (Prototype == nullptr || !BindVehicle(*Prototype))
+	{
+		return;
+	}
+
+	// The rest of CreateVehicle and OnCreatePhysicsState, skipped while the vehicle was pending.
+	PostSetupVehicle();
+
+	FPhysScene* PhysScene = GetWorld()->GetPhysicsScene();
+	if (FPhysXVehicleManager* VehicleManager = PhysScene ? FPhysXVehicleManager::GetVehicleManagerFromScene(PhysScene) : nullptr)
+	{
+		VehicleManager->AddVehicle(this);
+	}
+	CreateWheels();
 
-		if (!PVehicleDrive->mDriveDynData.getUseAutoGears())
+	if (USkeletalMeshComponent* MeshComp = GetMesh())
+	{
+		MeshComp->RegisterOnPhysicsCreatedDelegate(FOnSkelMeshPhysicsCreated::CreateUObject(this, &UVehicleMovementComponentNW::RecreatePhysicsState));
+		if (UVehicleAnimInstance* VehicleAnimInstance = Cast<UVehicleAnimInstance>(MeshComp->GetAnimInstance()))
 		{
-			RawInputData.setGearUp(bRawGearUpInput);
-			RawInputData.setGearDown(bRawGearDownInput);
+			VehicleAnimInstance->SetWheeledVehicleComponent(this);
 		}
+	}
 
-		// Convert from our curve to PxFixedSizeLookupTable
-		PxFixedSizeLookupTable<8> SpeedSteerLookup;
-		TArray<FRichCurveKey> SteerKeys = SteeringCurve.GetRichCurve()->GetCopyOfKeys();
-		const int32 MaxSteeringSamples = FMath::Min(8, SteerKeys.Num());
-		for (int32 KeyIdx = 0; KeyIdx < MaxSteeringSamples; KeyIdx++)
+	// Inputs given while not ready are dropped rather than applied all at once.
+	ClearAllInput();
+}
+
+void UVehicleMovementComponentNW::GenerateTireForces(UVehicleWheel* Wheel, const FTireShaderInput& Input, FTireShaderOutput& Output)
+{
+	if (ActiveTireModel == nullptr)
+	{
+		Super::GenerateTireForces(Wheel, Input, Output);
+		return;
+	}
+
+	// The engine's shader gives neither camber nor aligning moment, like its own model.
+	const FVehicleNWTireParams Params = { Wheel->LatStiffMaxLoad, Wheel->LatStiffValue, Wheel->LongStiffValue, 0.f };
+	const FVehicleNWTireInput TireInput = { Input.TireFriction, Input.LongSlip, Input.LatSlip, 0.f,
+		Input.WheelRadius, Input.RestTireLoad, Input.NormalizedTireLoad, Input.TireLoad, Input.Gravity };
+
+	FVehicleNWTireForces Forces;
+	ActiveTireModel->ComputeForces(Params, TireInput, Forces);
+
+	Output.WheelTorque = Forces.WheelTorque;
+	Output.LongForce = Forces.LongForce;
+	Output.LatForce = Forces.LatForce;
+}
+
+uint64 UVehicleMovementComponentNW::ComputePrototypeKey()
+{
+	FVehicleNWKeyBuilder KeyBuilder;
+
+	// Wheels: classes, placement on the mesh.
+	KeyBuilder.Append(NumOfWheels);
+	for (const FWheelSetup& WheelSetup : WheelSetups)
+	{
+		KeyBuilder.Append(FVehicleNWPrototypeCache::Get().GetWheelClassHash(WheelSetup.WheelClass.Get()));
+		KeyBuilder.Append(GetWheelRestingPosition(WheelSetup));
+		KeyBuilder.Append(WheelSetup.bDisableSteering);
+	}
+
+	KeyBuilder.Append(MinNormalizedTireLoad);
+	KeyBuilder.Append(MinNormalizedTireLoadFiltered);
+	KeyBuilder.Append(MaxNormalizedTireLoad);
+	KeyBuilder.Append(MaxNormalizedTireLoadFiltered);
+
+	// Chassis: sprung masses depend on mass and center of mass. The wheel shape mapping baked into the wheels sim data
+	// starts after the chassis shapes, the wheel shapes are already attached so the actor's count covers both.
+	FPhysicsCommand::ExecuteRead(UpdatedPrimitive->GetBodyInstance()->ActorHandle, [&](const FPhysicsActorHandle& Actor)
+	{
+		if (PxRigidDynamic* PRigidDynamic = FPhysicsInterface::GetPxRigidDynamic_AssumesLocked(Actor))
 		{
-			FRichCurveKey& Key = SteerKeys[KeyIdx];
-			SpeedSteerLookup.addPair(KmHToCmS(Key.Time), FMath::Clamp(Key.Value, 0.f, 1.f));
+			KeyBuilder.Append(PRigidDynamic->getNbShapes());
+			KeyBuilder.Append(PRigidDynamic->getMass());
+			const PxTransform PLocalCOM = PRigidDynamic->getCMassLocalPose();
+			KeyBuilder.Append(P2UVector(PLocalCOM.p));
+			KeyBuilder.Append(P2UQuat(PLocalCOM.q));
 		}
+	});
 
-		PxVehiclePadSmoothingData SmoothData =
-		{
-			{ ThrottleInputRate.RiseRate, BrakeInputRate.RiseRate, HandbrakeInputRate.RiseRate, SteeringInputRate.RiseRate, SteeringInputRate.RiseRate },
-			{ ThrottleInputRate.FallRate, BrakeInputRate.FallRate, HandbrakeInputRate.FallRate, SteeringInputRate.FallRate, SteeringInputRate.FallRate }
-		};
+	// Engine, differential and transmission, as handed to PhysX.
+	KeyBuilder.Append(GetDrivetrainBlob());
 
-		PxVehicleDriveNW* PVehicleDriveNW = (PxVehicleDriveNW*)PVehicleDrive;
-		PxVehicleDriveNWSmoothAnalogRawInputsAndSetAnalogInputs(SmoothData, SpeedSteerLookup, RawInputData, DeltaTime, false, *PVehicleDriveNW);
-	});
+	return KeyBuilder.GetHash();
 }
-#endif // WITH_PHYSX_VEHICLES
 
-void UVehicleMovementComponentNW::UpdateEngineSetup(const FVehicleEngineNWData& NewEngineSetup)
+static bool SameDrivingInputs(const FVehicleNWInputFrame& A, const FVehicleNWInputFrame& B)
 {
-#if WITH_PHYSX_VEHICLES
-	if (PVehicleDrive)
+	return A.Throttle == B.Throttle && A.Steering == B.Steering && A.Brake == B.Brake && A.Handbrake == B.Handbrake
+		&& A.bGearUp == B.bGearUp && A.bGearDown == B.bGearDown;
+}
+
+void UVehicleMovementComponentNW::UpdateSimulation(float DeltaTime)
+{
+	if (PVehicleDrive == nullptr)
+		return;
+
+	SCOPE_CYCLE_COUNTER(STAT_VehicleNW_UpdateSimulation);
+	CSV_SCOPED_TIMING_STAT(VehicleNW, UpdateSimulation);
+	VehicleNWStats::CountVehicleSimulated(WheelSetups.Num());
+
+	// Inputs of the whole fleet are applied at once.
+	if (Fleet)
 	{
-		PxVehicleEngineData EngineData;
-		GetVehicleEngineSetup(NewEngineSetup, EngineData);
+		Fleet->StepVehicle(this, DeltaTime);
+		return;
+	}
 
-		PxVehicleDriveNW* PVehicleDriveNW = (PxVehicleDriveNW*)PVehicleDrive;
-		PVehicleDriveNW->mDriveSimData.setEngineData(EngineData);
+	ConsumeInputs();
+	if (!WakeOnInput())
+	{
+		return;
+	}
+	UpdateInputRecording(DeltaTime);
+
+	// Recompile outside of the physics lock, and only if SteeringCurve or the input rates changed.
+	CompileInputSmoothingCache();
+
+	// Inputs come from the channel and only the drive's own dynamic data is written, the read lock covers the actor
+	// velocity read by the smoothing. Same reasoning as the parallel fleet update.
+	FVehicleNWTelemetryRecorder::FScopedAccess Telemetry;
+	FVehicleNWTelemetryRecorder::FProducer* TelemetryProducer = Telemetry.Get() ? Telemetry.Get()->GetProducer(GetWorld()) : nullptr;
+
+	FBodyInstance *BodyInstance = UpdatedPrimitive->GetBodyInstance();
+	FVehicleNWLockTimer LockTimer;
+	FPhysicsCommand::ExecuteRead(BodyInstance->ActorHandle, [&] (const FPhysicsActorHandle &) {
+		LockTimer.Acquired();
+		ApplyInputs_AssumesLocked(*(PxVehicleDriveNW*)PVehicleDrive, DeltaTime);
+
+		if (TelemetryProducer)
+		{
+			RecordTelemetry_AssumesLocked(*TelemetryProducer, *(PxVehicleDriveNW*)PVehicleDrive, DeltaTime);
+		}
+	});
+
+	// A new auto substep count goes to the wheels sim data, which takes the write lock.
+	if (bSubstepCountDirty)
+	{
+		FPhysicsCommand::ExecuteWrite(BodyInstance->ActorHandle, [&](const FPhysicsActorHandle&)
+		{
+			ApplyPendingSubstepCount_AssumesLocked(*(PxVehicleDriveNW*)PVehicleDrive);
+		});
 	}
-#endif // WITH_PHYSX_VEHICLES
 }
 
-void UVehicleMovementComponentNW::UpdateDifferentialSetup(const FVehicleDifferentialNWData& NewDifferentialSetup)
+bool UVehicleMovementComponentNW::WakeOnInput()
 {
-#if WITH_PHYSX_VEHICLES
-	if (PVehicleDrive)
+	if (!bAsleep)
 	{
-		PxVehicleDifferentialNWData DifferentialData;
-		GetVehicleDifferentialNWSetup(NewDifferentialSetup, DifferentialData);
-
-		PxVehicleDriveNW* PVehicleDriveNW = (PxVehicleDriveNW*)PVehicleDrive;
-		PVehicleDriveNW->mDriveSimData.setDiffData(DifferentialData);
+		return true;
 	}
-#endif
+	if (!HasWakingInput())
+	{
+		return false;
+	}
+
+	WakeVehicle();
+	return true;
 }
 
-void UVehicleMovementComponentNW::UpdateTransmissionSetup(const FVehicleTransmissionNWData& NewTransmissionSetup)
+bool UVehicleMovementComponentNW::HasWakingInput() const
 {
-#if WITH_PHYSX_VEHICLES
-	if (PVehicleDrive)
+	return bAsleep && !SameDrivingInputs(PhysicsInputs, RestInputs);
+}
+
+void UVehicleMovementComponentNW::PutToSleep()
+{
+	bPendingSleep = false;
+	RestTime = 0.f;
+	if (PVehicleDrive == nullptr)
 	{
-		PxVehicleGearsData GearData;
-		GetVehicleGearSetup(NewTransmissionSetup, GearData);
+		return;
+	}
 
-		PxVehicleAutoBoxData AutoBoxData;
-		GetVehicleAutoBoxSetup(NewTransmissionSetup, AutoBoxData);
+	PxVehicleDriveNW* PVehicleDriveNW = (PxVehicleDriveNW*)PVehicleDrive;
+	FPhysicsCommand::ExecuteWrite(UpdatedPrimitive->GetBodyInstance()->ActorHandle, [&](const FPhysicsActorHandle&)
+	{
+		// Keep the gear, a vehicle parked in reverse wakes up in reverse.
+		const PxU32 Gear = PVehicleDriveNW->mDriveDynData.getCurrentGear();
+		PVehicleDriveNW->setToRestState();
+		PVehicleDriveNW->mDriveDynData.forceGearChange(Gear);
+		UpdateDisplayValues_AssumesLocked(*PVehicleDriveNW);
 
-		PxVehicleDriveNW* PVehicleDriveNW = (PxVehicleDriveNW*)PVehicleDrive;
-		PVehicleDriveNW->mDriveSimData.setGearsData(GearData);
-		PVehicleDriveNW->mDriveSimData.setAutoBoxData(AutoBoxData);
-	}
-#endif
+		// PxVehicleUpdates skips the wheels of a sleeping actor without analog input.
+		PVehicleDriveNW->getRigidDynamicActor()->putToSleep();
+	});
+	bAsleep = true;
 }
 
-void BackwardsConvertCm2ToM2(float& val, float defaultValue)
+void UVehicleMovementComponentNW::ApplyInputs_AssumesLocked(PxVehicleDriveNW& PVehicleDriveNW, float DeltaTime)
 {
-	if (val != defaultValue)
+	if (bAsleep)
 	{
-		val = Cm2ToM2(val);
+		return;
+	}
+
+	// At rest: no throttle, inputs held since the last step and a still chassis. Recorded and replayed vehicles stay
+	// awake, every step has to go through UpdateInputRecording.
+	if (bEnableSleep && !InputRecording.IsValid() && !InputReplay.IsValid())
+	{
+		const PxRigidDynamic* PRigidDynamic = PVehicleDriveNW.getRigidDynamicActor();
+		const bool bAtRest = PhysicsInputs.Throttle == 0.f && !PhysicsInputs.bGearUp && !PhysicsInputs.bGearDown
+			&& SameDrivingInputs(PhysicsInputs, RestInputs)
+			&& PRigidDynamic->getLinearVelocity().magnitudeSquared() < FMath::Square(SleepLinearSpeed)
+			&& PRigidDynamic->getAngularVelocity().magnitudeSquared() < FMath::Square(FMath::DegreesToRadians(SleepAngularSpeed));
+
+		RestTime = bAtRest ? RestTime + DeltaTime : 0.f;
+		bPendingSleep = RestTime >= SleepDelay;
 	}
+	RestInputs = PhysicsInputs;
+
+	const PxWheelQueryResult* StepWheelsStates = GetWheelsStates_AssumesLocked();
+	UpdateWheelSurfaces_AssumesLocked(StepWheelsStates);
+	UpdateDisplayValues_AssumesLocked(PVehicleDriveNW);
+	UpdateSubstepCount_AssumesLocked(PVehicleDriveNW, StepWheelsStates);
+
+	PushInputs_AssumesLocked(PVehicleDriveNW, DeltaTime);
 }
 
-void UVehicleMovementComponentNW::Serialize(FArchive & Ar)
+void UVehicleMovementComponentNW::PushInputs_AssumesLocked(PxVehicleDriveNW& PVehicleDriveNW, float DeltaTime)
 {
-	Super::Serialize(Ar);
-#if WITH_PHYSX_VEHICLES
-	if (Ar.IsLoading() && Ar.UE4Ver() < VER_UE4_VEHICLES_UNIT_CHANGE)
+	// Reduced LOD: push inputs every ReducedLODUpdateInterval steps, smoothed over the time elapsed since the last push.
+	if (SimulationLOD == EVehicleNWSimulationLOD::Reduced)
 	{
-		PxVehicleEngineData DefEngineData;
-		float DefaultRPM = OmegaToRPM(DefEngineData.mMaxOmega);
+		ReducedLODAccumulatedTime += DeltaTime;
+		if (++ReducedLODStepCounter < ReducedLODUpdateInterval)
+		{
+			return;
+		}
 
-		// We need to convert from old units to new. This backwards compatible code fails in the rare case that they were using very strange values that are the new defaults in the correct units.
-		EngineSetup.MaxRPM = EngineSetup.MaxRPM != DefaultRPM ? OmegaToRPM(EngineSetup.MaxRPM) : DefaultRPM;	// Need to convert from rad/s to RPM.
+		DeltaTime = ReducedLODAccumulatedTime;
+		ReducedLODStepCounter = 0;
+		ReducedLODAccumulatedTime = 0.f;
 	}
 
-	if (Ar.IsLoading() && Ar.UE4Ver() < VER_UE4_VEHICLES_UNIT_CHANGE2)
+	PxVehicleDriveNWRawInputData RawInputData;
+	RawInputData.setAnalogAccel(PhysicsInputs.Throttle);
+	RawInputData.setAnalogSteer(PhysicsInputs.Steering);
+	RawInputData.setAnalogBrake(PhysicsInputs.Brake);
+	RawInputData.setAnalogHandbrake(PhysicsInputs.Handbrake);
+
+	if (!PVehicleDriveNW.mDriveDynData.getUseAutoGears())
 	{
-		PxVehicleEngineData DefEngineData;
-		PxVehicleClutchData DefClutchData;
+		RawInputData.setGearUp(PhysicsInputs.bGearUp != 0);
+		RawInputData.setGearDown(PhysicsInputs.bGearDown != 0);
+	}
 
-		// We need to convert from old units to new. This backwards compatible code fails in the rare case that they were using very strange values that are the new defaults in the correct units.
-		BackwardsConvertCm2ToM2(EngineSetup.DampingRateFullThrottle, DefEngineData.mDampingRateFullThrottle);
-		BackwardsConvertCm2ToM2(EngineSetup.DampingRateZeroThrottleClutchDisengaged, DefEngineData.mDampingRateZeroThrottleClutchDisengaged);
-		BackwardsConvertCm2ToM2(EngineSetup.DampingRateZeroThrottleClutchEngaged, DefEngineData.mDampingRateZeroThrottleClutchEngaged);
-		BackwardsConvertCm2ToM2(EngineSetup.MOI, DefEngineData.mMOI);
-		BackwardsConvertCm2ToM2(TransmissionSetup.ClutchStrength, DefClutchData.mStrength);
+	// Unpack the compiled steering table and smoothing data. Both live on the stack, nothing is allocated here.
+	PxFixedSizeLookupTable<FVehicleNWInputSmoothingCache::MaxSteeringSamples> SpeedSteerLookup;
+	for (int32 KeyIdx = 0; KeyIdx < InputSmoothingCache.NumSteerSamples; KeyIdx++)
+	{
+		SpeedSteerLookup.addPair(InputSmoothingCache.SteerSpeeds[KeyIdx], InputSmoothingCache.SteerValues[KeyIdx]);
 	}
-#endif
+
+	PxVehiclePadSmoothingData SmoothData = {};
+	for (int32 InputIdx = 0; InputIdx < FVehicleNWInputSmoothingCache::NumAnalogInputs; InputIdx++)
+	{
+		SmoothData.mRiseRates[InputIdx] = InputSmoothingCache.RiseRates[InputIdx];
+		SmoothData.mFallRates[InputIdx] = InputSmoothingCache.FallRates[InputIdx];
+	}
+
+	PxVehicleDriveNWSmoothAnalogRawInputsAndSetAnalogInputs(SmoothData, SpeedSteerLookup, RawInputData, DeltaTime, false, PVehicleDriveNW);
+}
+
+const PxWheelQueryResult* UVehicleMovementComponentNW::GetWheelsStates_AssumesLocked() const
+{
+	// The manager allocates them with the vehicle and frees them in RemoveVehicle, which only runs with the physics state.
+	if (WheelsStates == nullptr && PVehicle)
+	{
+		FPhysXVehicleManager* VehicleManager = FPhysXVehicleManager::GetVehicleManagerFromScene(GetWorld()->GetPhysicsScene());
+		WheelsStates = VehicleManager ? VehicleManager->GetWheelsStates_AssumesLocked(this) : nullptr;
+	}
+	return WheelsStates;
+}
+
+void UVehicleMovementComponentNW::UpdateWheelSurfaces_AssumesLocked(const PxWheelQueryResult* WheelsStates)
+{
+	if (WheelsStates == nullptr)
+	{
+		return;
+	}
+
+	for (int32 WheelIdx = 0; WheelIdx < WheelSurfaceTypes.Num(); ++WheelIdx)
+	{
+		const PxWheelQueryResult& WheelState = WheelsStates[WheelIdx];
+		const uint32 SurfaceType = WheelState.isInAir ? MAX_uint32 : WheelState.tireSurfaceType;
+		if (SurfaceType != WheelSurfaceTypes[WheelIdx])
+		{
+			WheelSurfaceTypes[WheelIdx] = SurfaceType;
+			WheelSurfaceFrictions[WheelIdx] = WheelState.isInAir ? 0.f : WheelState.tireFriction;
+			ChangedSurfaceWheels |= 1u << WheelIdx;
+		}
+	}
+}
+
+void UVehicleMovementComponentNW::UpdateDisplayValues_AssumesLocked(const PxVehicleDriveNW& PVehicleDriveNW)
+{
+	// PhysX has reverse as gear 0.
+	const int32 Gear = (int32)PVehicleDriveNW.mDriveDynData.getCurrentGear() - 1;
+	if (Gear != PublishedGear)
+	{
+		PublishedGear = Gear;
+		bGearChanged = true;
+	}
+
+	// cm/s to km/h. Coming to a stop is always published.
+	const int32 Speed = FMath::RoundToInt(FMath::Abs(PVehicleDriveNW.computeForwardSpeed()) * 0.036f);
+	if (FMath::Abs(Speed - PublishedSpeed) >= SpeedPublishStep || (Speed == 0 && PublishedSpeed != 0))
+	{
+		PublishedSpeed = Speed;
+		bSpeedChanged = true;
+	}
+
+	const float EngineRPM = OmegaToRPM(PVehicleDriveNW.mDriveDynData.getEngineRotationSpeed());
+	if (FMath::Abs(EngineRPM - PublishedEngineRPM) >= FMath::Max(EngineRPMPublishStep, KINDA_SMALL_NUMBER))
+	{
+		PublishedEngineRPM = EngineRPM;
+		bEngineRPMChanged = true;
+	}
+}
+
+void UVehicleMovementComponentNW::BroadcastStepChanges()
+{
+	// Handlers may change the vehicle, flags are cleared before each broadcast.
+	if (bGearChanged)
+	{
+		bGearChanged = false;
+		OnGearChanged.Broadcast(PublishedGear);
+	}
+	if (bSpeedChanged)
+	{
+		bSpeedChanged = false;
+		OnSpeedChanged.Broadcast(PublishedSpeed);
+	}
+	if (bEngineRPMChanged)
+	{
+		bEngineRPMChanged = false;
+		OnEngineRPMChanged.Broadcast(PublishedEngineRPM);
+	}
+}
+
+void UVehicleMovementComponentNW::BroadcastSurfaceChanges()
+{
+	if (ChangedSurfaceWheels == 0)
+	{
+		return;
+	}
+
+	const uint32 ChangedWheels = ChangedSurfaceWheels;
+	ChangedSurfaceWheels = 0;
+
+	FVehicleNWFrictionTable& FrictionTable = FVehicleNWFrictionTable::Get();
+	for (int32 WheelIdx = 0; WheelIdx < WheelSurfaceTypes.Num(); ++WheelIdx)
+	{
+		if (ChangedWheels & (1u << WheelIdx))
+		{
+			INC_DWORD_STAT(STAT_VehicleNW_SurfaceChanges);
+			const uint32 SurfaceType = WheelSurfaceTypes[WheelIdx];
+			UPhysicalMaterial* Surface = SurfaceType != MAX_uint32 ? FrictionTable.GetSurfaceMaterial(SurfaceType) : nullptr;
+			OnWheelSurfaceChanged.Broadcast(WheelIdx, Surface, WheelSurfaceFrictions[WheelIdx]);
+		}
+	}
+}
+
+void UVehicleMovementComponentNW::ApplySubstepCount_AssumesLocked(PxVehicleDriveNW& PVehicleDriveNW)
+{
+	const float ThresholdSpeed = KmHToCmS(SubstepThresholdSpeed);
+	if (SimulationLOD == EVehicleNWSimulationLOD::Reduced)
+	{
+		PVehicleDriveNW.mWheelsSimData.setSubStepCount(ThresholdSpeed, ReducedLODSubstepCount, ReducedLODSubstepCount);
+	}
+	else if (bAutoSubstep)
+	{
+		PVehicleDriveNW.mWheelsSimData.setSubStepCount(ThresholdSpeed, AutoSubstepCount, AutoSubstepCount);
+	}
+	else
+	{
+		PVehicleDriveNW.mWheelsSimData.setSubStepCount(ThresholdSpeed, FMath::Max(LowSpeedSubstepCount, 1), FMath::Max(HighSpeedSubstepCount, 1));
+	}
+}
+
+void UVehicleMovementComponentNW::ApplyPendingSubstepCount_AssumesLocked(PxVehicleDriveNW& PVehicleDriveNW)
+{
+	if (bSubstepCountDirty)
+	{
+		bSubstepCountDirty = false;
+		ApplySubstepCount_AssumesLocked(PVehicleDriveNW);
+	}
+}
+
+void UVehicleMovementComponentNW::UpdateSubstepCount_AssumesLocked(const PxVehicleDriveNW& PVehicleDriveNW, const PxWheelQueryResult* WheelsStates)
+{
+	if (bAutoSubstep && SimulationLOD == EVehicleNWSimulationLOD::Full)
+	{
+		if (WheelsStates)
+		{
+			// Substeps too coarse for the tires show up as slip jumping from one update to the next.
+			const int32 NumWheels = PVehicleDriveNW.mWheelsSimData.getNbWheels();
+			const bool bHasPrevSlips = AutoSubstepPrevSlips.Num() == NumWheels * 2;
+			AutoSubstepPrevSlips.SetNumUninitialized(NumWheels * 2);
+
+			float SlipError = 0.f;
+			for (int32 WheelIdx = 0; WheelIdx < NumWheels; ++WheelIdx)
+			{
+				const PxWheelQueryResult& WheelState = WheelsStates[WheelIdx];
+				float* PrevSlips = &AutoSubstepPrevSlips[WheelIdx * 2];
+				if (bHasPrevSlips && !WheelState.isInAir)
+				{
+					SlipError = FMath::Max(SlipError, FMath::Abs(WheelState.longitudinalSlip - PrevSlips[0]));
+					SlipError = FMath::Max(SlipError, FMath::Abs(WheelState.lateralSlip - PrevSlips[1]));
+				}
+				PrevSlips[0] = WheelState.longitudinalSlip;
+				PrevSlips[1] = WheelState.lateralSlip;
+			}
+
+			int32 NewCount = AutoSubstepCount;
+			if (SlipError > AutoSubstepSlipTolerance)
+			{
+				NewCount = AutoSubstepCount + 1;
+				AutoSubstepCalmUpdates = 0;
+			}
+			else if (SlipError < AutoSubstepSlipTolerance * 0.5f && ++AutoSubstepCalmUpdates >= AutoSubstepCalmUpdatesToDecrease)
+			{
+				NewCount = AutoSubstepCount - 1;
+				AutoSubstepCalmUpdates = 0;
+			}
+
+			NewCount = FMath::Clamp(NewCount, FMath::Max(AutoSubstepMinCount, 1), FMath::Max(AutoSubstepMinCount, AutoSubstepMaxCount));
+			if (NewCount != AutoSubstepCount)
+			{
+				INC_DWORD_STAT(STAT_VehicleNW_AutoSubstepChanges);
+				AutoSubstepCount = NewCount;
+				bSubstepCountDirty = true;
+			}
+		}
+	}
+
+#if STATS
+	// Mirror the choice PhysX makes in PxVehicleUpdates.
+	int32 NumSubsteps = AutoSubstepCount;
+	if (SimulationLOD == EVehicleNWSimulationLOD::Reduced)
+	{
+		NumSubsteps = ReducedLODSubstepCount;
+	}
+	else if (!bAutoSubstep)
+	{
+		const bool bLowSpeed = FMath::Abs(PVehicleDriveNW.computeForwardSpeed()) < KmHToCmS(SubstepThresholdSpeed);
+		NumSubsteps = bLowSpeed ? LowSpeedSubstepCount : HighSpeedSubstepCount;
+	}
+	INC_DWORD_STAT_BY(STAT_VehicleNW_WheelSubsteps, NumSubsteps);
+#endif
+}
+
+void UVehicleMovementComponentNW::RecordTelemetry_AssumesLocked(FVehicleNWTelemetryRecorder::FProducer& Producer, const PxVehicleDriveNW& PVehicleDriveNW, float DeltaTime) const
+{
+	FVehicleNWTelemetrySample Sample;
+	FVehicleNWTelemetryRecord& Record = Sample.Record;
+	Record.Time = GetWorld()->GetTimeSeconds();
+	Record.VehicleId = GetUniqueID();
+	Record.DeltaTime = DeltaTime;
+	// PhysX has reverse as gear 0.
+	Record.Gear = (int8)((int32)PVehicleDriveNW.mDriveDynData.getCurrentGear() - 1);
+	Record.Pad = 0;
+	Record.EngineRPM = OmegaToRPM(PVehicleDriveNW.mDriveDynData.getEngineRotationSpeed());
+	Record.ForwardSpeed = PVehicleDriveNW.computeForwardSpeed();
+	Record.Throttle = PhysicsInputs.Throttle;
+	Record.Steering = PhysicsInputs.Steering;
+	Record.Brake = PhysicsInputs.Brake;
+	Record.Handbrake = PhysicsInputs.Handbrake;
+	Record.Reserved = 0;
+
+	const PxWheelQueryResult* WheelsStates = GetWheelsStates_AssumesLocked();
+	const int32 NumWheels = WheelsStates ? FMath::Min<int32>(PVehicleDriveNW.mWheelsSimData.getNbWheels(), VehicleNWTelemetry::MaxWheels) : 0;
+	Record.NumWheels = (uint8)NumWheels;
+	for (int32 WheelIdx = 0; WheelIdx < NumWheels; WheelIdx++)
+	{
+		Sample.Wheels[WheelIdx].LongitudinalSlip = WheelsStates[WheelIdx].longitudinalSlip;
+		Sample.Wheels[WheelIdx].LateralSlip = WheelsStates[WheelIdx].lateralSlip;
+		Sample.Wheels[WheelIdx].SuspensionOffset = WheelsStates[WheelIdx].suspJounce;
+	}
+
+	Producer.Push(Sample);
+}
+#endif // WITH_PHYSX_VEHICLES
+
+void UVehicleMovementComponentNW::SetWheelSubsteps(float NewThresholdSpeed, int32 NewLowSpeedSubstepCount, int32 NewHighSpeedSubstepCount)
+{
+	SubstepThresholdSpeed = FMath::Max(NewThresholdSpeed, 0.f);
+	LowSpeedSubstepCount = FMath::Max(NewLowSpeedSubstepCount, 1);
+	HighSpeedSubstepCount = FMath::Max(NewHighSpeedSubstepCount, 1);
+
+#if WITH_PHYSX_VEHICLES
+	if (PVehicleDrive && UpdatedPrimitive)
+	{
+		FPhysicsCommand::ExecuteWrite(UpdatedPrimitive->GetBodyInstance()->ActorHandle, [&](const FPhysicsActorHandle&)
+		{
+			ApplySubstepCount_AssumesLocked(*(PxVehicleDriveNW*)PVehicleDrive);
+		});
+	}
+#endif // WITH_PHYSX_VEHICLES
+}
+
+void UVehicleMovementComponentNW::SetAutoSubstep(bool bNewAutoSubstep)
+{
+	bAutoSubstep = bNewAutoSubstep;
+	AutoSubstepCount = FMath::Max(AutoSubstepMinCount, 1);
+	AutoSubstepCalmUpdates = 0;
+	AutoSubstepPrevSlips.Reset();
+
+#if WITH_PHYSX_VEHICLES
+	if (PVehicleDrive && UpdatedPrimitive)
+	{
+		FPhysicsCommand::ExecuteWrite(UpdatedPrimitive->GetBodyInstance()->ActorHandle, [&](const FPhysicsActorHandle&)
+		{
+			ApplySubstepCount_AssumesLocked(*(PxVehicleDriveNW*)PVehicleDrive);
+		});
+	}
+#endif // WITH_PHYSX_VEHICLES
+}
+
+void UVehicleMovementComponentNW::TickComponent(float DeltaTime, enum ELevelTick TickType, FActorComponentTickFunction *ThisTickFunction)
+{
+	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
+
+#if WITH_PHYSX_VEHICLES
+	if (PendingSetup.IsValid() && PendingSetup->IsComplete())
+	{
+		FinishAsyncSetup();
+	}
+#endif // WITH_PHYSX_VEHICLES
+
+	// What the last physics steps left pending. Not done in UpdateSimulation, which runs inside the vehicle manager's and
+	// the fleet's loops over their vehicles, and handlers may destroy or unregister vehicles.
+	if (bPendingSleep)
+	{
+		PutToSleep();
+	}
+	BroadcastSurfaceChanges();
+	BroadcastStepChanges();
+
+	if (bReplicateQuantizedState && GetOwnerRole() == ROLE_Authority && GetNetMode() != NM_Standalone)
+	{
+		UpdateNetUpdateFrequency();
+	}
+
+	if (bEnableSimulationLOD && UpdatedPrimitive)
+	{
+		LODEvaluationTimer -= DeltaTime;
+		if (LODEvaluationTimer <= 0.f)
+		{
+			LODEvaluationTimer = LODEvaluationInterval;
+			SetSimulationLOD(EvaluateSimulationLOD());
+		}
+	}
+
+	if (bAsleep)
+	{
+		INC_DWORD_STAT(STAT_VehicleNW_Asleep);
+	}
+
+	switch (SimulationLOD)
+	{
+	case EVehicleNWSimulationLOD::Full:
+		INC_DWORD_STAT(STAT_VehicleNW_FullLOD);
+		break;
+	case EVehicleNWSimulationLOD::Reduced:
+		INC_DWORD_STAT(STAT_VehicleNW_ReducedLOD);
+		break;
+	case EVehicleNWSimulationLOD::Rail:
+		INC_DWORD_STAT(STAT_VehicleNW_RailLOD);
+		TickRail(DeltaTime);
+		break;
+	}
+}
+
+void UVehicleMovementComponentNW::WakeVehicle()
+{
+	if (!bAsleep)
+	{
+		return;
+	}
+
+#if WITH_PHYSX_VEHICLES
+	if (PVehicleDrive && UpdatedPrimitive)
+	{
+		FPhysicsCommand::ExecuteWrite(UpdatedPrimitive->GetBodyInstance()->ActorHandle, [&](const FPhysicsActorHandle&)
+		{
+			WakeVehicle_AssumesLocked(*(PxVehicleDriveNW*)PVehicleDrive);
+		});
+		return;
+	}
+#endif // WITH_PHYSX_VEHICLES
+
+	// No body to wake.
+	bAsleep = false;
+	RestTime = 0.f;
+	INC_DWORD_STAT(STAT_VehicleNW_WakeUps);
+}
+
+#if WITH_PHYSX_VEHICLES
+void UVehicleMovementComponentNW::WakeVehicle_AssumesLocked(PxVehicleDriveNW& PVehicleDriveNW)
+{
+	if (!bAsleep)
+	{
+		return;
+	}
+
+	bAsleep = false;
+	RestTime = 0.f;
+	INC_DWORD_STAT(STAT_VehicleNW_WakeUps);
+	PVehicleDriveNW.getRigidDynamicActor()->wakeUp();
+}
+#endif // WITH_PHYSX_VEHICLES
+
+void UVehicleMovementComponentNW::OnBodyWake(UPrimitiveComponent* WakingComponent, FName BoneName)
+{
+	// The body is already awake, only the vehicle state follows.
+	if (bAsleep)
+	{
+		bAsleep = false;
+		RestTime = 0.f;
+		INC_DWORD_STAT(STAT_VehicleNW_WakeUps);
+	}
+}
+
+bool UVehicleMovementComponentNW::IsVehicleReady() const
+{
+	// Rail vehicles have no PhysX vehicle.
+	if (SimulationLOD == EVehicleNWSimulationLOD::Rail)
+	{
+		return true;
+	}
+#if WITH_PHYSX_VEHICLES
+	return PVehicleDrive != nullptr;
+#else
+	return false;
+#endif // WITH_PHYSX_VEHICLES
+}
+
+EVehicleNWSimulationLOD UVehicleMovementComponentNW::EvaluateSimulationLOD() const
+{
+	const UWorld* World = GetWorld();
+	if (World == nullptr)
+	{
+		return SimulationLOD;
+	}
+
+	const FVector Location = UpdatedComponent->GetComponentLocation();
+	float ClosestDistSquared = MAX_flt;
+	for (FConstPlayerControllerIterator Iterator = World->GetPlayerControllerIterator(); Iterator; ++Iterator)
+	{
+		if (const APlayerController* PlayerController = Iterator->Get())
+		{
+			FVector ViewLocation;
+			FRotator ViewRotation;
+			PlayerController->GetPlayerViewPoint(ViewLocation, ViewRotation);
+			ClosestDistSquared = FMath::Min(ClosestDistSquared, FVector::DistSquared(ViewLocation, Location));
+		}
+	}
+
+	// No player to be seen by, keep the current LOD.
+	if (ClosestDistSquared == MAX_flt)
+	{
+		return SimulationLOD;
+	}
+
+	// A tier is left only once the vehicle is LODDistanceHysteresis inside its threshold.
+	const float ClosestDist = FMath::Sqrt(ClosestDistSquared);
+	auto IsBeyond = [&](float Distance, EVehicleNWSimulationLOD LOD)
+	{
+		return ClosestDist > (SimulationLOD >= LOD ? Distance - LODDistanceHysteresis : Distance);
+	};
+
+	if (IsBeyond(RailLODDistance, EVehicleNWSimulationLOD::Rail))
+	{
+		return EVehicleNWSimulationLOD::Rail;
+	}
+
+	if (IsBeyond(ReducedLODDistance, EVehicleNWSimulationLOD::Reduced))
+	{
+		return EVehicleNWSimulationLOD::Reduced;
+	}
+
+	const AActor* Owner = GetOwner();
+	if (bReduceLODWhenNotRendered && Owner && !Owner->WasRecentlyRendered(LODEvaluationInterval))
+	{
+		return EVehicleNWSimulationLOD::Reduced;
+	}
+
+	return EVehicleNWSimulationLOD::Full;
+}
+
+void UVehicleMovementComponentNW::SetSimulationLOD(EVehicleNWSimulationLOD NewLOD)
+{
+	if (NewLOD == SimulationLOD || UpdatedPrimitive == nullptr)
+	{
+		return;
+	}
+
+	INC_DWORD_STAT(STAT_VehicleNW_LODTransitions);
+	UE_LOG(LogVehicleNW, Verbose, TEXT("%s simulation LOD %d -> %d"), *GetPathName(), (int32)SimulationLOD, (int32)NewLOD);
+
+	const EVehicleNWSimulationLOD OldLOD = SimulationLOD;
+	SimulationLOD = NewLOD;
+	ReducedLODStepCounter = 0;
+	ReducedLODAccumulatedTime = 0.f;
+
+#if WITH_PHYSX_VEHICLES
+	if (OldLOD == EVehicleNWSimulationLOD::Rail)
+	{
+		// Back to a simulated body carrying the rail velocity, SetupVehicle restores the drivetrain.
+		UpdatedPrimitive->SetSimulatePhysics(true);
+		UpdatedPrimitive->SetPhysicsLinearVelocity(RailVelocity);
+		RecreatePhysicsState();
+	}
+	else if (NewLOD == EVehicleNWSimulationLOD::Rail)
+	{
+		RailVelocity = UpdatedPrimitive->GetPhysicsLinearVelocity();
+
+		if (PVehicleDrive)
+		{
+			const PxVehicleDriveDynData& DriveDynData = ((PxVehicleDriveNW*)PVehicleDrive)->mDriveDynData;
+			FPhysicsCommand::ExecuteRead(UpdatedPrimitive->GetBodyInstance()->ActorHandle, [&](const FPhysicsActorHandle&)
+			{
+				RailSavedGear = DriveDynData.getCurrentGear();
+				RailSavedEngineRotationSpeed = DriveDynData.getEngineRotationSpeed();
+			});
+			bRestoreRailDrivetrain = true;
+		}
+
+		const FVector Location = UpdatedComponent->GetComponentLocation();
+		RailRideHeight = TraceRailGround(Location) ? FVector::DotProduct(Location - RailGroundPoint, RailGroundNormal) : 0.f;
+		RailGroundTraceCounter = 0;
+
+		// Releases the PhysX vehicle, SetupVehicle does not create one while on rails.
+		RecreatePhysicsState();
+		UpdatedPrimitive->SetSimulatePhysics(false);
+	}
+	else if (PVehicleDrive)
+	{
+		FPhysicsCommand::ExecuteWrite(UpdatedPrimitive->GetBodyInstance()->ActorHandle, [&](const FPhysicsActorHandle&)
+		{
+			ApplySubstepCount_AssumesLocked(*(PxVehicleDriveNW*)PVehicleDrive);
+		});
+	}
+#endif // WITH_PHYSX_VEHICLES
+}
+
+void UVehicleMovementComponentNW::TickRail(float DeltaTime)
+{
+	FVector Location = UpdatedComponent->GetComponentLocation() + RailVelocity * DeltaTime;
+
+	if (--RailGroundTraceCounter <= 0)
+	{
+		RailGroundTraceCounter = RailGroundTraceInterval;
+		TraceRailGround(Location);
+	}
+
+	// Stick to the last ground plane sampled and follow its slope.
+	Location -= RailGroundNormal * (FVector::DotProduct(Location - RailGroundPoint, RailGroundNormal) - RailRideHeight);
+	RailVelocity = FVector::VectorPlaneProject(RailVelocity, RailGroundNormal);
+
+	FQuat Rotation = UpdatedComponent->GetComponentQuat();
+	if (!RailVelocity.IsNearlyZero())
+	{
+		// Keep the heading of vehicles left on rails while reversing.
+		const bool bReversing = FVector::DotProduct(RailVelocity, Rotation.GetForwardVector()) < 0.f;
+		Rotation = FRotationMatrix::MakeFromXZ(bReversing ? -RailVelocity : RailVelocity, RailGroundNormal).ToQuat();
+	}
+
+	UpdatedComponent->SetWorldLocationAndRotation(Location, Rotation, false, nullptr, ETeleportType::TeleportPhysics);
+}
+
+bool UVehicleMovementComponentNW::TraceRailGround(const FVector& Location)
+{
+	FCollisionQueryParams QueryParams(SCENE_QUERY_STAT(VehicleNWRailGround), false, GetOwner());
+	const FVector TraceOffset = RailGroundNormal * 500.f;
+
+	FHitResult Hit;
+	if (!GetWorld()->LineTraceSingleByChannel(Hit, Location + TraceOffset, Location - TraceOffset * 2.f, ECC_WorldStatic, QueryParams))
+	{
+		return false;
+	}
+
+	RailGroundPoint = Hit.ImpactPoint;
+	RailGroundNormal = Hit.ImpactNormal;
+	return true;
+}
+
+void UVehicleMovementComponentNW::BeginTuning()
+{
+	TuningDepth++;
+}
+
+void UVehicleMovementComponentNW::CommitTuning()
+{
+	if (TuningDepth > 0 && --TuningDepth > 0)
+	{
+		return;
+	}
+
+	const EVehicleNWTuningSection Sections = PendingTuning;
+	PendingTuning = EVehicleNWTuningSection::None;
+
+	if (EnumHasAnyFlags(Sections, EVehicleNWTuningSection::Steering))
+	{
+		MarkInputSmoothingDirty();
+	}
+
+	if (!EnumHasAnyFlags(Sections, EVehicleNWTuningSection::Drivetrain))
+	{
+		return;
+	}
+
+	SCOPE_CYCLE_COUNTER(STAT_VehicleNW_CommitTuning);
+
+	// An up to date blob only needs the changed sections, a stale one is compiled whole below.
+	if (CompiledDrivetrainVersion == DrivetrainVersion)
+	{
+		if (EnumHasAnyFlags(Sections, EVehicleNWTuningSection::Engine))
+		{
+			DrivetrainBlob.CompileEngine(EngineSetup);
+		}
+		if (EnumHasAnyFlags(Sections, EVehicleNWTuningSection::Clutch))
+		{
+			DrivetrainBlob.CompileClutch(TransmissionSetup);
+		}
+		if (EnumHasAnyFlags(Sections, EVehicleNWTuningSection::Gears))
+		{
+			DrivetrainBlob.CompileGears(TransmissionSetup);
+		}
+		if (EnumHasAnyFlags(Sections, EVehicleNWTuningSection::AutoBox))
+		{
+			DrivetrainBlob.CompileAutoBox(TransmissionSetup);
+		}
+		if (EnumHasAnyFlags(Sections, EVehicleNWTuningSection::Differential))
+		{
+			DrivetrainBlob.CompileDifferential(DifferentialSetup);
+		}
+	}
+	const FVehicleNWDrivetrainBlob& Blob = GetDrivetrainBlob();
+
+#if WITH_PHYSX_VEHICLES
+	FBodyInstance* BodyInstance = UpdatedPrimitive ? UpdatedPrimitive->GetBodyInstance() : nullptr;
+	if (!PVehicleDrive || !BodyInstance)
+	{
+		return;
+	}
+
+	// Convert before taking the lock, it is held for the setters only.
+	PxVehicleEngineData EngineData;
+	PxVehicleClutchData ClutchData;
+	PxVehicleGearsData GearsData;
+	PxVehicleAutoBoxData AutoBoxData;
+	PxVehicleDifferentialNWData DifferentialData;
+	if (EnumHasAnyFlags(Sections, EVehicleNWTuningSection::Engine))
+	{
+		SCOPE_CYCLE_COUNTER(STAT_VehicleNW_UpdateEngineSetup);
+		Blob.GetEngineData(EngineData);
+	}
+	if (EnumHasAnyFlags(Sections, EVehicleNWTuningSection::Transmission))
+	{
+		SCOPE_CYCLE_COUNTER(STAT_VehicleNW_UpdateTransmissionSetup);
+		if (EnumHasAnyFlags(Sections, EVehicleNWTuningSection::Clutch))
+		{
+			Blob.GetClutchData(ClutchData);
+		}
+		if (EnumHasAnyFlags(Sections, EVehicleNWTuningSection::Gears))
+		{
+			Blob.GetGearsData(GearsData);
+		}
+		if (EnumHasAnyFlags(Sections, EVehicleNWTuningSection::AutoBox))
+		{
+			Blob.GetAutoBoxData(AutoBoxData);
+		}
+	}
+	if (EnumHasAnyFlags(Sections, EVehicleNWTuningSection::Differential))
+	{
+		SCOPE_CYCLE_COUNTER(STAT_VehicleNW_UpdateDifferentialSetup);
+		Blob.GetDifferentialData(DifferentialData);
+	}
+
+	FPhysicsCommand::ExecuteWrite(BodyInstance->ActorHandle, [&](const FPhysicsActorHandle&)
+	{
+		PxVehicleDriveNW* PVehicleDriveNW = (PxVehicleDriveNW*)PVehicleDrive;
+		PxVehicleDriveSimDataNW& DriveSimData = PVehicleDriveNW->mDriveSimData;
+
+		if (EnumHasAnyFlags(Sections, EVehicleNWTuningSection::Engine))
+		{
+			DriveSimData.setEngineData(EngineData);
+		}
+		if (EnumHasAnyFlags(Sections, EVehicleNWTuningSection::Clutch))
+		{
+			DriveSimData.setClutchData(ClutchData);
+		}
+		if (EnumHasAnyFlags(Sections, EVehicleNWTuningSection::Gears))
+		{
+			DriveSimData.setGearsData(GearsData);
+		}
+		if (EnumHasAnyFlags(Sections, EVehicleNWTuningSection::AutoBox))
+		{
+			DriveSimData.setAutoBoxData(AutoBoxData);
+			PVehicleDriveNW->mDriveDynData.setUseAutoGears(TransmissionSetup.bUseGearAutoBox);
+		}
+		if (EnumHasAnyFlags(Sections, EVehicleNWTuningSection::Differential))
+		{
+			DriveSimData.setDiffData(DifferentialData);
+		}
+	});
+#endif // WITH_PHYSX_VEHICLES
+}
+
+void UVehicleMovementComponentNW::MarkTuningDirty(EVehicleNWTuningSection Sections)
+{
+	PendingTuning |= Sections;
+	if (TuningDepth == 0)
+	{
+		CommitTuning();
+	}
+}
+
+void UVehicleMovementComponentNW::TuneEngine(const FVehicleEngineNWData& NewEngineSetup)
+{
+	EngineSetup = NewEngineSetup;
+	MarkTuningDirty(EVehicleNWTuningSection::Engine);
+}
+
+void UVehicleMovementComponentNW::TuneClutch(float NewClutchStrength)
+{
+	TransmissionSetup.ClutchStrength = NewClutchStrength;
+	MarkTuningDirty(EVehicleNWTuningSection::Clutch);
+}
+
+void UVehicleMovementComponentNW::TuneGears(const TArray<FVehicleGearNWData>& NewForwardGears, float NewReverseGearRatio, float NewFinalRatio, float NewGearSwitchTime)
+{
+	TransmissionSetup.ForwardGears = NewForwardGears;
+	TransmissionSetup.ReverseGearRatio = NewReverseGearRatio;
+	TransmissionSetup.FinalRatio = NewFinalRatio;
+	TransmissionSetup.GearSwitchTime = NewGearSwitchTime;
+	MarkTuningDirty(EVehicleNWTuningSection::Gears | EVehicleNWTuningSection::AutoBox);
+}
+
+void UVehicleMovementComponentNW::TuneAutoBox(bool bNewUseGearAutoBox, float NewGearAutoBoxLatency)
+{
+	TransmissionSetup.bUseGearAutoBox = bNewUseGearAutoBox;
+	TransmissionSetup.GearAutoBoxLatency = NewGearAutoBoxLatency;
+	MarkTuningDirty(EVehicleNWTuningSection::AutoBox);
+}
+
+void UVehicleMovementComponentNW::TuneTransmission(const FVehicleTransmissionNWData& NewTransmissionSetup)
+{
+	TransmissionSetup = NewTransmissionSetup;
+	MarkTuningDirty(EVehicleNWTuningSection::Transmission);
+}
+
+void UVehicleMovementComponentNW::TuneDifferential(const FVehicleDifferentialNWData& NewDifferentialSetup)
+{
+	DifferentialSetup = NewDifferentialSetup;
+	MarkTuningDirty(EVehicleNWTuningSection::Differential);
+}
+
+void UVehicleMovementComponentNW::UpdateEngineSetup(const FVehicleEngineNWData& NewEngineSetup)
+{
+	TuneEngine(NewEngineSetup);
+}
+
+void UVehicleMovementComponentNW::UpdateDifferentialSetup(const FVehicleDifferentialNWData& NewDifferentialSetup)
+{
+	TuneDifferential(NewDifferentialSetup);
+}
+
+void UVehicleMovementComponentNW::UpdateTransmissionSetup(const FVehicleTransmissionNWData& NewTransmissionSetup)
+{
+	TuneTransmission(NewTransmissionSetup);
+}
+
+void BackwardsConvertCm2ToM2(float& val, float defaultValue)
+{
+	if (val != defaultValue)
+	{
+		val = Cm2ToM2(val);
+	}
+}
+
+void UVehicleMovementComponentNW::Serialize(FArchive & Ar)
+{
+	Super::Serialize(Ar);
+#if WITH_PHYSX_VEHICLES
+	if (Ar.IsLoading() && Ar.UE4Ver() < VER_UE4_VEHICLES_UNIT_CHANGE)
+	{
+		PxVehicleEngineData DefEngineData;
+		float DefaultRPM = OmegaToRPM(DefEngineData.mMaxOmega);
+
+		// We need to convert from old units to new. This backwards compatible code fails in the rare case that they were using very strange values that are the new defaults in the correct units.
+		EngineSetup.MaxRPM = EngineSetup.MaxRPM != DefaultRPM ? OmegaToRPM(EngineSetup.MaxRPM) : DefaultRPM;	// Need to convert from rad/s to RPM.
+	}
+
+	if (Ar.IsLoading() && Ar.UE4Ver() < VER_UE4_VEHICLES_UNIT_CHANGE2)
+	{
+		PxVehicleEngineData DefEngineData;
+		PxVehicleClutchData DefClutchData;
+
+		// We need to convert from old units to new. This backwards compatible code fails in the rare case that they were using very strange values that are the new defaults in the correct units.
+		BackwardsConvertCm2ToM2(EngineSetup.DampingRateFullThrottle, DefEngineData.mDampingRateFullThrottle);
+		BackwardsConvertCm2ToM2(EngineSetup.DampingRateZeroThrottleClutchDisengaged, DefEngineData.mDampingRateZeroThrottleClutchDisengaged);
+		BackwardsConvertCm2ToM2(EngineSetup.DampingRateZeroThrottleClutchEngaged, DefEngineData.mDampingRateZeroThrottleClutchEngaged);
+		BackwardsConvertCm2ToM2(EngineSetup.MOI, DefEngineData.mMOI);
+		BackwardsConvertCm2ToM2(TransmissionSetup.ClutchStrength, DefClutchData.mStrength);
+	}
+#endif
+	if (Ar.IsLoading())
+	{
+		MarkDrivetrainDirty();
+	}
+}
+
+void UVehicleMovementComponentNW::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const
+{
+	Super::GetLifetimeReplicatedProps(OutLifetimeProps);
+
+	// The owning client needs it too, generic movement is off for every connection. Only sent with
+	// bReplicateQuantizedState, see PreReplication.
+	DOREPLIFETIME_CONDITION(UVehicleMovementComponentNW, NWReplicatedState, COND_Custom);
+}
+
+void UVehicleMovementComponentNW::BeginPlay()
+{
+	Super::BeginPlay();
+
+	// The quantized state carries the transform, no need to send it twice.
+	AActor* Owner = GetOwner();
+	if (bReplicateQuantizedState && Owner && Owner->HasAuthority())
+	{
+		Owner->SetReplicatingMovement(false);
+	}
+}
+
+void UVehicleMovementComponentNW::PreReplication(IRepChangedPropertyTracker& ChangedPropertyTracker)
+{
+	Super::PreReplication(ChangedPropertyTracker);
+
+	// Without it the state is never captured, proxies would be sent a default one.
+	DOREPLIFETIME_ACTIVE_OVERRIDE(UVehicleMovementComponentNW, NWReplicatedState, bReplicateQuantizedState);
+
+	if (bReplicateQuantizedState)
+	{
+		CaptureReplicatedState(NWReplicatedState);
+	}
+}
+
+void UVehicleMovementComponentNW::CaptureReplicatedState(FVehicleNWReplicatedState& OutState) const
+{
+	if (UpdatedPrimitive == nullptr)
+	{
+		return;
+	}
+
+	OutState.Location = UpdatedComponent->GetComponentLocation();
+	OutState.Rotation = UpdatedComponent->GetComponentQuat();
+	OutState.LinearVelocity = UpdatedPrimitive->GetPhysicsLinearVelocity();
+	OutState.AngularVelocity = UpdatedPrimitive->GetPhysicsAngularVelocityInDegrees();
+
+	OutState.WheelRotation.SetNumUninitialized(Wheels.Num());
+	for (int32 WheelIdx = 0; WheelIdx < Wheels.Num(); WheelIdx++)
+	{
+		OutState.WheelRotation[WheelIdx] = Wheels[WheelIdx] ? Wheels[WheelIdx]->GetRotationAngle() : 0.f;
+	}
+
+#if WITH_PHYSX_VEHICLES
+	if (PVehicleDrive)
+	{
+		const PxVehicleDriveDynData& DriveDynData = ((PxVehicleDriveNW*)PVehicleDrive)->mDriveDynData;
+		FPhysicsCommand::ExecuteRead(UpdatedPrimitive->GetBodyInstance()->ActorHandle, [&](const FPhysicsActorHandle&)
+		{
+			OutState.Gear = (int32)DriveDynData.getCurrentGear();
+			OutState.EngineRotationSpeed = DriveDynData.getEngineRotationSpeed();
+		});
+	}
+#endif // WITH_PHYSX_VEHICLES
+}
+
+void UVehicleMovementComponentNW::OnRep_NWReplicatedState()
+{
+	// Deltas whose base was lost decode nothing, the proxy keeps what it has until the next keyframe.
+	if (!NWReplicatedState.bNewStateReceived)
+	{
+		return;
+	}
+	NWReplicatedState.bNewStateReceived = false;
+
+	if (!bReplicateQuantizedState || UpdatedPrimitive == nullptr || SimulationLOD == EVehicleNWSimulationLOD::Rail)
+	{
+		return;
+	}
+
+	const FVehicleNWReplicatedState& State = NWReplicatedState;
+
+	// The owning client keeps its own drivetrain and is pulled towards the server body the way generic physics
+	// movement would, through the physics replication of the scene.
+	if (GetOwnerRole() == ROLE_AutonomousProxy)
+	{
+		FRigidBodyState Target;
+		Target.Position = State.Location;
+		Target.Quaternion = State.Rotation;
+		Target.LinVel = State.LinearVelocity;
+		Target.AngVel = State.AngularVelocity;
+		Target.Flags = ERigidBodyFlags::NeedsUpdate;
+		UpdatedPrimitive->SetRigidBodyReplicatedTarget(Target);
+		return;
+	}
+
+	if (GetOwnerRole() != ROLE_SimulatedProxy)
+	{
+		return;
+	}
+	UpdatedComponent->SetWorldLocationAndRotation(State.Location, State.Rotation, false, nullptr, ETeleportType::TeleportPhysics);
+	UpdatedPrimitive->SetPhysicsLinearVelocity(State.LinearVelocity);
+	UpdatedPrimitive->SetPhysicsAngularVelocityInDegrees(State.AngularVelocity);
+
+#if WITH_PHYSX_VEHICLES
+	// Extrapolate from the server drivetrain rather than from whatever the proxy converged to.
+	if (PVehicleDrive)
+	{
+		PxVehicleDriveNW* PVehicleDriveNW = (PxVehicleDriveNW*)PVehicleDrive;
+		FPhysicsCommand::ExecuteWrite(UpdatedPrimitive->GetBodyInstance()->ActorHandle, [&](const FPhysicsActorHandle&)
+		{
+			if ((int32)PVehicleDriveNW->mDriveDynData.getCurrentGear() != State.Gear)
+			{
+				PVehicleDriveNW->mDriveDynData.forceGearChange(State.Gear);
+			}
+			PVehicleDriveNW->mDriveDynData.setEngineRotationSpeed(State.EngineRotationSpeed);
+
+			const int32 NumWheels = FMath::Min<int32>(State.WheelRotation.Num(), PVehicleDriveNW->mWheelsSimData.getNbWheels());
+			for (int32 WheelIdx = 0; WheelIdx < NumWheels; WheelIdx++)
+			{
+				// UVehicleWheel reports the PhysX angle negated.
+				PVehicleDriveNW->mWheelsDynData.setWheelRotationAngle(WheelIdx, -FMath::DegreesToRadians(State.WheelRotation[WheelIdx]));
+			}
+		});
+	}
+#endif // WITH_PHYSX_VEHICLES
+}
+
+void UVehicleMovementComponentNW::UpdateNetUpdateFrequency()
+{
+	AActor* Owner = GetOwner();
+	if (Owner == nullptr)
+	{
+		return;
+	}
+
+	// Driven vehicles are fully active, coasting ones by speed.
+	const bool bHasInput = RawThrottleInput != 0.f || RawSteeringInput != 0.f || RawBrakeInput != 0.f || bRawHandbrakeInput;
+	const float ActiveSpeed = FMath::Max(KmHToCmS(ActiveNetSpeed), KINDA_SMALL_NUMBER);
+	const float Activity = bHasInput ? 1.f : FMath::Clamp(FMath::Abs(GetForwardSpeed()) / ActiveSpeed, 0.f, 1.f);
+
+	Owner->MinNetUpdateFrequency = IdleNetUpdateFrequency;
+	Owner->NetUpdateFrequency = FMath::Lerp(IdleNetUpdateFrequency, FMath::Max(ActiveNetUpdateFrequency, IdleNetUpdateFrequency), Activity);
+
+	const int32 Gear = GetCurrentGear();
+	if (Gear != LastNetGear)
+	{
+		LastNetGear = Gear;
+		Owner->ForceNetUpdate();
+	}
+}
+
+FVehicleNWInputFrame UVehicleMovementComponentNW::GetInputFrame(float DeltaTime) const
+{
+	FVehicleNWInputFrame InputFrame = PhysicsInputs;
+	InputFrame.DeltaTime = DeltaTime;
+	return InputFrame;
+}
+
+void UVehicleMovementComponentNW::SetInputFrame(const FVehicleNWInputFrame& InputFrame)
+{
+	PhysicsInputs = InputFrame;
+}
+
+void UVehicleMovementComponentNW::PreTick(float DeltaTime)
+{
+	// The base class only smooths the raw inputs with a local controller, other vehicles take ReplicatedState. Unpossessed
+	// traffic on the authority gets its smoothed inputs there, as ServerUpdateState would have set them.
+	if (bDrivenByTraffic && PVehicle && GetOwnerRole() == ROLE_Authority)
+	{
+		AController* Controller = GetController();
+		if (Controller == nullptr || !Controller->IsLocalController())
+		{
+			ReplicatedState.SteeringInput = SteeringInputRate.InterpInputValue(DeltaTime, SteeringInput, CalcSteeringInput());
+			ReplicatedState.ThrottleInput = ThrottleInputRate.InterpInputValue(DeltaTime, ThrottleInput, CalcThrottleInput());
+			ReplicatedState.BrakeInput = BrakeInputRate.InterpInputValue(DeltaTime, BrakeInput, CalcBrakeInput());
+			ReplicatedState.HandbrakeInput = HandbrakeInputRate.InterpInputValue(DeltaTime, HandbrakeInput, CalcHandbrakeInput());
+			ReplicatedState.CurrentGear = GetTargetGear();
+		}
+	}
+
+	// Smooths the raw inputs into ThrottleInput and co.
+	Super::PreTick(DeltaTime);
+
+	FVehicleNWInputFrame& InputFrame = InputChannel.GetWriteFrame();
+	InputFrame.DeltaTime = DeltaTime;
+	InputFrame.Throttle = ThrottleInput;
+	InputFrame.Steering = SteeringInput;
+	InputFrame.Brake = BrakeInput;
+	InputFrame.Handbrake = HandbrakeInput;
+	InputFrame.bGearUp = bRawGearUpInput;
+	InputFrame.bGearDown = bRawGearDownInput;
+	InputChannel.Publish();
+}
+
+void UVehicleMovementComponentNW::ConsumeInputs()
+{
+	if (InputChannel.Consume())
+	{
+		PhysicsInputs = InputChannel.GetReadFrame();
+	}
+}
+
+bool UVehicleMovementComponentNW::CaptureSnapshot(FVehicleNWSnapshot& OutSnapshot) const
+{
+#if WITH_PHYSX_VEHICLES
+	if (PVehicleDrive == nullptr)
+	{
+		return false;
+	}
+
+	FPhysicsCommand::ExecuteRead(UpdatedPrimitive->GetBodyInstance()->ActorHandle, [&](const FPhysicsActorHandle&)
+	{
+		CaptureSnapshot_AssumesLocked(*(PxVehicleDriveNW*)PVehicleDrive, OutSnapshot);
+	});
+	return true;
+#else
+	return false;
+#endif // WITH_PHYSX_VEHICLES
+}
+
+bool UVehicleMovementComponentNW::SaveSnapshot(int32 Frame)
+{
+	SCOPE_CYCLE_COUNTER(STAT_VehicleNW_SaveSnapshot);
+
+	FVehicleNWSnapshot* Snapshot = SnapshotRing.Write(Frame);
+	if (Snapshot && !CaptureSnapshot(*Snapshot))
+	{
+		Snapshot->Frame = INDEX_NONE;
+		return false;
+	}
+	return Snapshot != nullptr;
+}
+
+bool UVehicleMovementComponentNW::RestoreSnapshot(int32 Frame)
+{
+	SCOPE_CYCLE_COUNTER(STAT_VehicleNW_RestoreSnapshot);
+
+#if WITH_PHYSX_VEHICLES
+	const FVehicleNWSnapshot* Snapshot = PVehicleDrive ? SnapshotRing.Find(Frame) : nullptr;
+	if (Snapshot == nullptr)
+	{
+		return false;
+	}
+
+	FPhysicsCommand::ExecuteWrite(UpdatedPrimitive->GetBodyInstance()->ActorHandle, [&](const FPhysicsActorHandle&)
+	{
+		RestoreSnapshot_AssumesLocked(*(PxVehicleDriveNW*)PVehicleDrive, *Snapshot);
+	});
+	return true;
+#else
+	return false;
+#endif // WITH_PHYSX_VEHICLES
+}
+
+int32 UVehicleMovementComponentNW::ResimulateFromSnapshot(int32 Frame, TArrayView<const FVehicleNWInputFrame> InputFrames, bool bSaveSnapshots)
+{
+	SCOPE_CYCLE_COUNTER(STAT_VehicleNW_Resimulate);
+
+	int32 NumFrames = 0;
+
+#if WITH_PHYSX_VEHICLES
+	const FVehicleNWSnapshot* Snapshot = PVehicleDrive ? SnapshotRing.Find(Frame) : nullptr;
+	if (Snapshot == nullptr)
+	{
+		return 0;
+	}
+
+	// Recompile outside of the physics lock.
+	CompileInputSmoothingCache();
+
+	PxVehicleDriveNW& PVehicleDriveNW = *(PxVehicleDriveNW*)PVehicleDrive;
+	FVehicleNWLockTimer LockTimer;
+	FPhysicsCommand::ExecuteWrite(UpdatedPrimitive->GetBodyInstance()->ActorHandle, [&](const FPhysicsActorHandle&)
+	{
+		LockTimer.Acquired();
+
+		RestoreSnapshot_AssumesLocked(PVehicleDriveNW, *Snapshot);
+
+		if (!ResimContext.IsValid())
+		{
+			ResimContext = MakeUnique<FVehicleNWResimContext>(PVehicleDriveNW);
+		}
+		if (!ResimContext->IsValid())
+		{
+			return;
+		}
+		ResimContext->SetHeightfieldSuspension(bHeightfieldSuspension);
+
+		for (const FVehicleNWInputFrame& InputFrame : InputFrames)
+		{
+			SetInputFrame(InputFrame);
+			PushInputs_AssumesLocked(PVehicleDriveNW, InputFrame.DeltaTime);
+			ResimContext->Step(InputFrame.DeltaTime);
+			NumFrames++;
+
+			if (bSaveSnapshots)
+			{
+				if (FVehicleNWSnapshot* NextSnapshot = SnapshotRing.Write(Frame + NumFrames))
+				{
+					CaptureSnapshot_AssumesLocked(PVehicleDriveNW, *NextSnapshot);
+				}
+			}
+		}
+	});
+#endif // WITH_PHYSX_VEHICLES
+
+	return NumFrames;
+}
+
+void UVehicleMovementComponentNW::StartInputRecording()
+{
+	WakeVehicle();
+
+	FVehicleNWSnapshot InitialState = {};
+	InitialState.Frame = INDEX_NONE;
+	if (!CaptureSnapshot(InitialState))
+	{
+		UE_LOG(LogVehicleNW, Warning, TEXT("%s: cannot record inputs without a PhysX vehicle"), *GetPathName());
+		return;
+	}
+
+	if (!InputRecording.IsValid())
+	{
+		InputRecording = MakeUnique<FVehicleNWInputRecording>();
+	}
+	InputRecording->Reset(InitialState);
+}
+
+TUniquePtr<FVehicleNWInputRecording> UVehicleMovementComponentNW::StopInputRecording()
+{
+	return MoveTemp(InputRecording);
+}
+
+bool UVehicleMovementComponentNW::StartInputReplay(TSharedRef<const FVehicleNWInputRecording> Recording)
+{
+#if WITH_PHYSX_VEHICLES
+	const FVehicleNWSnapshot& InitialState = Recording->GetInitialState();
+	if (PVehicleDrive == nullptr || InitialState.NumWheels != WheelSetups.Num())
+	{
+		return false;
+	}
+
+	FPhysicsCommand::ExecuteWrite(UpdatedPrimitive->GetBodyInstance()->ActorHandle, [&](const FPhysicsActorHandle&)
+	{
+		RestoreSnapshot_AssumesLocked(*(PxVehicleDriveNW*)PVehicleDrive, InitialState);
+	});
+
+	InputReplay = Recording;
+	InputReplayOffset = 0;
+	FMemory::Memzero(InputReplayFrame);
+	InputReplayFrameIndex = 0;
+	InputReplayDivergentFrame = INDEX_NONE;
+	return true;
+#else
+	return false;
+#endif // WITH_PHYSX_VEHICLES
+}
+
+bool UVehicleMovementComponentNW::PeekInputReplayDeltaTime(float& OutDeltaTime) const
+{
+	if (!InputReplay.IsValid())
+	{
+		return false;
+	}
+
+	// Frames are delta coded, read the next one on top of a copy of the current one.
+	int32 Offset = InputReplayOffset;
+	FVehicleNWInputFrame NextFrame = InputReplayFrame;
+	uint32 StateHash = 0;
+	if (!InputReplay->ReadFrame(Offset, NextFrame, StateHash))
+	{
+		return false;
+	}
+
+	OutDeltaTime = NextFrame.DeltaTime;
+	return true;
+}
+
+void UVehicleMovementComponentNW::UpdateInputRecording(float DeltaTime)
+{
+	if (!InputRecording.IsValid() && !InputReplay.IsValid())
+	{
+		return;
+	}
+
+	FVehicleNWSnapshot State = {};
+	if (!CaptureSnapshot(State))
+	{
+		return;
+	}
+	const uint32 StateHash = State.HashSimulationState();
+
+	if (InputReplay.IsValid())
+	{
+		uint32 RecordedHash = 0;
+		if (InputReplay->ReadFrame(InputReplayOffset, InputReplayFrame, RecordedHash))
+		{
+			UE_LOG(LogVehicleNW, VeryVerbose, TEXT("%s: replay frame %d state %08x"), *GetPathName(), InputReplayFrameIndex, StateHash);
+			if (StateHash != RecordedHash && InputReplayDivergentFrame == INDEX_NONE)
+			{
+				InputReplayDivergentFrame = InputReplayFrameIndex;
+				UE_LOG(LogVehicleNW, Warning, TEXT("%s: replay diverged at frame %d (state %08x, recorded %08x)"), *GetPathName(), InputReplayFrameIndex, StateHash, RecordedHash);
+			}
+
+			// The replay drives the world at the recorded steps, anything else (physics substepping, a hitch clamped
+			// by MaxPhysicsDeltaTime) makes the rest of the replay meaningless.
+			if (!FMath::IsNearlyEqual(DeltaTime, InputReplayFrame.DeltaTime, 1e-5f) && InputReplayDivergentFrame == INDEX_NONE)
+			{
+				InputReplayDivergentFrame = InputReplayFrameIndex;
+				UE_LOG(LogVehicleNW, Warning, TEXT("%s: replay frame %d stepped %.5fs, recorded %.5fs"), *GetPathName(), InputReplayFrameIndex, DeltaTime, InputReplayFrame.DeltaTime);
+			}
+
+			SetInputFrame(InputReplayFrame);
+			InputReplayFrameIndex++;
+		}
+		else
+		{
+			InputReplay.Reset();
+		}
+	}
+
+	if (InputRecording.IsValid())
+	{
+		InputRecording->AddFrame(GetInputFrame(DeltaTime), StateHash);
+	}
+}
+
+#if WITH_PHYSX_VEHICLES
+void UVehicleMovementComponentNW::CaptureSnapshot_AssumesLocked(const PxVehicleDriveNW& PVehicleDriveNW, FVehicleNWSnapshot& OutSnapshot) const
+{
+	const PxRigidDynamic* PRigidDynamic = PVehicleDriveNW.getRigidDynamicActor();
+	const PxTransform PPose = PRigidDynamic->getGlobalPose();
+	const PxVec3 PLinearVelocity = PRigidDynamic->getLinearVelocity();
+	const PxVec3 PAngularVelocity = PRigidDynamic->getAngularVelocity();
+
+	OutSnapshot.BodyPose[0] = PPose.p.x;
+	OutSnapshot.BodyPose[1] = PPose.p.y;
+	OutSnapshot.BodyPose[2] = PPose.p.z;
+	OutSnapshot.BodyPose[3] = PPose.q.x;
+	OutSnapshot.BodyPose[4] = PPose.q.y;
+	OutSnapshot.BodyPose[5] = PPose.q.z;
+	OutSnapshot.BodyPose[6] = PPose.q.w;
+	FMemory::Memcpy(OutSnapshot.LinearVelocity, &PLinearVelocity, sizeof(OutSnapshot.LinearVelocity));
+	FMemory::Memcpy(OutSnapshot.AngularVelocity, &PAngularVelocity, sizeof(OutSnapshot.AngularVelocity));
+
+	FMemory::Memcpy(OutSnapshot.DriveDynData, &PVehicleDriveNW.mDriveDynData, sizeof(PxVehicleDriveDynData));
+
+	const PxVehicleWheelsDynData& WheelsDynData = PVehicleDriveNW.mWheelsDynData;
+	OutSnapshot.NumWheels = PVehicleDriveNW.mWheelsSimData.getNbWheels();
+	for (int32 WheelIdx = 0; WheelIdx < OutSnapshot.NumWheels; WheelIdx++)
+	{
+		OutSnapshot.WheelRotationSpeeds[WheelIdx] = WheelsDynData.getWheelRotationSpeed(WheelIdx);
+		OutSnapshot.WheelRotationAngles[WheelIdx] = WheelsDynData.getWheelRotationAngle(WheelIdx);
+	}
+
+	OutSnapshot.Inputs = GetInputFrame(0.f);
+	OutSnapshot.ReducedLODStepCounter = ReducedLODStepCounter;
+	OutSnapshot.ReducedLODAccumulatedTime = ReducedLODAccumulatedTime;
+}
+
+void UVehicleMovementComponentNW::RestoreSnapshot_AssumesLocked(PxVehicleDriveNW& PVehicleDriveNW, const FVehicleNWSnapshot& Snapshot)
+{
+	// The scene writes the pose back to the component on the next sync.
+	PxRigidDynamic* PRigidDynamic = PVehicleDriveNW.getRigidDynamicActor();
+	const PxTransform PPose(
+		PxVec3(Snapshot.BodyPose[0], Snapshot.BodyPose[1], Snapshot.BodyPose[2]),
+		PxQuat(Snapshot.BodyPose[3], Snapshot.BodyPose[4], Snapshot.BodyPose[5], Snapshot.BodyPose[6]));
+	PRigidDynamic->setGlobalPose(PPose);
+	PRigidDynamic->setLinearVelocity(PxVec3(Snapshot.LinearVelocity[0], Snapshot.LinearVelocity[1], Snapshot.LinearVelocity[2]));
+	PRigidDynamic->setAngularVelocity(PxVec3(Snapshot.AngularVelocity[0], Snapshot.AngularVelocity[1], Snapshot.AngularVelocity[2]));
+
+	FMemory::Memcpy(&PVehicleDriveNW.mDriveDynData, Snapshot.DriveDynData, sizeof(PxVehicleDriveDynData));
+
+	PxVehicleWheelsDynData& WheelsDynData = PVehicleDriveNW.mWheelsDynData;
+	const int32 NumWheels = FMath::Min<int32>(Snapshot.NumWheels, PVehicleDriveNW.mWheelsSimData.getNbWheels());
+	for (int32 WheelIdx = 0; WheelIdx < NumWheels; WheelIdx++)
+	{
+		WheelsDynData.setWheelRotationSpeed(WheelIdx, Snapshot.WheelRotationSpeeds[WheelIdx]);
+		WheelsDynData.setWheelRotationAngle(WheelIdx, Snapshot.WheelRotationAngles[WheelIdx]);
+	}
+
+	SetInputFrame(Snapshot.Inputs);
+	RestInputs = Snapshot.Inputs;
+	bAsleep = false;
+	bPendingSleep = false;
+	RestTime = 0.f;
+	ReducedLODStepCounter = Snapshot.ReducedLODStepCounter;
+	ReducedLODAccumulatedTime = Snapshot.ReducedLODAccumulatedTime;
+}
+#endif // WITH_PHYSX_VEHICLES
+
+void UVehicleMovementComponentNW::OnDestroyPhysicsState()
+{
+	// Leave the fleet before the PhysX drive is released.
+	if (Fleet)
+	{
+		Fleet->UnregisterVehicle(this);
+	}
+
+#if WITH_PHYSX_VEHICLES
+	ResimContext.Reset();
+
+	// Keep the result of a build still pending for the next spawn.
+	if (PendingSetup.IsValid())
+	{
+		FVehicleNWPrototypeCache::Get().Resolve(*PendingSetup);
+		PendingSetup.Reset();
+	}
+
+	// Freed by the vehicle manager when the base class removes the vehicle.
+	WheelsStates = nullptr;
+	ActiveTireModel = nullptr;
+#endif // WITH_PHYSX_VEHICLES
+
+	Super::OnDestroyPhysicsState();
 }
 
 void UVehicleMovementComponentNW::ComputeConstants()
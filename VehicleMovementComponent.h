@@ -5,125 +5,212 @@
 #include "CoreMinimal.h"
 #include "WheeledVehicleMovementComponent.h"
 #include "Curves/CurveFloat.h"
+#include "VehicleNWDrivetrain.h"
+#include "VehicleNWReplication.h"
+#include "VehicleNWSnapshot.h"
+#include "VehicleNWInputRecording.h"
+#include "VehicleNWInputChannel.h"
+#include "VehicleNWTireModel.h"
+#include "VehicleNWTelemetryRecorder.h"
 #include "VehicleMovementComponentNW.generated.h"
 
+class UVehicleNWFleetSubsystem;
+class UPhysicalMaterial;
+struct FVehicleNWPendingPrototype;
+struct FVehicleNWPrototype;
+struct FVehicleNWWheelsBlob;
+
 #if WITH_PHYSX_VEHICLES
 namespace physx
 {
 	class PxVehicleDriveNW;
+	class PxVehicleDriveSimDataNW;
+	class PxVehicleWheelsSimData;
+	class PxWheelQueryResult;
 }
 #endif // WITH_PHYSX_VEHICLES
 
-USTRUCT()
+// Surface is null while the wheel is in the air.
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_ThreeParams(FVehicleNWWheelSurfaceChanged, int32, WheelIndex, UPhysicalMaterial*, Surface, float, Friction);
+
+// Gear is -1 in reverse, 0 in neutral. Speed is the absolute forward speed in km/h.
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FVehicleNWGearChanged, int32, Gear);
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FVehicleNWSpeedChanged, int32, Speed);
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FVehicleNWEngineRPMChanged, float, EngineRPM);
+
+USTRUCT(BlueprintType)
 struct FDrivenWheelData
 {
 	GENERATED_USTRUCT_BODY()
 
-	UPROPERTY(EditAnywhere, Category = Setup)
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Setup)
 	int32 DrivenWheelIndex;
 
-	UPROPERTY(EditAnywhere, Category = Setup)
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Setup)
 		bool IsDrivenWheel;
 };
 
-USTRUCT()
+USTRUCT(BlueprintType)
 struct FVehicleDifferentialNWData
 {
 	GENERATED_USTRUCT_BODY()
 
-	UPROPERTY(EditAnywhere, Category = Setup, AdvancedDisplay)
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Setup, AdvancedDisplay)
 	TArray<FDrivenWheelData> DWheelData;
 };
 
-USTRUCT()
+USTRUCT(BlueprintType)
 struct FVehicleEngineNWData
 {
 	GENERATED_USTRUCT_BODY()
 
 	// Torque (Nm) at a given RPM.
-	UPROPERTY(EditAnywhere, Category = Setup)
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Setup)
 	FRuntimeFloatCurve TorqueCurve;
 
 	// Maximum revolutions per minute of the engine.
-	UPROPERTY(EditAnywhere, Category = Setup, meta = (ClampMin = "0.01", UIMin = "0.01"))
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Setup, meta = (ClampMin = "0.01", UIMin = "0.01"))
 		float MaxRPM;
 
 	// Moment of inertia of the engine around the axis of rotation (Kgm^2). 
-	UPROPERTY(EditAnywhere, Category = Setup, meta = (ClampMin = "0.01", UIMin = "0.01"))
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Setup, meta = (ClampMin = "0.01", UIMin = "0.01"))
 		float MOI;
 
 	// Damping rate of engine when full throttle is applied (Kgm^2/s).
-	UPROPERTY(EditAnywhere, Category = Setup, AdvancedDisplay, meta = (ClampMin = "0.0", UIMin = "0.0"))
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Setup, AdvancedDisplay, meta = (ClampMin = "0.0", UIMin = "0.0"))
 		float DampingRateFullThrottle;
 
 	// Damping rate of engine in at zero throttle when the clutch is engaged (Kgm^2/s).
-	UPROPERTY(EditAnywhere, Category = Setup, AdvancedDisplay, meta = (ClampMin = "0.0", UIMin = "0.0"))
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Setup, AdvancedDisplay, meta = (ClampMin = "0.0", UIMin = "0.0"))
 		float DampingRateZeroThrottleClutchEngaged;
 
 	// Damping rate of engine in at zero throttle when the clutch is disengaged (in neutral gear) (Kgm^2/s).
-	UPROPERTY(EditAnywhere, Category = Setup, AdvancedDisplay, meta = (ClampMin = "0.0", UIMin = "0.0"))
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Setup, AdvancedDisplay, meta = (ClampMin = "0.0", UIMin = "0.0"))
 		float DampingRateZeroThrottleClutchDisengaged;
 
 	// Find the peak torque produced by the TorqueCurve.
 	float FindPeakTorque() const;
 };
 
-USTRUCT()
+USTRUCT(BlueprintType)
 struct FVehicleGearNWData
 {
 	GENERATED_USTRUCT_BODY()
 
 		// Determines the amount of torque multiplication.
-	UPROPERTY(EditAnywhere, Category = Setup)
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Setup)
     	float Ratio;
 
 	// Value of engineRevs/maxEngineRevs that is low enough to gear down.
-	UPROPERTY(EditAnywhere, meta = (ClampMin = "0.0", UIMin = "0.0", ClampMax = "1.0", UIMax = "1.0"), Category = Setup)
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, meta = (ClampMin = "0.0", UIMin = "0.0", ClampMax = "1.0", UIMax = "1.0"), Category = Setup)
 		float DownRatio;
 
 	// Value of engineRevs/maxEngineRevs that is high enough to gear up.
-	UPROPERTY(EditAnywhere, meta = (ClampMin = "0.0", UIMin = "0.0", ClampMax = "1.0", UIMax = "1.0"), Category = Setup)
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, meta = (ClampMin = "0.0", UIMin = "0.0", ClampMax = "1.0", UIMax = "1.0"), Category = Setup)
 		float UpRatio;
 };
 
-USTRUCT()
+USTRUCT(BlueprintType)
 struct FVehicleTransmissionNWData
 {
 	GENERATED_USTRUCT_BODY()
 
 	// Whether to use automatic transmission.
-	UPROPERTY(EditAnywhere, Category = VehicleSetup, meta = (DisplayName = "Automatic Transmission"))
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = VehicleSetup, meta = (DisplayName = "Automatic Transmission"))
 		bool bUseGearAutoBox;
 
 	// Time it takes to switch gears (seconds).
-	UPROPERTY(EditAnywhere, Category = Setup, meta = (ClampMin = "0.0", UIMin = "0.0"))
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Setup, meta = (ClampMin = "0.0", UIMin = "0.0"))
 		float GearSwitchTime;
 
 	// Minimum time it takes the automatic transmission to initiate a gear change (seconds).
-	UPROPERTY(EditAnywhere, Category = Setup, meta = (editcondition = "bUseGearAutoBox", ClampMin = "0.0", UIMin = "0.0"))
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Setup, meta = (editcondition = "bUseGearAutoBox", ClampMin = "0.0", UIMin = "0.0"))
 		float GearAutoBoxLatency;
 
 	// The final gear ratio multiplies the transmission gear ratios.
-	UPROPERTY(EditAnywhere, AdvancedDisplay, Category = Setup)
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, AdvancedDisplay, Category = Setup)
 		float FinalRatio;
 
 	// Forward gear ratios (up to 30).
-	UPROPERTY(EditAnywhere, Category = Setup, AdvancedDisplay)
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Setup, AdvancedDisplay)
 		TArray<FVehicleGearNWData> ForwardGears;
 
 	// Reverse gear ratio.
-	UPROPERTY(EditAnywhere, AdvancedDisplay, Category = Setup)
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, AdvancedDisplay, Category = Setup)
 		float ReverseGearRatio;
 
 	// Value of engineRevs/maxEngineRevs that is high enough to increment gear.
-	UPROPERTY(EditAnywhere, AdvancedDisplay, Category = Setup, meta = (ClampMin = "0.0", UIMin = "0.0", ClampMax = "1.0", UIMax = "1.0"))
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, AdvancedDisplay, Category = Setup, meta = (ClampMin = "0.0", UIMin = "0.0", ClampMax = "1.0", UIMax = "1.0"))
 		float NeutralGearUpRatio;
 
 	// Strength of clutch (Kgm^2/s).
-	UPROPERTY(EditAnywhere, Category = Setup, AdvancedDisplay, meta = (ClampMin = "0.0", UIMin = "0.0"))
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Setup, AdvancedDisplay, meta = (ClampMin = "0.0", UIMin = "0.0"))
 		float ClutchStrength;
 };
 
+// Steering table and pad smoothing data compiled from SteeringCurve and the input rates.
+struct FVehicleNWInputSmoothingCache
+{
+	// Max number of (speed, steer) pairs PhysX accepts in the steering lookup table.
+	static const int32 MaxSteeringSamples = 8;
+
+	// Number of analog inputs used by PxVehicleDriveNW (accel, brake, handbrake, steer left, steer right).
+	static const int32 NumAnalogInputs = 5;
+
+	// Forward speed (cm/s) of each steering sample.
+	float SteerSpeeds[MaxSteeringSamples];
+
+	// Max steering scale (0-1) of each steering sample.
+	float SteerValues[MaxSteeringSamples];
+
+	int32 NumSteerSamples;
+
+	float RiseRates[NumAnalogInputs];
+	float FallRates[NumAnalogInputs];
+
+	// Source version this cache was compiled from.
+	uint32 Version;
+
+	FVehicleNWInputSmoothingCache()
+		: NumSteerSamples(0)
+		, Version(0)
+	{
+		FMemory::Memzero(SteerSpeeds);
+		FMemory::Memzero(SteerValues);
+		FMemory::Memzero(RiseRates);
+		FMemory::Memzero(FallRates);
+	}
+};
+
+UENUM(BlueprintType)
+enum class EVehicleNWSimulationLOD : uint8
+{
+	// Full drivetrain and suspension simulation.
+	Full,
+
+	// Fewer wheel substeps, inputs pushed to PhysX every ReducedLODUpdateInterval physics steps.
+	Reduced,
+
+	// Kinematic, follows the last velocity along the road surface. Gear and engine speed are frozen.
+	Rail,
+};
+
+// Parts of the setup pushed to PhysX separately by UVehicleMovementComponentNW::CommitTuning.
+enum class EVehicleNWTuningSection : uint8
+{
+	None = 0,
+	Engine = 1 << 0,
+	Clutch = 1 << 1,
+	Gears = 1 << 2,
+	AutoBox = 1 << 3,
+	Differential = 1 << 4,
+	Steering = 1 << 5,
+
+	Drivetrain = Engine | Clutch | Gears | AutoBox | Differential,
+	Transmission = Clutch | Gears | AutoBox,
+};
+ENUM_CLASS_FLAGS(EVehicleNWTuningSection)
+
 UCLASS(ClassGroup = (Physics), meta = (BlueprintSpawnableComponent), hidecategories = (PlanarMovement, "Components|Movement|Planar", Activation, "Components|Activation"))
 class MYVEHICLEPROJECT_API UVehicleMovementComponentNW : public UWheeledVehicleMovementComponent
 {
@@ -147,25 +234,500 @@ class MYVEHICLEPROJECT_API UVehicleMovementComponentNW : public UWheeledVehicleM
 	UPROPERTY(EditAnywhere, Category = MechanicalSetup)
 		FVehicleTransmissionNWData TransmissionSetup;
 
+	// Tire model registered with FVehicleNWTireModels. None keeps the PhysX built-in model.
+	UPROPERTY(EditAnywhere, Category = WheelSetup)
+		FName TireModel;
+
 	// Maximum steering versus forward speed (Km/h).
 	UPROPERTY(EditAnywhere, Category = SteeringSetup)
 		FRuntimeFloatCurve SteeringCurve;
 
+	// Forward speed (Km/h) below which wheels use LowSpeedSubstepCount substeps, HighSpeedSubstepCount above.
+	UPROPERTY(EditAnywhere, Category = Substepping, meta = (ClampMin = "0.0", UIMin = "0.0"))
+		float SubstepThresholdSpeed;
+
+	// Wheel substeps per update below SubstepThresholdSpeed.
+	UPROPERTY(EditAnywhere, Category = Substepping, meta = (ClampMin = "1", UIMin = "1", UIMax = "32"))
+		int32 LowSpeedSubstepCount;
+
+	// Wheel substeps per update above SubstepThresholdSpeed.
+	UPROPERTY(EditAnywhere, Category = Substepping, meta = (ClampMin = "1", UIMin = "1", UIMax = "32"))
+		int32 HighSpeedSubstepCount;
+
+	// Ignore the speed threshold and use the fewest substeps that keep the wheel slip error under AutoSubstepSlipTolerance.
+	UPROPERTY(EditAnywhere, Category = Substepping)
+		bool bAutoSubstep;
+
+	// Largest change of wheel slip between two updates that is not considered integration error.
+	UPROPERTY(EditAnywhere, Category = Substepping, meta = (editcondition = "bAutoSubstep", ClampMin = "0.0", UIMin = "0.0"))
+		float AutoSubstepSlipTolerance;
+
+	UPROPERTY(EditAnywhere, Category = Substepping, meta = (editcondition = "bAutoSubstep", ClampMin = "1", UIMin = "1", UIMax = "32"))
+		int32 AutoSubstepMinCount;
+
+	UPROPERTY(EditAnywhere, Category = Substepping, meta = (editcondition = "bAutoSubstep", ClampMin = "1", UIMin = "1", UIMax = "32"))
+		int32 AutoSubstepMaxCount;
+
+	// Change the substep configuration of the running vehicle.
+	UFUNCTION(BlueprintCallable, Category = "Game|Components|WheeledVehicleMovement")
+	void SetWheelSubsteps(float NewThresholdSpeed, int32 NewLowSpeedSubstepCount, int32 NewHighSpeedSubstepCount);
+
+	UFUNCTION(BlueprintCallable, Category = "Game|Components|WheeledVehicleMovement")
+	void SetAutoSubstep(bool bNewAutoSubstep);
+
+	// Replicate the quantized FVehicleNWReplicatedState instead of the actor's generic movement. Simulated proxies take
+	// it as is, the owning client is corrected towards it like generic physics movement would.
+	UPROPERTY(EditAnywhere, Category = Replication)
+		bool bReplicateQuantizedState;
+
+	// Net update frequency of a parked vehicle without input.
+	UPROPERTY(EditAnywhere, Category = Replication, meta = (ClampMin = "0.1", UIMin = "0.1"))
+		float IdleNetUpdateFrequency;
+
+	// Net update frequency of a vehicle driven or moving at ActiveNetSpeed or faster.
+	UPROPERTY(EditAnywhere, Category = Replication, meta = (ClampMin = "0.1", UIMin = "0.1"))
+		float ActiveNetUpdateFrequency;
+
+	// Forward speed (Km/h) at which ActiveNetUpdateFrequency is reached.
+	UPROPERTY(EditAnywhere, Category = Replication, meta = (ClampMin = "0.0", UIMin = "0.0"))
+		float ActiveNetSpeed;
+
+	// Fill a replicated state from the current simulation.
+	void CaptureReplicatedState(FVehicleNWReplicatedState& OutState) const;
+
+	// False while the PhysX vehicle is being set up in the background. Inputs given until then are dropped.
+	UFUNCTION(BlueprintCallable, Category = "Game|Components|WheeledVehicleMovement")
+	bool IsVehicleReady() const;
+
+	// Pick the simulation LOD from the distance to the closest player view.
+	UPROPERTY(EditAnywhere, Category = SimulationLOD)
+		bool bEnableSimulationLOD;
+
+	// Distance (cm) from the closest player view beyond which the vehicle uses the Reduced LOD.
+	UPROPERTY(EditAnywhere, Category = SimulationLOD, meta = (editcondition = "bEnableSimulationLOD", ClampMin = "0.0", UIMin = "0.0"))
+		float ReducedLODDistance;
+
+	// Distance (cm) from the closest player view beyond which the vehicle uses the Rail LOD.
+	UPROPERTY(EditAnywhere, Category = SimulationLOD, meta = (editcondition = "bEnableSimulationLOD", ClampMin = "0.0", UIMin = "0.0"))
+		float RailLODDistance;
+
+	// Distance (cm) a vehicle has to move past a threshold before switching back, avoids flickering between LODs.
+	UPROPERTY(EditAnywhere, Category = SimulationLOD, AdvancedDisplay, meta = (editcondition = "bEnableSimulationLOD", ClampMin = "0.0", UIMin = "0.0"))
+		float LODDistanceHysteresis;
+
+	// Time between two LOD evaluations (seconds).
+	UPROPERTY(EditAnywhere, Category = SimulationLOD, AdvancedDisplay, meta = (editcondition = "bEnableSimulationLOD", ClampMin = "0.0", UIMin = "0.0"))
+		float LODEvaluationInterval;
+
+	// Use the Reduced LOD for full LOD vehicles that were not rendered recently.
+	UPROPERTY(EditAnywhere, Category = SimulationLOD, meta = (editcondition = "bEnableSimulationLOD"))
+		bool bReduceLODWhenNotRendered;
+
+	// Wheel substep count used at the Reduced LOD, whatever the speed.
+	UPROPERTY(EditAnywhere, Category = SimulationLOD, meta = (ClampMin = "1", UIMin = "1"))
+		int32 ReducedLODSubstepCount;
+
+	// Number of physics steps between two input updates at the Reduced LOD.
+	UPROPERTY(EditAnywhere, Category = SimulationLOD, meta = (ClampMin = "1", UIMin = "1"))
+		int32 ReducedLODUpdateInterval;
+
+	// Number of frames between two ground traces at the Rail LOD.
+	UPROPERTY(EditAnywhere, Category = SimulationLOD, meta = (ClampMin = "1", UIMin = "1"))
+		int32 RailGroundTraceInterval;
+
+	UFUNCTION(BlueprintCallable, Category = "Game|Components|WheeledVehicleMovement")
+	EVehicleNWSimulationLOD GetSimulationLOD() const { return SimulationLOD; }
+
+	// Switch LOD now. Overridden on the next evaluation when bEnableSimulationLOD is set.
+	UFUNCTION(BlueprintCallable, Category = "Game|Components|WheeledVehicleMovement")
+	void SetSimulationLOD(EVehicleNWSimulationLOD NewLOD);
+
+	// Put the vehicle to sleep when it stays at rest, without throttle or input change, for SleepDelay. Off by default,
+	// it turns on sleep notifies for the body and puts the drive to its rest state.
+	UPROPERTY(EditAnywhere, Category = Sleep)
+		bool bEnableSleep;
+
+	// Speed (cm/s) under which the chassis is considered at rest.
+	UPROPERTY(EditAnywhere, Category = Sleep, meta = (editcondition = "bEnableSleep", ClampMin = "0.0", UIMin = "0.0"))
+		float SleepLinearSpeed;
+
+	// Angular speed (degrees/s) under which the chassis is considered at rest.
+	UPROPERTY(EditAnywhere, Category = Sleep, meta = (editcondition = "bEnableSleep", ClampMin = "0.0", UIMin = "0.0"))
+		float SleepAngularSpeed;
+
+	// Time at rest (seconds) before going to sleep.
+	UPROPERTY(EditAnywhere, Category = Sleep, meta = (editcondition = "bEnableSleep", ClampMin = "0.0", UIMin = "0.0"))
+		float SleepDelay;
+
+	// True while no input smoothing or PhysX vehicle update runs. Input changes, contacts and impulses wake the vehicle.
+	UFUNCTION(BlueprintCallable, Category = "Game|Components|WheeledVehicleMovement")
+	bool IsVehicleAsleep() const { return bAsleep; }
+
+	UFUNCTION(BlueprintCallable, Category = "Game|Components|WheeledVehicleMovement")
+	void WakeVehicle();
+
+	// A wheel touched down, left the ground or rolled onto another surface. Raised on the game thread from the
+	// component tick following the step that noticed it. Friction is the tire friction of the surface from the scene friction table.
+	UPROPERTY(BlueprintAssignable, Category = "Game|Components|WheeledVehicleMovement")
+		FVehicleNWWheelSurfaceChanged OnWheelSurfaceChanged;
+
+	// Smallest speed change (km/h) published through OnSpeedChanged.
+	UPROPERTY(EditAnywhere, Category = Display, meta = (ClampMin = "1", UIMin = "1"))
+		int32 SpeedPublishStep;
+
+	// Smallest engine RPM change published through OnEngineRPMChanged.
+	UPROPERTY(EditAnywhere, Category = Display, meta = (ClampMin = "0.0", UIMin = "0.0"))
+		float EngineRPMPublishStep;
+
+	// Display values, raised from the component tick following the step that moved them past their publish step.
+	UPROPERTY(BlueprintAssignable, Category = "Game|Components|WheeledVehicleMovement")
+		FVehicleNWGearChanged OnGearChanged;
+
+	UPROPERTY(BlueprintAssignable, Category = "Game|Components|WheeledVehicleMovement")
+		FVehicleNWSpeedChanged OnSpeedChanged;
+
+	UPROPERTY(BlueprintAssignable, Category = "Game|Components|WheeledVehicleMovement")
+		FVehicleNWEngineRPMChanged OnEngineRPMChanged;
+
+	// Last published display values, read without taking the physics lock.
+	int32 GetPublishedGear() const { return PublishedGear; }
+	int32 GetPublishedSpeed() const { return PublishedSpeed; }
+	float GetPublishedEngineRPM() const { return PublishedEngineRPM; }
+
+	// Number of snapshots kept for rollback, allocated when the vehicle is set up. 0 disables snapshots.
+	UPROPERTY(EditAnywhere, Category = Prediction, meta = (ClampMin = "0", UIMin = "0"))
+		int32 SnapshotRingSize;
+
+	// Resimulated steps answer suspension rays by sampling the landscape heightfield when it is the only thing under the wheels.
+	UPROPERTY(EditAnywhere, Category = Prediction)
+		bool bHeightfieldSuspension;
+
+	// Save the simulation state as Frame, overwriting the oldest snapshot. False if there is no vehicle or no ring.
+	bool SaveSnapshot(int32 Frame);
+
+	// Put the vehicle back in the state saved as Frame. False if that snapshot was overwritten.
+	bool RestoreSnapshot(int32 Frame);
+
+	const FVehicleNWSnapshot* FindSnapshot(int32 Frame) const { return SnapshotRing.Find(Frame); }
+
+	// Restore Frame, then step the vehicle once per input frame under a single physics lock. Snapshots Frame + 1 and up
+	// are rewritten with the corrected states if bSaveSnapshots is set. Returns the number of frames simulated.
+	int32 ResimulateFromSnapshot(int32 Frame, TArrayView<const FVehicleNWInputFrame> InputFrames, bool bSaveSnapshots = true);
+
+	// Inputs the physics step uses, as taken from the input channel or set by SetInputFrame. Physics side.
+	FVehicleNWInputFrame GetInputFrame(float DeltaTime) const;
+	void SetInputFrame(const FVehicleNWInputFrame& InputFrame);
+
+	// Start recording the inputs of every physics step, from the current state.
+	void StartInputRecording();
+
+	// Stop recording and hand the recording over, null if none was running.
+	TUniquePtr<FVehicleNWInputRecording> StopInputRecording();
+
+	// Restore the initial state of Recording and feed its inputs to the following physics steps.
+	bool StartInputReplay(TSharedRef<const FVehicleNWInputRecording> Recording);
+
+	bool IsReplayingInputs() const { return InputReplay.IsValid(); }
+
+	// Step length recorded for the next replayed frame. False once the replay is over.
+	bool PeekInputReplayDeltaTime(float& OutDeltaTime) const;
+
+	// First replayed frame that did not start from the recorded state, INDEX_NONE if none so far.
+	int32 GetInputReplayDivergentFrame() const { return InputReplayDivergentFrame; }
+
+#if WITH_PHYSX_VEHICLES
+	// Snapshot copies without locking, to roll back many vehicles under one lock. Scene lock must be held.
+	void CaptureSnapshot_AssumesLocked(const physx::PxVehicleDriveNW& PVehicleDriveNW, FVehicleNWSnapshot& OutSnapshot) const;
+	void RestoreSnapshot_AssumesLocked(physx::PxVehicleDriveNW& PVehicleDriveNW, const FVehicleNWSnapshot& Snapshot);
+#endif // WITH_PHYSX_VEHICLES
+
 	virtual void Serialize(FArchive & Ar) override;
 	virtual void ComputeConstants() override;
+	virtual void OnDestroyPhysicsState() override;
+	virtual void TickComponent(float DeltaTime, enum ELevelTick TickType, FActorComponentTickFunction *ThisTickFunction) override;
+	virtual void PreTick(float DeltaTime) override;
+	virtual void BeginPlay() override;
+	virtual void PreReplication(IRepChangedPropertyTracker& ChangedPropertyTracker) override;
+	virtual void GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const override;
 
 #if WITH_EDITOR
 	virtual void PostEditChangeProperty(struct FPropertyChangedEvent& PropertyChangedEvent) override;
 #endif
 
+	// Replace the steering curve at runtime. The steering table is recompiled on the next simulation update.
+	UFUNCTION(BlueprintCallable, Category = "Game|Components|WheeledVehicleMovement")
+	void SetSteeringCurve(const FRuntimeFloatCurve& NewSteeringCurve);
+
+	// Hold the following Tune* calls until the matching CommitTuning. Pairs can be nested.
+	UFUNCTION(BlueprintCallable, Category = "Game|Components|WheeledVehicleMovement|Tuning")
+	void BeginTuning();
+
+	// Convert the sections changed since the outermost BeginTuning and push them to PhysX under one lock.
+	UFUNCTION(BlueprintCallable, Category = "Game|Components|WheeledVehicleMovement|Tuning")
+	void CommitTuning();
+
+	UFUNCTION(BlueprintCallable, Category = "Game|Components|WheeledVehicleMovement|Tuning")
+	void TuneEngine(const FVehicleEngineNWData& NewEngineSetup);
+
+	UFUNCTION(BlueprintCallable, Category = "Game|Components|WheeledVehicleMovement|Tuning")
+	void TuneClutch(float NewClutchStrength);
+
+	// Gear ratios, and the automatic gearbox thresholds that come with each forward gear.
+	UFUNCTION(BlueprintCallable, Category = "Game|Components|WheeledVehicleMovement|Tuning")
+	void TuneGears(const TArray<FVehicleGearNWData>& NewForwardGears, float NewReverseGearRatio, float NewFinalRatio, float NewGearSwitchTime);
+
+	UFUNCTION(BlueprintCallable, Category = "Game|Components|WheeledVehicleMovement|Tuning")
+	void TuneAutoBox(bool bNewUseGearAutoBox, float NewGearAutoBoxLatency);
+
+	UFUNCTION(BlueprintCallable, Category = "Game|Components|WheeledVehicleMovement|Tuning")
+	void TuneTransmission(const FVehicleTransmissionNWData& NewTransmissionSetup);
+
+	UFUNCTION(BlueprintCallable, Category = "Game|Components|WheeledVehicleMovement|Tuning")
+	void TuneDifferential(const FVehicleDifferentialNWData& NewDifferentialSetup);
+
+	// Call after changing the setup properties directly. Committed right away outside of BeginTuning/CommitTuning.
+	void MarkTuningDirty(EVehicleNWTuningSection Sections);
+
+	// Replace the input rise/fall rates at runtime. The smoothing data is recompiled on the next simulation update.
+	void SetInputRates(const FVehicleInputRate& NewThrottleRate, const FVehicleInputRate& NewBrakeRate, const FVehicleInputRate& NewHandbrakeRate, const FVehicleInputRate& NewSteeringRate);
+
+	// Raw throttle, steering and brake from a batched driver such as UVehicleNWTrafficSubsystem. Only writes the raw
+	// inputs, so workers can set those of different vehicles at once. Brake is in [0, 1].
+	void SetDriverInputs(float Throttle, float Steering, float Brake);
+
+	// Invalidate the compiled steering table and smoothing data after SteeringCurve or the input rates were modified directly.
+	void MarkInputSmoothingDirty() { ++InputSmoothingVersion; }
+
+	// Call after changing EngineSetup, TransmissionSetup or DifferentialSetup from code.
+	void MarkDrivetrainDirty() { ++DrivetrainVersion; }
+
+	// Drivetrain setup converted for PhysX, recompiled only when marked dirty.
+	const FVehicleNWDrivetrainBlob& GetDrivetrainBlob() const;
+
 protected:
 
+	friend class UVehicleNWFleetSubsystem;
+	friend class UVehicleNWTrafficSubsystem;
+	friend class FVehicleNWHeightfieldQuery;
+
+	// Fleet this vehicle is registered with, null when inputs are applied per vehicle.
+	UVehicleNWFleetSubsystem* Fleet;
+
+	// Index of this vehicle in the fleet arrays.
+	int32 FleetIndex;
+
+	// Set while UVehicleNWTrafficSubsystem drives this vehicle, PreTick then smooths its raw inputs without a local controller.
+	bool bDrivenByTraffic;
+
+	// Compiled steering table and smoothing data used by UpdateSimulation.
+	FVehicleNWInputSmoothingCache InputSmoothingCache;
+
+	// Inputs published by the game thread every PreTick, taken by the physics step.
+	FVehicleNWInputChannel InputChannel;
+
+	// Inputs of the current physics step. Only touched by the physics side.
+	FVehicleNWInputFrame PhysicsInputs;
+
+	// Take the latest inputs published by the game thread, if any. Physics side.
+	void ConsumeInputs();
+
+	// Bumped every time SteeringCurve or the input rates change.
+	uint32 InputSmoothingVersion;
+
+	// Rebuild InputSmoothingCache from SteeringCurve and the input rates if it is out of date.
+	void CompileInputSmoothingCache();
+
+	UPROPERTY(Transient, ReplicatedUsing = OnRep_NWReplicatedState)
+	FVehicleNWReplicatedState NWReplicatedState;
+
+	UFUNCTION()
+	void OnRep_NWReplicatedState();
+
+	// Adapt the owner's net update frequency to how active the vehicle is.
+	void UpdateNetUpdateFrequency();
+
+	// Gear seen by the last UpdateNetUpdateFrequency, gear changes are sent right away.
+	int32 LastNetGear;
+
+	// Sections changed since the last commit, and BeginTuning nesting depth.
+	EVehicleNWTuningSection PendingTuning;
+	int32 TuningDepth;
+
+	// Compiled lazily from const accessors.
+	mutable FVehicleNWDrivetrainBlob DrivetrainBlob;
+	mutable uint32 CompiledDrivetrainVersion;
+	uint32 DrivetrainVersion;
+
+	EVehicleNWSimulationLOD SimulationLOD;
+
+	// Time left before the next LOD evaluation.
+	float LODEvaluationTimer;
+
+	// Physics steps and time since inputs were last pushed at the Reduced LOD.
+	int32 ReducedLODStepCounter;
+	float ReducedLODAccumulatedTime;
+
+	// Rail LOD state: velocity followed, height above ground, last ground sample.
+	FVector RailVelocity;
+	float RailRideHeight;
+	FVector RailGroundPoint;
+	FVector RailGroundNormal;
+	int32 RailGroundTraceCounter;
+
+	// Substep count picked by bAutoSubstep, and updates spent under half the tolerance.
+	int32 AutoSubstepCount;
+	int32 AutoSubstepCalmUpdates;
+
+	// Wheel slips seen by the previous update, to estimate the slip error.
+	TArray<float, TInlineAllocator<40>> AutoSubstepPrevSlips;
+
+	// AutoSubstepCount changed and is not in the wheels sim data yet.
+	bool bSubstepCountDirty;
+
+	// Sleep state. RestInputs are the inputs of the previous step, any change wakes the vehicle.
+	bool bAsleep;
+	bool bPendingSleep;
+	float RestTime;
+	FVehicleNWInputFrame RestInputs;
+
+	// Drivable surface type under each wheel as of the last step, MAX_uint32 in the air, and the wheels whose surface
+	// changed since the last BroadcastSurfaceChanges.
+	TArray<uint32, TInlineAllocator<20>> WheelSurfaceTypes;
+	TArray<float, TInlineAllocator<20>> WheelSurfaceFrictions;
+	uint32 ChangedSurfaceWheels;
+
+	// Display values as last published, and which of them the last step changed.
+	int32 PublishedGear;
+	int32 PublishedSpeed;
+	float PublishedEngineRPM;
+	bool bGearChanged;
+	bool bSpeedChanged;
+	bool bEngineRPMChanged;
+
+	// Raise the display value delegates for what the last steps changed. From TickComponent, like BroadcastSurfaceChanges.
+	void BroadcastStepChanges();
+
+	// Raise OnWheelSurfaceChanged for the wheels flagged since the last call. From TickComponent, outside of any loop
+	// over vehicles.
+	void BroadcastSurfaceChanges();
+
+	// Wake the vehicle if its inputs changed. False if it stays asleep. Physics side.
+	bool WakeOnInput();
+
+	// Whether the vehicle is asleep and the inputs just consumed differ from those it was put to rest with.
+	bool HasWakingInput() const;
+
+#if WITH_PHYSX_VEHICLES
+	// WakeVehicle for a caller already holding the scene write lock, such as the fleet waking several vehicles at once.
+	void WakeVehicle_AssumesLocked(physx::PxVehicleDriveNW& PVehicleDriveNW);
+#endif // WITH_PHYSX_VEHICLES
+
+	// Rest the drive and put the body to sleep, once bPendingSleep was set by ApplyInputs_AssumesLocked. From TickComponent.
+	void PutToSleep();
+
+	// Contacts and impulses wake the body, and the vehicle with it.
+	UFUNCTION()
+	void OnBodyWake(UPrimitiveComponent* WakingComponent, FName BoneName);
+
+	// Drivetrain state restored when leaving the Rail LOD.
+	bool bRestoreRailDrivetrain;
+	uint32 RailSavedGear;
+	float RailSavedEngineRotationSpeed;
+
+	// Preallocated snapshots, indexed by frame.
+	FVehicleNWSnapshotRing SnapshotRing;
+
+	// Capture the current simulation state, false if there is no PhysX vehicle.
+	bool CaptureSnapshot(FVehicleNWSnapshot& OutSnapshot) const;
+
+	TUniquePtr<FVehicleNWInputRecording> InputRecording;
+
+	// Recording being replayed, decoding position, last decoded frame.
+	TSharedPtr<const FVehicleNWInputRecording> InputReplay;
+	int32 InputReplayOffset;
+	FVehicleNWInputFrame InputReplayFrame;
+	int32 InputReplayFrameIndex;
+	int32 InputReplayDivergentFrame;
+
+	// Record, or replace with the replayed ones, the inputs of the coming physics step.
+	void UpdateInputRecording(float DeltaTime);
+
+#if WITH_PHYSX_VEHICLES
+	// Batch query used by ResimulateFromSnapshot, kept until the PhysX vehicle goes away.
+	TUniquePtr<FVehicleNWResimContext> ResimContext;
+
+	// Model TireModel names, found when the vehicle is bound. Null keeps the PhysX built-in model.
+	const IVehicleNWTireModel* ActiveTireModel;
+
+	// Prototype built in the background for SetupVehicle, the vehicle is bound to it by FinishAsyncSetup.
+	TSharedPtr<FVehicleNWPendingPrototype> PendingSetup;
+
+	// Wheel states the vehicle manager keeps for this vehicle, see GetWheelsStates_AssumesLocked.
+	mutable physx::PxWheelQueryResult* WheelsStates;
+#endif // WITH_PHYSX_VEHICLES
+
+	// LOD for the current distance to the closest player view.
+	EVehicleNWSimulationLOD EvaluateSimulationLOD() const;
+
+	// Move along the road surface at the Rail LOD.
+	void TickRail(float DeltaTime);
+
+	// Sample the ground below the vehicle, false if nothing was hit.
+	bool TraceRailGround(const FVector& Location);
+
 #if WITH_PHYSX_VEHICLES
 
 	// Allocate and setup the PhysX vehicle.
 	virtual void SetupVehicle() override;
 	virtual void UpdateSimulation(float DeltaTime) override;
 
+	// Tire forces of ActiveTireModel. Called by the engine's tire shader, from the thread running the vehicle update.
+	virtual void GenerateTireForces(UVehicleWheel* Wheel, const FTireShaderInput& Input, FTireShaderOutput& Output) override;
+
+	// Hash of everything the wheel and drive sim data are built from, see FVehicleNWPrototypeCache.
+	uint64 ComputePrototypeKey();
+
+	// Copy what the wheels sim data is built from, false if the wheels or the rigid body are not ready.
+	bool CaptureWheelsBlob(FVehicleNWWheelsBlob& Blob);
+
+	// Build the wheel and drive sim data on the game thread and add them to the cache.
+	const FVehicleNWPrototype* BuildPrototype(uint64 PrototypeKey);
+
+	// Create the PhysX drive from a prototype and bind it to the rigid body. False if there is no body to bind to.
+	bool BindVehicle(const FVehicleNWPrototype& Prototype);
+
+	// Bind the vehicle once PendingSetup is built, and do what the base class does after a synchronous SetupVehicle.
+	void FinishAsyncSetup();
+
+	// Smooth the current inputs and push them to the PhysX drive. Scene read lock must be held: only the drive's dynamic
+	// data and this component are written, sim data changes are left for ApplyPendingSubstepCount_AssumesLocked.
+	void ApplyInputs_AssumesLocked(physx::PxVehicleDriveNW& PVehicleDriveNW, float DeltaTime);
+
+	// The part of ApplyInputs_AssumesLocked that is simulation: reduced LOD accumulation and input smoothing. Used alone
+	// by resimulation, which must not touch sleep, surface, display or substep bookkeeping of the live vehicle.
+	void PushInputs_AssumesLocked(physx::PxVehicleDriveNW& PVehicleDriveNW, float DeltaTime);
+
+	// Wheel states of the last update, null until the vehicle manager has the vehicle. The manager finds them with a
+	// search of its vehicles, so they are looked up once and kept until the drive is rebound or the physics state goes.
+	const physx::PxWheelQueryResult* GetWheelsStates_AssumesLocked() const;
+
+	// Flag the wheels whose surface differs from the previous step. Only writes this component, runs under the read lock.
+	void UpdateWheelSurfaces_AssumesLocked(const physx::PxWheelQueryResult* WheelsStates);
+
+	// Quantize gear, speed and RPM and flag those that moved past their publish step. Same threading as above.
+	void UpdateDisplayValues_AssumesLocked(const physx::PxVehicleDriveNW& PVehicleDriveNW);
+
+	// Wheel substep counts for the current simulation LOD and substepping setup.
+	void ApplySubstepCount_AssumesLocked(physx::PxVehicleDriveNW& PVehicleDriveNW);
+
+	// Adapt AutoSubstepCount to the slip of the last update, and count the substeps the next update will use.
+	void UpdateSubstepCount_AssumesLocked(const physx::PxVehicleDriveNW& PVehicleDriveNW, const physx::PxWheelQueryResult* WheelsStates);
+
+	// Write an AutoSubstepCount changed by UpdateSubstepCount_AssumesLocked to the drive. Scene write lock must be held.
+	void ApplyPendingSubstepCount_AssumesLocked(physx::PxVehicleDriveNW& PVehicleDriveNW);
+
+	// Push the drive state, wheel states of the last update and inputs of this step to the telemetry ring.
+	void RecordTelemetry_AssumesLocked(FVehicleNWTelemetryRecorder::FProducer& Producer, const physx::PxVehicleDriveNW& PVehicleDriveNW, float DeltaTime) const;
 
 #endif // WITH_PHYSX_VEHICLES
 
@@ -177,4 +739,9 @@ protected:
 
 	// Update simulation data: transmission.
 	void UpdateTransmissionSetup(const FVehicleTransmissionNWData& NewGearSetup);
-};
\ No newline at end of file
+};
+
+#if WITH_PHYSX_VEHICLES
+// Convert the differential, engine, clutch, gear and autobox setup of a vehicle to PhysX drive data.
+MYVEHICLEPROJECT_API void SetupDriveHelper(const UVehicleMovementComponentNW* VehicleData, const physx::PxVehicleWheelsSimData* PWheelsSimData, physx::PxVehicleDriveSimDataNW& DriveData);
+#endif // WITH_PHYSX_VEHICLES
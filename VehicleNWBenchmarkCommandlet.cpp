@@ -0,0 +1,371 @@
+// Copyright Unreal Engine Community.
+
+#include "VehicleNWBenchmarkCommandlet.h"
+#include "VehicleMovementComponentNW.h"
+#include "PhysXIncludes.h"
+#include "PhysXPublic.h"
+#include "HAL/PlatformTime.h"
+#include "HAL/PlatformMemory.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Dom/JsonObject.h"
+#include "Serialization/JsonWriter.h"
+#include "Serialization/JsonSerializer.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogVehicleNWBenchmark, Log, All);
+
+#if WITH_PHYSX_VEHICLES
+
+namespace VehicleNWBenchmark
+{
+	// Test vehicle, roughly a heavy truck. Lengths are in cm like the rest of the engine.
+	const float ChassisMass = 4000.f;
+	const PxVec3 ChassisHalfExtents(300.f, 120.f, 60.f);
+	const float WheelRadius = 50.f;
+	const float WheelWidth = 30.f;
+	const float WheelMass = 40.f;
+	const float AxleSpacing = 60.f;
+	const float VehicleSpacing = 1500.f;
+
+	struct FSweepResult
+	{
+		int32 NumWheels;
+		int32 NumVehicles;
+		TArray<double> SetupNs;
+		double VehicleUpdateNsPerVehicleStep;
+		double TotalNsPerVehicleStep;
+		uint64 MemoryDeltaBytes;
+		uint64 PeakUsedPhysicalBytes;
+	};
+
+	static TArray<int32> ParseIntList(const FString& Params, const TCHAR* Key, const TArray<int32>& Default)
+	{
+		FString Value;
+		if (!FParse::Value(*Params, Key, Value, false))
+		{
+			return Default;
+		}
+
+		TArray<FString> Items;
+		Value.ParseIntoArray(Items, TEXT(","));
+
+		TArray<int32> Result;
+		for (const FString& Item : Items)
+		{
+			Result.Add(FCString::Atoi(*Item));
+		}
+		return Result;
+	}
+
+	static double Percentile(const TArray<double>& SortedSamples, float Fraction)
+	{
+		if (SortedSamples.Num() == 0)
+		{
+			return 0.0;
+		}
+
+		const int32 Index = FMath::Clamp(FMath::RoundToInt(Fraction * (SortedSamples.Num() - 1)), 0, SortedSamples.Num() - 1);
+		return SortedSamples[Index];
+	}
+
+	static PxVehicleWheelsSimData* CreateWheelsSimData(int32 NumWheels)
+	{
+		PxVehicleWheelsSimData* PWheelsSimData = PxVehicleWheelsSimData::allocate(NumWheels);
+
+		// Wheels in left/right pairs along the chassis.
+		TArray<PxVec3> WheelOffsets;
+		WheelOffsets.SetNum(NumWheels);
+		const int32 NumAxles = (NumWheels + 1) / 2;
+		for (int32 WheelIdx = 0; WheelIdx < NumWheels; WheelIdx++)
+		{
+			const int32 AxleIdx = WheelIdx / 2;
+			const float X = (NumAxles - 1) * AxleSpacing * 0.5f - AxleIdx * AxleSpacing;
+			const float Y = (WheelIdx % 2 == 0) ? -ChassisHalfExtents.y : ChassisHalfExtents.y;
+			WheelOffsets[WheelIdx] = PxVec3(X, Y, -ChassisHalfExtents.z);
+		}
+
+		TArray<PxReal> SprungMasses;
+		SprungMasses.SetNum(NumWheels);
+		PxVehicleComputeSprungMasses(NumWheels, WheelOffsets.GetData(), PxVec3(0.f), ChassisMass, 2, SprungMasses.GetData());
+
+		for (int32 WheelIdx = 0; WheelIdx < NumWheels; WheelIdx++)
+		{
+			PxVehicleWheelData WheelData;
+			WheelData.mRadius = WheelRadius;
+			WheelData.mWidth = WheelWidth;
+			WheelData.mMass = WheelMass;
+			WheelData.mMOI = 0.5f * WheelMass * WheelRadius * WheelRadius;
+			WheelData.mMaxSteer = (WheelIdx < 2) ? PxPi / 4.f : 0.f;
+			WheelData.mMaxHandBrakeTorque = (WheelIdx >= 2) ? M2ToCm2(4000.f) : 0.f;
+			WheelData.mMaxBrakeTorque = M2ToCm2(3000.f);
+			PWheelsSimData->setWheelData(WheelIdx, WheelData);
+
+			PxVehicleTireData TireData;
+			TireData.mType = 0;
+			PWheelsSimData->setTireData(WheelIdx, TireData);
+
+			PxVehicleSuspensionData SuspensionData;
+			SuspensionData.mSprungMass = SprungMasses[WheelIdx];
+			SuspensionData.mMaxCompression = 10.f;
+			SuspensionData.mMaxDroop = 10.f;
+			SuspensionData.mSpringStrength = FMath::Square(7.f * 2.f * PI) * SprungMasses[WheelIdx];
+			SuspensionData.mSpringDamperRate = 2.f * FMath::Sqrt(SuspensionData.mSpringStrength * SprungMasses[WheelIdx]);
+			PWheelsSimData->setSuspensionData(WheelIdx, SuspensionData);
+
+			PWheelsSimData->setSuspTravelDirection(WheelIdx, PxVec3(0.f, 0.f, -1.f));
+			PWheelsSimData->setWheelCentreOffset(WheelIdx, WheelOffsets[WheelIdx]);
+			PWheelsSimData->setSuspForceAppPointOffset(WheelIdx, WheelOffsets[WheelIdx]);
+			PWheelsSimData->setTireForceAppPointOffset(WheelIdx, WheelOffsets[WheelIdx]);
+
+			// No wheel shapes, raycasts only.
+			PWheelsSimData->setWheelShapeMapping(WheelIdx, -1);
+		}
+
+		return PWheelsSimData;
+	}
+
+	static void RunSweep(int32 NumWheels, int32 NumVehicles, int32 WarmupSteps, int32 Steps, float DeltaTime, FSweepResult& OutResult)
+	{
+		OutResult.NumWheels = NumWheels;
+		OutResult.NumVehicles = NumVehicles;
+
+		const uint64 UsedPhysicalBefore = FPlatformMemory::GetStats().UsedPhysical;
+
+		PxSceneDesc SceneDesc(GPhysXSDK->getTolerancesScale());
+		SceneDesc.gravity = PxVec3(0.f, 0.f, -980.f);
+		SceneDesc.cpuDispatcher = PxDefaultCpuDispatcherCreate(0);
+		SceneDesc.filterShader = PxDefaultSimulationFilterShader;
+		PxScene* PScene = GPhysXSDK->createScene(SceneDesc);
+
+		PxMaterial* PMaterial = GPhysXSDK->createMaterial(1.f, 1.f, 0.f);
+		PxRigidStatic* PGround = PxCreatePlane(*GPhysXSDK, PxPlane(0.f, 0.f, 1.f, 0.f), *PMaterial);
+		PScene->addActor(*PGround);
+
+		PxVehicleDrivableSurfaceType SurfaceType;
+		SurfaceType.mType = 0;
+		const PxMaterial* SurfaceMaterials[1] = { PMaterial };
+		PxVehicleDrivableSurfaceToTireFrictionPairs* PFrictionPairs = PxVehicleDrivableSurfaceToTireFrictionPairs::allocate(1, 1);
+		PFrictionPairs->setup(1, 1, SurfaceMaterials, &SurfaceType);
+		PFrictionPairs->setTypePairFriction(0, 0, 1.f);
+
+		// Drive data comes from the component defaults, through the same conversion as SetupVehicle.
+		UVehicleMovementComponentNW* Template = NewObject<UVehicleMovementComponentNW>();
+		Template->DifferentialSetup.DWheelData.Reset();
+		for (int32 WheelIdx = 0; WheelIdx < NumWheels; WheelIdx++)
+		{
+			FDrivenWheelData DiffData;
+			DiffData.DrivenWheelIndex = WheelIdx;
+			DiffData.IsDrivenWheel = true;
+			Template->DifferentialSetup.DWheelData.Add(DiffData);
+		}
+
+		TArray<PxVehicleWheels*> PVehicles;
+		TArray<PxRigidDynamic*> PActors;
+		PVehicles.Reserve(NumVehicles);
+		PActors.Reserve(NumVehicles);
+		OutResult.SetupNs.Reset(NumVehicles);
+
+		const int32 GridSize = FMath::CeilToInt(FMath::Sqrt((float)NumVehicles));
+		for (int32 VehicleIdx = 0; VehicleIdx < NumVehicles; VehicleIdx++)
+		{
+			const PxTransform Pose(PxVec3((VehicleIdx % GridSize) * VehicleSpacing, (VehicleIdx / GridSize) * VehicleSpacing, ChassisHalfExtents.z + WheelRadius + 10.f));
+			PxRigidDynamic* PActor = GPhysXSDK->createRigidDynamic(Pose);
+			PxShape* PChassisShape = PxRigidActorExt::createExclusiveShape(*PActor, PxBoxGeometry(ChassisHalfExtents), *PMaterial);
+			PChassisShape->setFlag(PxShapeFlag::eSCENE_QUERY_SHAPE, false);
+			PxRigidBodyExt::setMassAndUpdateInertia(*PActor, ChassisMass);
+			PScene->addActor(*PActor);
+
+			// Time everything SetupVehicle does for the drive: wheel data, conversion, allocation and setup.
+			const uint64 StartCycles = FPlatformTime::Cycles64();
+
+			PxVehicleWheelsSimData* PWheelsSimData = CreateWheelsSimData(NumWheels);
+
+			PxVehicleDriveSimDataNW DriveData;
+			SetupDriveHelper(Template, PWheelsSimData, DriveData);
+
+			PxVehicleDriveNW* PVehicleDriveNW = PxVehicleDriveNW::allocate(NumWheels);
+			PVehicleDriveNW->setup(GPhysXSDK, PActor, *PWheelsSimData, DriveData, 0);
+			PVehicleDriveNW->setToRestState();
+			PVehicleDriveNW->mDriveDynData.forceGearChange(PxVehicleGearsData::eFIRST);
+			PVehicleDriveNW->mDriveDynData.setUseAutoGears(true);
+
+			PWheelsSimData->free();
+
+			OutResult.SetupNs.Add(FPlatformTime::ToMilliseconds64(FPlatformTime::Cycles64() - StartCycles) * 1e6);
+
+			PVehicles.Add(PVehicleDriveNW);
+			PActors.Add(PActor);
+		}
+
+		// One batched query for every wheel of every vehicle.
+		const int32 NumRaycasts = NumVehicles * NumWheels;
+		TArray<PxRaycastQueryResult> RaycastResults;
+		TArray<PxRaycastHit> RaycastHits;
+		RaycastResults.SetNumZeroed(NumRaycasts);
+		RaycastHits.SetNumZeroed(NumRaycasts);
+
+		PxBatchQueryDesc BatchQueryDesc(NumRaycasts, 0, 0);
+		BatchQueryDesc.queryMemory.userRaycastResultBuffer = RaycastResults.GetData();
+		BatchQueryDesc.queryMemory.userRaycastTouchBuffer = RaycastHits.GetData();
+		BatchQueryDesc.queryMemory.raycastTouchBufferSize = NumRaycasts;
+		PxBatchQuery* PBatchQuery = PScene->createBatchQuery(BatchQueryDesc);
+
+		const PxVec3 Gravity = PScene->getGravity();
+		uint64 VehicleCycles = 0;
+		uint64 TotalCycles = 0;
+
+		for (int32 StepIdx = 0; StepIdx < WarmupSteps + Steps; StepIdx++)
+		{
+			for (PxVehicleWheels* PVehicle : PVehicles)
+			{
+				PxVehicleDriveNW* PVehicleDriveNW = (PxVehicleDriveNW*)PVehicle;
+				PVehicleDriveNW->mDriveDynData.setAnalogInput(PxVehicleDriveNWControl::eANALOG_INPUT_ACCEL, 0.5f);
+				PVehicleDriveNW->mDriveDynData.setAnalogInput(PxVehicleDriveNWControl::eANALOG_INPUT_STEER_RIGHT, 0.1f);
+			}
+
+			const uint64 StepStartCycles = FPlatformTime::Cycles64();
+
+			PxVehicleSuspensionRaycasts(PBatchQuery, PVehicles.Num(), PVehicles.GetData(), RaycastResults.Num(), RaycastResults.GetData());
+			PxVehicleUpdates(DeltaTime, Gravity, *PFrictionPairs, PVehicles.Num(), PVehicles.GetData(), nullptr);
+
+			const uint64 VehicleEndCycles = FPlatformTime::Cycles64();
+
+			PScene->simulate(DeltaTime);
+			PScene->fetchResults(true);
+
+			if (StepIdx >= WarmupSteps)
+			{
+				VehicleCycles += VehicleEndCycles - StepStartCycles;
+				TotalCycles += FPlatformTime::Cycles64() - StepStartCycles;
+			}
+		}
+
+		const double VehicleSteps = (double)FMath::Max(1, Steps) * NumVehicles;
+		OutResult.VehicleUpdateNsPerVehicleStep = FPlatformTime::ToMilliseconds64(VehicleCycles) * 1e6 / VehicleSteps;
+		OutResult.TotalNsPerVehicleStep = FPlatformTime::ToMilliseconds64(TotalCycles) * 1e6 / VehicleSteps;
+
+		const FPlatformMemoryStats MemoryStats = FPlatformMemory::GetStats();
+		OutResult.MemoryDeltaBytes = MemoryStats.UsedPhysical > UsedPhysicalBefore ? MemoryStats.UsedPhysical - UsedPhysicalBefore : 0;
+		OutResult.PeakUsedPhysicalBytes = MemoryStats.PeakUsedPhysical;
+
+		// Cleanup.
+		PBatchQuery->release();
+		for (PxVehicleWheels* PVehicle : PVehicles)
+		{
+			((PxVehicleDriveNW*)PVehicle)->free();
+		}
+		for (PxRigidDynamic* PActor : PActors)
+		{
+			PActor->release();
+		}
+		PFrictionPairs->release();
+		PGround->release();
+		PScene->release();
+		PMaterial->release();
+		static_cast<PxDefaultCpuDispatcher*>(SceneDesc.cpuDispatcher)->release();
+		Template->MarkPendingKill();
+
+		OutResult.SetupNs.Sort();
+	}
+
+	static TSharedRef<FJsonObject> ToJson(const FSweepResult& Result)
+	{
+		TSharedRef<FJsonObject> SetupObject = MakeShared<FJsonObject>();
+		SetupObject->SetNumberField(TEXT("p50"), Percentile(Result.SetupNs, 0.5f));
+		SetupObject->SetNumberField(TEXT("p90"), Percentile(Result.SetupNs, 0.9f));
+		SetupObject->SetNumberField(TEXT("p99"), Percentile(Result.SetupNs, 0.99f));
+		SetupObject->SetNumberField(TEXT("max"), Result.SetupNs.Num() ? Result.SetupNs.Last() : 0.0);
+
+		TSharedRef<FJsonObject> ResultObject = MakeShared<FJsonObject>();
+		ResultObject->SetNumberField(TEXT("wheels"), Result.NumWheels);
+		ResultObject->SetNumberField(TEXT("vehicles"), Result.NumVehicles);
+		ResultObject->SetObjectField(TEXT("setup_ns"), SetupObject);
+		ResultObject->SetNumberField(TEXT("vehicle_update_ns_per_vehicle_step"), Result.VehicleUpdateNsPerVehicleStep);
+		ResultObject->SetNumberField(TEXT("total_ns_per_vehicle_step"), Result.TotalNsPerVehicleStep);
+		ResultObject->SetNumberField(TEXT("memory_delta_bytes"), (double)Result.MemoryDeltaBytes);
+		ResultObject->SetNumberField(TEXT("peak_used_physical_bytes"), (double)Result.PeakUsedPhysicalBytes);
+		return ResultObject;
+	}
+}
+
+#endif // WITH_PHYSX_VEHICLES
+
+UVehicleNWBenchmarkCommandlet::UVehicleNWBenchmarkCommandlet(const FObjectInitializer& ObjectInitializer)
+	: Super(ObjectInitializer)
+{
+	IsClient = false;
+	IsServer = false;
+	IsEditor = false;
+	LogToConsole = true;
+}
+
+int32 UVehicleNWBenchmarkCommandlet::Main(const FString& Params)
+{
+#if WITH_PHYSX_VEHICLES
+	using namespace VehicleNWBenchmark;
+
+	const TArray<int32> WheelCounts = ParseIntList(Params, TEXT("Wheels="), { 2, 4, 6, 8, 10, 12, 14, 16, 18, 20 });
+	const TArray<int32> VehicleCounts = ParseIntList(Params, TEXT("Vehicles="), { 1, 10, 100, 1000, 5000 });
+
+	int32 Steps = 120;
+	int32 WarmupSteps = 10;
+	float DeltaTime = 1.f / 60.f;
+	FParse::Value(*Params, TEXT("Steps="), Steps);
+	FParse::Value(*Params, TEXT("WarmupSteps="), WarmupSteps);
+	FParse::Value(*Params, TEXT("DeltaTime="), DeltaTime);
+
+	FString OutputPath = FPaths::ProjectSavedDir() / TEXT("VehicleNWBenchmark.json");
+	FParse::Value(*Params, TEXT("Output="), OutputPath);
+
+	TArray<TSharedPtr<FJsonValue>> Results;
+	for (int32 NumWheels : WheelCounts)
+	{
+		// PxVehicleDriveNW supports 2 to 20 wheels, same limit as SetupVehicle.
+		if (NumWheels < 2 || NumWheels > PX_MAX_NB_WHEELS)
+		{
+			UE_LOG(LogVehicleNWBenchmark, Warning, TEXT("Skipping unsupported wheel count %d"), NumWheels);
+			continue;
+		}
+
+		for (int32 NumVehicles : VehicleCounts)
+		{
+			if (NumVehicles < 1)
+			{
+				continue;
+			}
+
+			FSweepResult Result;
+			RunSweep(NumWheels, NumVehicles, WarmupSteps, Steps, DeltaTime, Result);
+			Results.Add(MakeShared<FJsonValueObject>(ToJson(Result)));
+
+			UE_LOG(LogVehicleNWBenchmark, Display, TEXT("wheels=%d vehicles=%d setup_p50=%.0fns update=%.1fns/vehicle/step total=%.1fns/vehicle/step"),
+				NumWheels, NumVehicles, Percentile(Result.SetupNs, 0.5f), Result.VehicleUpdateNsPerVehicleStep, Result.TotalNsPerVehicleStep);
+
+			CollectGarbage(RF_NoFlags);
+		}
+	}
+
+	TSharedRef<FJsonObject> RootObject = MakeShared<FJsonObject>();
+	RootObject->SetStringField(TEXT("benchmark"), TEXT("VehicleNW"));
+	RootObject->SetNumberField(TEXT("steps"), Steps);
+	RootObject->SetNumberField(TEXT("warmup_steps"), WarmupSteps);
+	RootObject->SetNumberField(TEXT("delta_time"), DeltaTime);
+	RootObject->SetArrayField(TEXT("results"), Results);
+
+	FString Json;
+	TSharedRef<TJsonWriter<>> Writer = TJsonWriterFactory<>::Create(&Json);
+	FJsonSerializer::Serialize(RootObject, Writer);
+
+	if (!FFileHelper::SaveStringToFile(Json, *OutputPath))
+	{
+		UE_LOG(LogVehicleNWBenchmark, Error, TEXT("Failed to write %s"), *OutputPath);
+		return 1;
+	}
+
+	UE_LOG(LogVehicleNWBenchmark, Display, TEXT("Wrote %s"), *OutputPath);
+	return 0;
+#else
+	UE_LOG(LogVehicleNWBenchmark, Error, TEXT("PhysX vehicles are not available in this build."));
+	return 1;
+#endif // WITH_PHYSX_VEHICLES
+}
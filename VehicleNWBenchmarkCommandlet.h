@@ -0,0 +1,27 @@
+// Copyright Unreal Engine Community.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "VehicleNWBenchmarkCommandlet.generated.h"
+
+/**
+ * Headless benchmark for PxVehicleDriveNW setup and stepping.
+ *
+ * Builds vehicles with the same conversion code as UVehicleMovementComponentNW (SetupDriveHelper) in a plain
+ * PhysX scene with a flat ground plane, steps them with batched suspension raycasts and PxVehicleUpdates, and
+ * writes the results as JSON.
+ *
+ * UE4Editor-Cmd <Project> -run=VehicleNWBenchmark -nullrhi [-Wheels=2,4,...,20] [-Vehicles=1,10,...,5000]
+ *     [-Steps=120] [-WarmupSteps=10] [-DeltaTime=0.016667] [-Output=<Saved/VehicleNWBenchmark.json>]
+ */
+UCLASS()
+class MYVEHICLEPROJECT_API UVehicleNWBenchmarkCommandlet : public UCommandlet
+{
+	GENERATED_UCLASS_BODY()
+
+	// Begin UCommandlet interface
+	virtual int32 Main(const FString& Params) override;
+	// End UCommandlet interface
+};
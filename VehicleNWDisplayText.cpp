@@ -0,0 +1,72 @@
+// Copyright Unreal Engine Community.
+
+#include "VehicleNWDisplayText.h"
+#include "Internationalization/Internationalization.h"
+
+#define LOCTEXT_NAMESPACE "VehicleNW"
+
+namespace VehicleNWDisplayText
+{
+	// PxVehicleGearsData::eGEARSRATIO_COUNT, reverse and neutral included.
+	static constexpr int32 NumGears = 32;
+
+	struct FCache
+	{
+		TArray<FText> Gears;
+		TArray<FText> Speeds;
+		bool bRegisteredCultureChanged = false;
+
+		void BuildIfNeeded()
+		{
+			if (!bRegisteredCultureChanged)
+			{
+				FInternationalization::Get().OnCultureChanged().AddLambda([this]() { Gears.Reset(); Speeds.Reset(); });
+				bRegisteredCultureChanged = true;
+			}
+			if (Gears.Num() > 0)
+			{
+				return;
+			}
+
+			Gears.Reserve(NumGears);
+			Gears.Add(LOCTEXT("ReverseGear", "R"));
+			Gears.Add(LOCTEXT("NeutralGear", "N"));
+			for (int32 Gear = 1; Gear < NumGears - 1; Gear++)
+			{
+				Gears.Add(FText::AsNumber(Gear));
+			}
+
+			Speeds.Reserve(FVehicleNWDisplayText::MaxCachedSpeed + 1);
+			for (int32 Speed = 0; Speed <= FVehicleNWDisplayText::MaxCachedSpeed; Speed++)
+			{
+				Speeds.Add(FormatSpeed(Speed));
+			}
+		}
+
+		static FText FormatSpeed(int32 Speed)
+		{
+			return FText::Format(LOCTEXT("SpeedFormat", "{0} km/h"), FText::AsNumber(Speed));
+		}
+	};
+
+	static FCache& GetCache()
+	{
+		static FCache Cache;
+		Cache.BuildIfNeeded();
+		return Cache;
+	}
+}
+
+const FText& FVehicleNWDisplayText::GetGearText(int32 Gear)
+{
+	const VehicleNWDisplayText::FCache& Cache = VehicleNWDisplayText::GetCache();
+	return Cache.Gears[FMath::Clamp(Gear + 1, 0, Cache.Gears.Num() - 1)];
+}
+
+FText FVehicleNWDisplayText::GetSpeedText(int32 Speed)
+{
+	const VehicleNWDisplayText::FCache& Cache = VehicleNWDisplayText::GetCache();
+	return Cache.Speeds.IsValidIndex(Speed) ? Cache.Speeds[Speed] : VehicleNWDisplayText::FCache::FormatSpeed(Speed);
+}
+
+#undef LOCTEXT_NAMESPACE
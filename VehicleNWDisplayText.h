@@ -0,0 +1,23 @@
+// Copyright Unreal Engine Community.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * Gear and speed strings for vehicle HUDs, formatted once and shared by every vehicle. Rebuilt when the culture
+ * changes. Game thread only.
+ */
+class MYVEHICLEPROJECT_API FVehicleNWDisplayText
+{
+public:
+
+	// Speeds above this are formatted on each call.
+	static constexpr int32 MaxCachedSpeed = 400;
+
+	/** "R" for -1, "N" for 0, then the gear number. */
+	static const FText& GetGearText(int32 Gear);
+
+	/** Speed in km/h, e.g. "10 km/h". */
+	static FText GetSpeedText(int32 Speed);
+};
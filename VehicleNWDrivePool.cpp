@@ -0,0 +1,145 @@
+// Copyright Unreal Engine Community.
+
+#include "VehicleNWDrivePool.h"
+#include "PhysXIncludes.h"
+#include "PhysXPublic.h"
+#include "Misc/CoreDelegates.h"
+#include "VehicleNWStats.h"
+
+DECLARE_DWORD_COUNTER_STAT(TEXT("Drive Pool Hits"), STAT_VehicleNW_DrivePoolHits, STATGROUP_VehicleNW);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Drive Pool Misses"), STAT_VehicleNW_DrivePoolMisses, STATGROUP_VehicleNW);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Drive Pool Size"), STAT_VehicleNW_DrivePoolSize, STATGROUP_VehicleNW);
+
+static TAutoConsoleVariable<int32> CVarVehicleNWDrivePoolPrewarmSize(
+	TEXT("p.VehicleNW.DrivePool.PrewarmSize"),
+	8,
+	TEXT("Number of free drives kept ready for every wheel count that has been spawned."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarVehicleNWDrivePoolMaxSize(
+	TEXT("p.VehicleNW.DrivePool.MaxSize"),
+	64,
+	TEXT("High-water mark of free drives kept per wheel count."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarVehicleNWDrivePoolReplenishPerFrame(
+	TEXT("p.VehicleNW.DrivePool.ReplenishPerFrame"),
+	4,
+	TEXT("Max number of drives allocated per frame to top up the pool."),
+	ECVF_Default);
+
+#if WITH_PHYSX_VEHICLES
+
+FVehicleNWDrivePool& FVehicleNWDrivePool::Get()
+{
+	static FVehicleNWDrivePool Pool;
+	return Pool;
+}
+
+FVehicleNWDrivePool::FVehicleNWDrivePool()
+{
+	Buckets.SetNum(PX_MAX_NB_WHEELS + 1);
+
+	TickerHandle = FTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateRaw(this, &FVehicleNWDrivePool::Replenish));
+
+	// PhysX is gone by the time statics are destroyed.
+	FCoreDelegates::OnPreExit.AddRaw(this, &FVehicleNWDrivePool::Empty);
+}
+
+FVehicleNWDrivePool::~FVehicleNWDrivePool()
+{
+	for (const FBucket& Bucket : Buckets)
+	{
+		check(Bucket.Drives.Num() == 0);
+	}
+}
+
+PxVehicleDriveNW* FVehicleNWDrivePool::Acquire(int32 NumWheels)
+{
+	check(Buckets.IsValidIndex(NumWheels));
+
+	FBucket& Bucket = Buckets[NumWheels];
+	Bucket.bUsed = true;
+
+	if (Bucket.Drives.Num() > 0)
+	{
+		INC_DWORD_STAT(STAT_VehicleNW_DrivePoolHits);
+		DEC_DWORD_STAT(STAT_VehicleNW_DrivePoolSize);
+		return Bucket.Drives.Pop(false);
+	}
+
+	INC_DWORD_STAT(STAT_VehicleNW_DrivePoolMisses);
+	return PxVehicleDriveNW::allocate(NumWheels);
+}
+
+void FVehicleNWDrivePool::Release(PxVehicleDriveNW* Drive, int32 NumWheels)
+{
+	check(Drive && Buckets.IsValidIndex(NumWheels));
+
+	FBucket& Bucket = Buckets[NumWheels];
+	if (Bucket.Drives.Num() >= CVarVehicleNWDrivePoolMaxSize.GetValueOnGameThread())
+	{
+		Drive->free();
+		return;
+	}
+
+	Bucket.Drives.Add(Drive);
+	INC_DWORD_STAT(STAT_VehicleNW_DrivePoolSize);
+}
+
+void FVehicleNWDrivePool::Prewarm(int32 NumWheels, int32 Count)
+{
+	check(Buckets.IsValidIndex(NumWheels));
+
+	FBucket& Bucket = Buckets[NumWheels];
+	Bucket.bUsed = true;
+
+	const int32 TargetCount = FMath::Min(Count, CVarVehicleNWDrivePoolMaxSize.GetValueOnGameThread());
+	while (Bucket.Drives.Num() < TargetCount)
+	{
+		Bucket.Drives.Add(PxVehicleDriveNW::allocate(NumWheels));
+		INC_DWORD_STAT(STAT_VehicleNW_DrivePoolSize);
+	}
+}
+
+void FVehicleNWDrivePool::Empty()
+{
+	for (FBucket& Bucket : Buckets)
+	{
+		for (PxVehicleDriveNW* Drive : Bucket.Drives)
+		{
+			Drive->free();
+		}
+		Bucket.Drives.Empty();
+		Bucket.bUsed = false;
+	}
+
+	SET_DWORD_STAT(STAT_VehicleNW_DrivePoolSize, 0);
+}
+
+int32 FVehicleNWDrivePool::GetNumPooled(int32 NumWheels) const
+{
+	return Buckets.IsValidIndex(NumWheels) ? Buckets[NumWheels].Drives.Num() : 0;
+}
+
+bool FVehicleNWDrivePool::Replenish(float DeltaTime)
+{
+	const int32 TargetCount = FMath::Min(CVarVehicleNWDrivePoolPrewarmSize.GetValueOnGameThread(), CVarVehicleNWDrivePoolMaxSize.GetValueOnGameThread());
+	int32 Budget = CVarVehicleNWDrivePoolReplenishPerFrame.GetValueOnGameThread();
+
+	for (int32 NumWheels = 0; NumWheels < Buckets.Num() && Budget > 0; NumWheels++)
+	{
+		FBucket& Bucket = Buckets[NumWheels];
+		while (Bucket.bUsed && Bucket.Drives.Num() < TargetCount && Budget > 0)
+		{
+			Bucket.Drives.Add(PxVehicleDriveNW::allocate(NumWheels));
+			INC_DWORD_STAT(STAT_VehicleNW_DrivePoolSize);
+			--Budget;
+		}
+	}
+
+	// Keep ticking.
+	return true;
+}
+
+#endif // WITH_PHYSX_VEHICLES
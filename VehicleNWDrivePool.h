@@ -0,0 +1,68 @@
+// Copyright Unreal Engine Community.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Containers/Ticker.h"
+
+#if WITH_PHYSX_VEHICLES
+
+namespace physx
+{
+	class PxVehicleDriveNW;
+}
+
+/**
+ * Pre-allocated PxVehicleDriveNW instances, bucketed by wheel count.
+ *
+ * FPhysXVehicleManager frees a vehicle's drive when the vehicle is removed, so drives of despawned vehicles
+ * cannot come back here. Instead the pool keeps every bucket that was used topped up to its pre-warm size from
+ * the core ticker, so allocation happens between spawn waves rather than during them. Drives that were acquired
+ * but never handed to the vehicle manager are returned with Release.
+ *
+ * Game thread only.
+ */
+class MYVEHICLEPROJECT_API FVehicleNWDrivePool
+{
+public:
+
+	static FVehicleNWDrivePool& Get();
+
+	~FVehicleNWDrivePool();
+
+	/** A drive for NumWheels wheels, taken from the pool if possible. setup() still has to be called on it. */
+	physx::PxVehicleDriveNW* Acquire(int32 NumWheels);
+
+	/** Return a drive that was never registered with the vehicle manager. Freed if the bucket is at its high-water mark. */
+	void Release(physx::PxVehicleDriveNW* Drive, int32 NumWheels);
+
+	/** Allocate drives for NumWheels wheels until the bucket holds Count, capped by the high-water mark. */
+	void Prewarm(int32 NumWheels, int32 Count);
+
+	/** Free every pooled drive. */
+	void Empty();
+
+	int32 GetNumPooled(int32 NumWheels) const;
+
+private:
+
+	FVehicleNWDrivePool();
+
+	/** Top up used buckets to the pre-warm size, a few allocations per frame. */
+	bool Replenish(float DeltaTime);
+
+	struct FBucket
+	{
+		TArray<physx::PxVehicleDriveNW*> Drives;
+
+		/** Whether a vehicle with this wheel count was ever spawned. Only used buckets are replenished. */
+		bool bUsed = false;
+	};
+
+	/** Indexed by wheel count. */
+	TArray<FBucket> Buckets;
+
+	FDelegateHandle TickerHandle;
+};
+
+#endif // WITH_PHYSX_VEHICLES
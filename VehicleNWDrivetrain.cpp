@@ -0,0 +1,309 @@
+// Copyright Unreal Engine Community.
+
+#include "VehicleNWDrivetrain.h"
+#include "VehicleMovementComponentNW.h"
+#include "PhysXIncludes.h"
+#include "PhysXPublic.h"
+#include "VehicleNWStats.h"
+
+DECLARE_CYCLE_STAT(TEXT("Compile Drivetrain"), STAT_VehicleNW_CompileDrivetrain, STATGROUP_VehicleNW);
+
+// Dense samples taken from TorqueCurve before picking the table entries.
+static const int32 NumTorqueCurveSamples = 128;
+
+static_assert(TIsPODType<FVehicleNWDrivetrainBlob>::Value, "FVehicleNWDrivetrainBlob is hashed and copied as raw bytes.");
+
+#if WITH_PHYSX_VEHICLES
+static_assert(FVehicleNWDrivetrainBlob::MaxTorqueSamples == PxVehicleEngineData::eMAX_NB_ENGINE_TORQUE_CURVE_ENTRIES, "Torque table size mismatch.");
+static_assert(FVehicleNWDrivetrainBlob::MaxGearRatios == PxVehicleGearsData::eGEARSRATIO_COUNT, "Gear count mismatch.");
+static_assert(FVehicleNWDrivetrainBlob::ReverseGear == PxVehicleGearsData::eREVERSE && FVehicleNWDrivetrainBlob::NeutralGear == PxVehicleGearsData::eNEUTRAL && FVehicleNWDrivetrainBlob::FirstGear == PxVehicleGearsData::eFIRST, "Gear index mismatch.");
+static_assert(FVehicleNWDrivetrainBlob::MaxWheels == PX_MAX_NB_WHEELS, "Wheel count mismatch.");
+#endif // WITH_PHYSX_VEHICLES
+
+/**
+ * Pick MaxTorqueSamples points of the dense samples so that the piecewise linear table PhysX builds from them
+ * deviates as little as possible from the curve (minimax). The first and last samples are always kept.
+ */
+static float ResampleTorqueTable(const TArray<float>& X, const TArray<float>& Y, FVehicleNWDrivetrainBlob& Blob)
+{
+	const int32 NumSamples = X.Num();
+	const int32 NumPoints = FMath::Min(NumSamples, FVehicleNWDrivetrainBlob::MaxTorqueSamples);
+
+	// SegmentError[I * NumSamples + J]: largest error when samples I and J are joined by a straight line.
+	TArray<float> SegmentError;
+	SegmentError.SetNumZeroed(NumSamples * NumSamples);
+	for (int32 I = 0; I < NumSamples; ++I)
+	{
+		for (int32 J = I + 2; J < NumSamples; ++J)
+		{
+			const float Slope = (Y[J] - Y[I]) / FMath::Max(X[J] - X[I], KINDA_SMALL_NUMBER);
+			float Error = 0.f;
+			for (int32 K = I + 1; K < J; ++K)
+			{
+				Error = FMath::Max(Error, FMath::Abs(Y[I] + Slope * (X[K] - X[I]) - Y[K]));
+			}
+			SegmentError[I * NumSamples + J] = Error;
+		}
+	}
+
+	// Cost[P * NumSamples + J]: best error of a table of P + 1 points ending on sample J.
+	TArray<float> Cost;
+	TArray<int32> Previous;
+	Cost.Init(MAX_flt, NumPoints * NumSamples);
+	Previous.Init(INDEX_NONE, NumPoints * NumSamples);
+	Cost[0] = 0.f;
+	for (int32 P = 1; P < NumPoints; ++P)
+	{
+		for (int32 J = P; J < NumSamples; ++J)
+		{
+			for (int32 I = P - 1; I < J; ++I)
+			{
+				const float PrevCost = Cost[(P - 1) * NumSamples + I];
+				if (PrevCost == MAX_flt)
+				{
+					continue;
+				}
+
+				const float NewCost = FMath::Max(PrevCost, SegmentError[I * NumSamples + J]);
+				if (NewCost < Cost[P * NumSamples + J])
+				{
+					Cost[P * NumSamples + J] = NewCost;
+					Previous[P * NumSamples + J] = I;
+				}
+			}
+		}
+	}
+
+	// Walk back from the last sample.
+	Blob.NumTorqueSamples = NumPoints;
+	int32 SampleIdx = NumSamples - 1;
+	for (int32 P = NumPoints - 1; P >= 0; --P)
+	{
+		Blob.TorqueX[P] = X[SampleIdx];
+		Blob.TorqueY[P] = Y[SampleIdx];
+		SampleIdx = Previous[P * NumSamples + SampleIdx];
+	}
+
+	return Cost[(NumPoints - 1) * NumSamples + NumSamples - 1];
+}
+
+void FVehicleNWDrivetrainBlob::Compile(const FVehicleEngineNWData& Engine, const FVehicleTransmissionNWData& Transmission, const FVehicleDifferentialNWData& Differential)
+{
+	SCOPE_CYCLE_COUNTER(STAT_VehicleNW_CompileDrivetrain);
+
+	// Padding and unused entries must not change the hash.
+	FMemory::Memzero(this, sizeof(*this));
+
+	CompileEngine(Engine);
+	CompileTransmission(Transmission);
+	CompileDifferential(Differential);
+}
+
+void FVehicleNWDrivetrainBlob::CompileEngine(const FVehicleEngineNWData& Engine)
+{
+	MOI = M2ToCm2(Engine.MOI);
+	MaxOmega = RPMToOmega(Engine.MaxRPM);
+	DampingRateFullThrottle = M2ToCm2(Engine.DampingRateFullThrottle);
+	DampingRateZeroThrottleClutchEngaged = M2ToCm2(Engine.DampingRateZeroThrottleClutchEngaged);
+	DampingRateZeroThrottleClutchDisengaged = M2ToCm2(Engine.DampingRateZeroThrottleClutchDisengaged);
+
+	const float PeakTorqueNm = Engine.FindPeakTorque();
+	PeakTorque = M2ToCm2(PeakTorqueNm); // Convert Nm to (kg cm^2/s^2).
+
+	NumTorqueSamples = 0;
+	TorqueResampleError = 0.f;
+	FMemory::Memzero(TorqueX);
+	FMemory::Memzero(TorqueY);
+
+	const FRichCurve* TorqueCurve = Engine.TorqueCurve.GetRichCurveConst();
+	const TArray<FRichCurveKey>& TorqueKeys = TorqueCurve->GetConstRefOfKeys();
+	if (TorqueKeys.Num() == 0 || PeakTorqueNm <= 0.f || Engine.MaxRPM <= 0.f)
+	{
+		return;
+	}
+
+	// Normalize RPM and torque to the 0-1 range.
+	const float InvMaxRPM = 1.f / Engine.MaxRPM;
+	const float InvPeakTorque = 1.f / PeakTorqueNm;
+
+	if (TorqueKeys.Num() <= MaxTorqueSamples)
+	{
+		NumTorqueSamples = TorqueKeys.Num();
+		for (int32 KeyIdx = 0; KeyIdx < TorqueKeys.Num(); KeyIdx++)
+		{
+			TorqueX[KeyIdx] = FMath::Clamp(TorqueKeys[KeyIdx].Time * InvMaxRPM, 0.f, 1.f);
+			TorqueY[KeyIdx] = TorqueKeys[KeyIdx].Value * InvPeakTorque;
+		}
+		return;
+	}
+
+	// Sample the curve densely, keys included as long as there are not too many of them.
+	const float MinTime = TorqueKeys[0].Time;
+	const float MaxTime = TorqueKeys.Last().Time;
+	TArray<float> SampleTimes;
+	SampleTimes.Reserve(NumTorqueCurveSamples + TorqueKeys.Num());
+	for (int32 SampleIdx = 0; SampleIdx < NumTorqueCurveSamples; SampleIdx++)
+	{
+		SampleTimes.Add(FMath::Lerp(MinTime, MaxTime, (float)SampleIdx / (NumTorqueCurveSamples - 1)));
+	}
+	if (TorqueKeys.Num() < NumTorqueCurveSamples)
+	{
+		for (const FRichCurveKey& Key : TorqueKeys)
+		{
+			SampleTimes.Add(Key.Time);
+		}
+		SampleTimes.Sort();
+	}
+
+	TArray<float> X;
+	TArray<float> Y;
+	X.Reserve(SampleTimes.Num());
+	Y.Reserve(SampleTimes.Num());
+	for (float Time : SampleTimes)
+	{
+		const float NormalizedRPM = FMath::Clamp(Time * InvMaxRPM, 0.f, 1.f);
+		if (X.Num() > 0 && NormalizedRPM - X.Last() <= KINDA_SMALL_NUMBER)
+		{
+			continue;
+		}
+		X.Add(NormalizedRPM);
+		Y.Add(TorqueCurve->Eval(Time) * InvPeakTorque);
+	}
+
+	TorqueResampleError = ResampleTorqueTable(X, Y, *this);
+}
+
+void FVehicleNWDrivetrainBlob::CompileTransmission(const FVehicleTransmissionNWData& Transmission)
+{
+	CompileClutch(Transmission);
+	CompileGears(Transmission);
+	CompileAutoBox(Transmission);
+}
+
+void FVehicleNWDrivetrainBlob::CompileClutch(const FVehicleTransmissionNWData& Transmission)
+{
+	ClutchStrength = M2ToCm2(Transmission.ClutchStrength);
+}
+
+void FVehicleNWDrivetrainBlob::CompileGears(const FVehicleTransmissionNWData& Transmission)
+{
+	FMemory::Memzero(GearRatios);
+
+	const int32 NumForwardGears = FMath::Min(Transmission.ForwardGears.Num(), MaxGearRatios - FirstGear);
+	NumGearRatios = NumForwardGears + FirstGear;
+	GearRatios[ReverseGear] = Transmission.ReverseGearRatio;
+	for (int32 GearIdx = 0; GearIdx < NumForwardGears; GearIdx++)
+	{
+		GearRatios[GearIdx + FirstGear] = Transmission.ForwardGears[GearIdx].Ratio;
+	}
+
+	FinalRatio = Transmission.FinalRatio;
+	GearSwitchTime = Transmission.GearSwitchTime;
+}
+
+void FVehicleNWDrivetrainBlob::CompileAutoBox(const FVehicleTransmissionNWData& Transmission)
+{
+	FMemory::Memzero(UpRatios);
+	FMemory::Memzero(DownRatios);
+
+	const int32 NumForwardGears = FMath::Min(Transmission.ForwardGears.Num(), MaxGearRatios - FirstGear);
+	for (int32 GearIdx = 0; GearIdx < NumForwardGears; GearIdx++)
+	{
+		const FVehicleGearNWData& GearData = Transmission.ForwardGears[GearIdx];
+		UpRatios[GearIdx] = GearData.UpRatio;
+		DownRatios[GearIdx] = GearData.DownRatio;
+	}
+	UpRatios[NeutralGear] = Transmission.NeutralGearUpRatio;
+
+	AutoBoxLatency = Transmission.GearAutoBoxLatency;
+}
+
+void FVehicleNWDrivetrainBlob::CompileDifferential(const FVehicleDifferentialNWData& Differential)
+{
+	DrivenWheelMask = 0;
+	for (const FDrivenWheelData& WheelData : Differential.DWheelData)
+	{
+		if (WheelData.DrivenWheelIndex >= 0 && WheelData.DrivenWheelIndex < MaxWheels)
+		{
+			const uint32 WheelBit = 1u << WheelData.DrivenWheelIndex;
+			DrivenWheelMask = WheelData.IsDrivenWheel ? (DrivenWheelMask | WheelBit) : (DrivenWheelMask & ~WheelBit);
+		}
+	}
+}
+
+#if WITH_PHYSX_VEHICLES
+void FVehicleNWDrivetrainBlob::GetEngineData(PxVehicleEngineData& PxSetup) const
+{
+	PxSetup.mMOI = MOI;
+	PxSetup.mMaxOmega = MaxOmega;
+	PxSetup.mDampingRateFullThrottle = DampingRateFullThrottle;
+	PxSetup.mDampingRateZeroThrottleClutchEngaged = DampingRateZeroThrottleClutchEngaged;
+	PxSetup.mDampingRateZeroThrottleClutchDisengaged = DampingRateZeroThrottleClutchDisengaged;
+	PxSetup.mPeakTorque = PeakTorque;
+
+	PxSetup.mTorqueCurve.clear();
+	for (int32 SampleIdx = 0; SampleIdx < NumTorqueSamples; SampleIdx++)
+	{
+		PxSetup.mTorqueCurve.addPair(TorqueX[SampleIdx], TorqueY[SampleIdx]);
+	}
+}
+
+void FVehicleNWDrivetrainBlob::GetClutchData(PxVehicleClutchData& PxSetup) const
+{
+	PxSetup.mStrength = ClutchStrength;
+}
+
+void FVehicleNWDrivetrainBlob::GetGearsData(PxVehicleGearsData& PxSetup) const
+{
+	PxSetup.mSwitchTime = GearSwitchTime;
+	PxSetup.mRatios[PxVehicleGearsData::eREVERSE] = GearRatios[PxVehicleGearsData::eREVERSE];
+	for (int32 GearIdx = PxVehicleGearsData::eFIRST; GearIdx < NumGearRatios; GearIdx++)
+	{
+		PxSetup.mRatios[GearIdx] = GearRatios[GearIdx];
+	}
+	PxSetup.mFinalRatio = FinalRatio;
+	PxSetup.mNbRatios = NumGearRatios;
+}
+
+void FVehicleNWDrivetrainBlob::GetAutoBoxData(PxVehicleAutoBoxData& PxSetup) const
+{
+	for (int32 GearIdx = 0; GearIdx < NumGearRatios - PxVehicleGearsData::eFIRST; GearIdx++)
+	{
+		PxSetup.mUpRatios[GearIdx] = UpRatios[GearIdx];
+		PxSetup.mDownRatios[GearIdx] = DownRatios[GearIdx];
+	}
+	PxSetup.mUpRatios[PxVehicleGearsData::eNEUTRAL] = UpRatios[PxVehicleGearsData::eNEUTRAL];
+	PxSetup.setLatency(AutoBoxLatency);
+}
+
+void FVehicleNWDrivetrainBlob::GetDifferentialData(PxVehicleDifferentialNWData& PxSetup) const
+{
+	for (uint32 WheelIdx = 0; WheelIdx < PX_MAX_NB_WHEELS; WheelIdx++)
+	{
+		PxSetup.setDrivenWheel(WheelIdx, (DrivenWheelMask & (1u << WheelIdx)) != 0);
+	}
+}
+
+void FVehicleNWDrivetrainBlob::Apply(PxVehicleDriveSimDataNW& DriveData) const
+{
+	PxVehicleDifferentialNWData DifferentialSetup;
+	GetDifferentialData(DifferentialSetup);
+	DriveData.setDiffData(DifferentialSetup);
+
+	PxVehicleEngineData EngineSetup;
+	GetEngineData(EngineSetup);
+	DriveData.setEngineData(EngineSetup);
+
+	PxVehicleClutchData ClutchSetup;
+	GetClutchData(ClutchSetup);
+	DriveData.setClutchData(ClutchSetup);
+
+	PxVehicleGearsData GearSetup;
+	GetGearsData(GearSetup);
+	DriveData.setGearsData(GearSetup);
+
+	PxVehicleAutoBoxData AutoBoxSetup;
+	GetAutoBoxData(AutoBoxSetup);
+	DriveData.setAutoBoxData(AutoBoxSetup);
+}
+#endif // WITH_PHYSX_VEHICLES
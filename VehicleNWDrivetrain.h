@@ -0,0 +1,98 @@
+// Copyright Unreal Engine Community.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+struct FVehicleEngineNWData;
+struct FVehicleTransmissionNWData;
+struct FVehicleDifferentialNWData;
+
+#if WITH_PHYSX_VEHICLES
+namespace physx
+{
+	class PxVehicleEngineData;
+	class PxVehicleGearsData;
+	class PxVehicleAutoBoxData;
+	class PxVehicleClutchData;
+	class PxVehicleDifferentialNWData;
+	class PxVehicleDriveSimDataNW;
+}
+#endif // WITH_PHYSX_VEHICLES
+
+/**
+ * Engine, transmission and differential setup of a UVehicleMovementComponentNW, converted to PhysX units once.
+ *
+ * Plain data: it is zeroed before being compiled so it can be hashed and compared as raw bytes. TorqueCurve is
+ * resampled into the PhysX table with the smallest possible error rather than truncated to its first keys.
+ */
+struct MYVEHICLEPROJECT_API FVehicleNWDrivetrainBlob
+{
+	// PxVehicleEngineData::eMAX_NB_ENGINE_TORQUE_CURVE_ENTRIES.
+	static const int32 MaxTorqueSamples = 8;
+
+	// PxVehicleGearsData::eGEARSRATIO_COUNT, and the eREVERSE, eNEUTRAL and eFIRST indices.
+	static const int32 MaxGearRatios = 32;
+	static const int32 ReverseGear = 0;
+	static const int32 NeutralGear = 1;
+	static const int32 FirstGear = 2;
+
+	// PX_MAX_NB_WHEELS.
+	static const int32 MaxWheels = 20;
+
+	// Engine (kg cm^2, rad/s).
+	float MOI;
+	float MaxOmega;
+	float DampingRateFullThrottle;
+	float DampingRateZeroThrottleClutchEngaged;
+	float DampingRateZeroThrottleClutchDisengaged;
+
+	// Peak of TorqueCurve (kg cm^2/s^2).
+	float PeakTorque;
+
+	// Torque table, RPM normalized by MaxRPM and torque by PeakTorque.
+	int32 NumTorqueSamples;
+	float TorqueX[MaxTorqueSamples];
+	float TorqueY[MaxTorqueSamples];
+
+	// Largest difference between the torque table and TorqueCurve, relative to PeakTorque.
+	float TorqueResampleError;
+
+	// Clutch (kg cm^2/s).
+	float ClutchStrength;
+
+	// Gears, indexed like PxVehicleGearsData (reverse, neutral, first...).
+	int32 NumGearRatios;
+	float GearRatios[MaxGearRatios];
+	float FinalRatio;
+	float GearSwitchTime;
+
+	// Automatic gearbox.
+	float UpRatios[MaxGearRatios];
+	float DownRatios[MaxGearRatios];
+	float AutoBoxLatency;
+
+	// Differential, one bit per driven wheel.
+	uint32 DrivenWheelMask;
+
+	void Compile(const FVehicleEngineNWData& Engine, const FVehicleTransmissionNWData& Transmission, const FVehicleDifferentialNWData& Differential);
+	void CompileEngine(const FVehicleEngineNWData& Engine);
+	void CompileTransmission(const FVehicleTransmissionNWData& Transmission);
+
+	// Parts of CompileTransmission, for retuning a single PhysX section.
+	void CompileClutch(const FVehicleTransmissionNWData& Transmission);
+	void CompileGears(const FVehicleTransmissionNWData& Transmission);
+	void CompileAutoBox(const FVehicleTransmissionNWData& Transmission);
+	void CompileDifferential(const FVehicleDifferentialNWData& Differential);
+
+#if WITH_PHYSX_VEHICLES
+	void GetEngineData(physx::PxVehicleEngineData& PxSetup) const;
+	void GetClutchData(physx::PxVehicleClutchData& PxSetup) const;
+	void GetGearsData(physx::PxVehicleGearsData& PxSetup) const;
+	void GetAutoBoxData(physx::PxVehicleAutoBoxData& PxSetup) const;
+	void GetDifferentialData(physx::PxVehicleDifferentialNWData& PxSetup) const;
+
+	// Set every section of the drive sim data.
+	void Apply(physx::PxVehicleDriveSimDataNW& DriveData) const;
+#endif // WITH_PHYSX_VEHICLES
+};
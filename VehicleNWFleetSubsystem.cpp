@@ -0,0 +1,304 @@
+// Copyright Unreal Engine Community.
+
+#include "VehicleNWFleetSubsystem.h"
+#include "VehicleMovementComponentNW.h"
+#include "VehicleNWStats.h"
+#include "PhysXIncludes.h"
+#include "PhysXPublic.h"
+#include "Physics/PhysicsInterfaceCore.h"
+#include "Engine/World.h"
+#include "Async/ParallelFor.h"
+#include "PhysXVehicleManager.h"
+#include "VehicleNWTelemetryRecorder.h"
+
+DECLARE_CYCLE_STAT(TEXT("Fleet Flush Inputs"), STAT_VehicleNW_FleetFlush, STATGROUP_VehicleNW);
+DECLARE_CYCLE_STAT(TEXT("Fleet Chunk"), STAT_VehicleNW_FleetChunk, STATGROUP_VehicleNW);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Fleet Chunks"), STAT_VehicleNW_FleetChunks, STATGROUP_VehicleNW);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Fleet Vehicles"), STAT_VehicleNW_FleetVehicles, STATGROUP_VehicleNW);
+DECLARE_CYCLE_STAT(TEXT("Fleet Gather Telemetry"), STAT_VehicleNW_FleetTelemetry, STATGROUP_VehicleNW);
+
+static TAutoConsoleVariable<int32> CVarVehicleNWFleetUpdate(
+	TEXT("p.VehicleNW.FleetUpdate"),
+	1,
+	TEXT("Whether NW vehicles apply their inputs as one fleet per physics step (1) or each under its own lock (0).\n")
+	TEXT("Only affects vehicles created after the change."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarVehicleNWParallelUpdate(
+	TEXT("p.VehicleNW.ParallelUpdate"),
+	0,
+	TEXT("Whether the fleet applies vehicle inputs on task graph workers.\n")
+	TEXT("Vehicles are independent so results are identical to the serial path."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarVehicleNWParallelChunkSize(
+	TEXT("p.VehicleNW.ParallelChunkSize"),
+	64,
+	TEXT("Number of vehicles processed by one worker task when p.VehicleNW.ParallelUpdate is enabled."),
+	ECVF_Default);
+
+bool UVehicleNWFleetSubsystem::IsFleetUpdateEnabled()
+{
+	return CVarVehicleNWFleetUpdate.GetValueOnGameThread() != 0;
+}
+
+void UVehicleNWFleetSubsystem::Deinitialize()
+{
+	for (UVehicleMovementComponentNW* Vehicle : Vehicles)
+	{
+		if (Vehicle)
+		{
+			Vehicle->Fleet = nullptr;
+			Vehicle->FleetIndex = INDEX_NONE;
+		}
+	}
+
+	Vehicles.Reset();
+#if WITH_PHYSX_VEHICLES
+	Drives.Reset();
+#endif // WITH_PHYSX_VEHICLES
+	PendingStep.Empty();
+
+	Super::Deinitialize();
+}
+
+void UVehicleNWFleetSubsystem::RegisterVehicle(UVehicleMovementComponentNW* Vehicle)
+{
+#if WITH_PHYSX_VEHICLES
+	check(Vehicle && Vehicle->PVehicleDrive);
+	check(Vehicle->FleetIndex == INDEX_NONE);
+
+	Vehicle->Fleet = this;
+	Vehicle->FleetIndex = Vehicles.Add(Vehicle);
+	Drives.Add((physx::PxVehicleDriveNW*)Vehicle->PVehicleDrive);
+
+	// Not flushed yet: if it is the first vehicle to tick in the next step, that tick flushes the fleet. Registering it
+	// as pending would skip the flush of the first step of a new fleet, and drop the inputs of that step.
+	PendingStep.Add(false);
+#endif // WITH_PHYSX_VEHICLES
+}
+
+void UVehicleNWFleetSubsystem::UnregisterVehicle(UVehicleMovementComponentNW* Vehicle)
+{
+#if WITH_PHYSX_VEHICLES
+	check(Vehicle && Vehicle->Fleet == this);
+
+	const int32 Index = Vehicle->FleetIndex;
+	check(Vehicles[Index] == Vehicle);
+
+	Vehicles.RemoveAtSwap(Index, 1, false);
+	Drives.RemoveAtSwap(Index, 1, false);
+	PendingStep.RemoveAtSwap(Index);
+
+	if (Vehicles.IsValidIndex(Index))
+	{
+		Vehicles[Index]->FleetIndex = Index;
+	}
+
+	Vehicle->Fleet = nullptr;
+	Vehicle->FleetIndex = INDEX_NONE;
+#endif // WITH_PHYSX_VEHICLES
+}
+
+void UVehicleNWFleetSubsystem::StepVehicle(UVehicleMovementComponentNW* Vehicle, float DeltaTime)
+{
+	const int32 Index = Vehicle->FleetIndex;
+	check(Vehicles.IsValidIndex(Index));
+
+	// Inputs of this vehicle were already consumed: a new physics step has started.
+	if (!PendingStep[Index])
+	{
+		FlushInputs(DeltaTime);
+	}
+
+	PendingStep[Index] = false;
+}
+
+void UVehicleNWFleetSubsystem::FlushInputs(float DeltaTime)
+{
+#if WITH_PHYSX_VEHICLES
+	SCOPE_CYCLE_COUNTER(STAT_VehicleNW_FleetFlush);
+	CSV_SCOPED_TIMING_STAT(VehicleNW, FleetFlush);
+	INC_DWORD_STAT_BY(STAT_VehicleNW_FleetVehicles, Vehicles.Num());
+
+	// Recompile any out of date steering tables before taking the lock. Published, recorded or replayed inputs are
+	// settled here too, the first vehicle to tick flushes the others before their own UpdateSimulation.
+	WakingVehicles.Reset();
+	for (int32 VehicleIdx = 0; VehicleIdx < Vehicles.Num(); VehicleIdx++)
+	{
+		UVehicleMovementComponentNW* Vehicle = Vehicles[VehicleIdx];
+		Vehicle->ConsumeInputs();
+		if (Vehicle->HasWakingInput())
+		{
+			WakingVehicles.Add(VehicleIdx);
+		}
+		Vehicle->UpdateInputRecording(DeltaTime);
+		Vehicle->CompileInputSmoothingCache();
+	}
+
+	FPhysScene* PhysScene = GetWorld()->GetPhysicsScene();
+
+	// Vehicles whose inputs changed while asleep are woken under one write lock, before their inputs are applied.
+	if (WakingVehicles.Num() > 0)
+	{
+		FPhysicsCommand::ExecuteWrite(PhysScene, [&]()
+		{
+			for (int32 VehicleIdx : WakingVehicles)
+			{
+				Vehicles[VehicleIdx]->WakeVehicle_AssumesLocked(*Drives[VehicleIdx]);
+			}
+		});
+	}
+
+	const int32 ChunkSize = FMath::Max(1, CVarVehicleNWParallelChunkSize.GetValueOnGameThread());
+	const int32 NumChunks = FMath::DivideAndRoundUp(Drives.Num(), ChunkSize);
+	if (CVarVehicleNWParallelUpdate.GetValueOnGameThread() != 0 && NumChunks > 1)
+	{
+		INC_DWORD_STAT_BY(STAT_VehicleNW_FleetChunks, NumChunks);
+
+		// Smoothing only writes to the drive's own dynamic data and reads the actor velocity,
+		// so every chunk can run under a shared read lock. Vehicles never read each other, which
+		// keeps the result identical to the serial path whatever the chunk size.
+		ParallelFor(NumChunks, [&](int32 ChunkIdx)
+		{
+			SCOPE_CYCLE_COUNTER(STAT_VehicleNW_FleetChunk);
+
+			const int32 FirstVehicle = ChunkIdx * ChunkSize;
+			const int32 LastVehicle = FMath::Min(FirstVehicle + ChunkSize, Drives.Num());
+
+			FVehicleNWLockTimer LockTimer;
+			FPhysicsCommand::ExecuteRead(PhysScene, [&]()
+			{
+				LockTimer.Acquired();
+				for (int32 VehicleIdx = FirstVehicle; VehicleIdx < LastVehicle; VehicleIdx++)
+				{
+					Vehicles[VehicleIdx]->ApplyInputs_AssumesLocked(*Drives[VehicleIdx], DeltaTime);
+				}
+			});
+		});
+	}
+	else
+	{
+		FVehicleNWLockTimer LockTimer;
+		FPhysicsCommand::ExecuteRead(PhysScene, [&]()
+		{
+			LockTimer.Acquired();
+			for (int32 VehicleIdx = 0; VehicleIdx < Drives.Num(); VehicleIdx++)
+			{
+				Vehicles[VehicleIdx]->ApplyInputs_AssumesLocked(*Drives[VehicleIdx], DeltaTime);
+			}
+		});
+	}
+
+	// Auto substep changes go to the wheels sim data, under the write lock, and are rare.
+	bool bSubstepCountsDirty = false;
+	for (UVehicleMovementComponentNW* Vehicle : Vehicles)
+	{
+		bSubstepCountsDirty |= Vehicle->bSubstepCountDirty;
+	}
+	if (bSubstepCountsDirty)
+	{
+		FPhysicsCommand::ExecuteWrite(PhysScene, [&]()
+		{
+			for (int32 VehicleIdx = 0; VehicleIdx < Drives.Num(); VehicleIdx++)
+			{
+				Vehicles[VehicleIdx]->ApplyPendingSubstepCount_AssumesLocked(*Drives[VehicleIdx]);
+			}
+		});
+	}
+
+	// Sleep, surface and display changes are left to each vehicle's TickComponent, outside of this loop and the
+	// vehicle manager's.
+
+	// Telemetry is sampled here rather than per vehicle, under one lock, into the ring of this world.
+	FVehicleNWTelemetryRecorder::FScopedAccess Telemetry;
+	if (FVehicleNWTelemetryRecorder::FProducer* TelemetryProducer = Telemetry.Get() ? Telemetry.Get()->GetProducer(GetWorld()) : nullptr)
+	{
+		FPhysicsCommand::ExecuteRead(PhysScene, [&]()
+		{
+			for (int32 VehicleIdx = 0; VehicleIdx < Drives.Num(); VehicleIdx++)
+			{
+				Vehicles[VehicleIdx]->RecordTelemetry_AssumesLocked(*TelemetryProducer, *Drives[VehicleIdx], DeltaTime);
+			}
+		});
+	}
+
+	PendingStep.Init(true, Vehicles.Num());
+#endif // WITH_PHYSX_VEHICLES
+}
+
+void UVehicleNWFleetSubsystem::GatherTelemetry(FVehicleNWFleetTelemetry& Out) const
+{
+	SCOPE_CYCLE_COUNTER(STAT_VehicleNW_FleetTelemetry);
+
+#if WITH_PHYSX_VEHICLES
+	const int32 NumVehicles = Vehicles.Num();
+	Out.Vehicles.SetNumUninitialized(NumVehicles, false);
+	Out.EngineRPM.SetNumUninitialized(NumVehicles, false);
+	Out.Gear.SetNumUninitialized(NumVehicles, false);
+	Out.ForwardSpeed.SetNumUninitialized(NumVehicles, false);
+	Out.FirstWheel.SetNumUninitialized(NumVehicles, false);
+	Out.NumWheels.SetNumUninitialized(NumVehicles, false);
+
+	int32 TotalWheels = 0;
+	for (int32 VehicleIdx = 0; VehicleIdx < NumVehicles; VehicleIdx++)
+	{
+		Out.Vehicles[VehicleIdx] = Vehicles[VehicleIdx];
+		Out.FirstWheel[VehicleIdx] = TotalWheels;
+		Out.NumWheels[VehicleIdx] = Drives[VehicleIdx]->mWheelsSimData.getNbWheels();
+		TotalWheels += Out.NumWheels[VehicleIdx];
+	}
+
+	Out.LongitudinalSlip.SetNumUninitialized(TotalWheels, false);
+	Out.LateralSlip.SetNumUninitialized(TotalWheels, false);
+	Out.SuspensionOffset.SetNumUninitialized(TotalWheels, false);
+	Out.TireLoad.SetNumUninitialized(TotalWheels, false);
+	Out.TireFriction.SetNumUninitialized(TotalWheels, false);
+	Out.bInAir.SetNumUninitialized(TotalWheels, false);
+
+	FPhysScene* PhysScene = GetWorld()->GetPhysicsScene();
+
+	FVehicleNWLockTimer LockTimer;
+	FPhysicsCommand::ExecuteRead(PhysScene, [&]()
+	{
+		LockTimer.Acquired();
+		for (int32 VehicleIdx = 0; VehicleIdx < NumVehicles; VehicleIdx++)
+		{
+			const PxVehicleDriveNW& Drive = *Drives[VehicleIdx];
+			Out.EngineRPM[VehicleIdx] = OmegaToRPM(Drive.mDriveDynData.getEngineRotationSpeed());
+			// PhysX has reverse as gear 0.
+			Out.Gear[VehicleIdx] = (int32)Drive.mDriveDynData.getCurrentGear() - 1;
+			Out.ForwardSpeed[VehicleIdx] = Drive.computeForwardSpeed();
+
+			const int32 FirstWheel = Out.FirstWheel[VehicleIdx];
+			const int32 NumWheels = Out.NumWheels[VehicleIdx];
+			const PxWheelQueryResult* WheelsStates = Vehicles[VehicleIdx]->GetWheelsStates_AssumesLocked();
+			if (WheelsStates == nullptr)
+			{
+				// Not updated by the manager yet.
+				for (int32 WheelIdx = FirstWheel; WheelIdx < FirstWheel + NumWheels; WheelIdx++)
+				{
+					Out.LongitudinalSlip[WheelIdx] = 0.f;
+					Out.LateralSlip[WheelIdx] = 0.f;
+					Out.SuspensionOffset[WheelIdx] = 0.f;
+					Out.TireLoad[WheelIdx] = 0.f;
+					Out.TireFriction[WheelIdx] = 0.f;
+					Out.bInAir[WheelIdx] = 1;
+				}
+				continue;
+			}
+
+			for (int32 WheelIdx = 0; WheelIdx < NumWheels; WheelIdx++)
+			{
+				const PxWheelQueryResult& WheelState = WheelsStates[WheelIdx];
+				Out.LongitudinalSlip[FirstWheel + WheelIdx] = WheelState.longitudinalSlip;
+				Out.LateralSlip[FirstWheel + WheelIdx] = WheelState.lateralSlip;
+				Out.SuspensionOffset[FirstWheel + WheelIdx] = WheelState.suspJounce;
+				Out.TireLoad[FirstWheel + WheelIdx] = WheelState.suspSpringForce;
+				Out.TireFriction[FirstWheel + WheelIdx] = WheelState.tireFriction;
+				Out.bInAir[FirstWheel + WheelIdx] = WheelState.isInAir ? 1 : 0;
+			}
+		}
+	});
+#endif // WITH_PHYSX_VEHICLES
+}
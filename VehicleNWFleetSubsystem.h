@@ -0,0 +1,107 @@
+// Copyright Unreal Engine Community.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "VehicleNWFleetSubsystem.generated.h"
+
+class UVehicleMovementComponentNW;
+
+#if WITH_PHYSX_VEHICLES
+namespace physx
+{
+	class PxVehicleDriveNW;
+}
+#endif // WITH_PHYSX_VEHICLES
+
+/**
+ * State of every fleet vehicle as of the last physics update, one array per value. Vehicle arrays are in fleet order,
+ * the wheels of vehicle i are at [FirstWheel[i], FirstWheel[i] + NumWheels[i]) in the wheel arrays.
+ *
+ * Keep one around and pass it to every UVehicleNWFleetSubsystem::GatherTelemetry: arrays are resized, never shrunk.
+ */
+struct FVehicleNWFleetTelemetry
+{
+	// Per vehicle. Pointers are only valid until the fleet changes.
+	TArray<UVehicleMovementComponentNW*> Vehicles;
+	TArray<float> EngineRPM;
+	// -1 reverse, 0 neutral, 1+ forward, like UWheeledVehicleMovementComponent::GetCurrentGear.
+	TArray<int32> Gear;
+	// cm/s along the chassis forward axis.
+	TArray<float> ForwardSpeed;
+	TArray<int32> FirstWheel;
+	TArray<int32> NumWheels;
+
+	// Per wheel.
+	TArray<float> LongitudinalSlip;
+	TArray<float> LateralSlip;
+	// Suspension compression from the rest position (cm), positive when compressed.
+	TArray<float> SuspensionOffset;
+	// Force of the suspension spring, which is what loads the tire.
+	TArray<float> TireLoad;
+	TArray<float> TireFriction;
+	TArray<uint8> bInAir;
+};
+
+/**
+ * Drives every UVehicleMovementComponentNW of a world as one fleet.
+ *
+ * Suspension queries and PxVehicleUpdates are already issued once per scene by FPhysXVehicleManager.
+ * The per-vehicle part of the step (input smoothing) is batched here: the first registered vehicle
+ * to be ticked in a physics step applies the inputs of the whole fleet under a single scene read lock (one per
+ * chunk with p.VehicleNW.ParallelUpdate), walking a contiguous array of PxVehicleDriveNW. Vehicles woken by an input
+ * change are woken before that under one write lock, and only the auto substep counts that changed are written to the
+ * wheels sim data afterwards, under another.
+ */
+UCLASS()
+class MYVEHICLEPROJECT_API UVehicleNWFleetSubsystem : public UWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+
+	// Begin USubsystem interface
+	virtual void Deinitialize() override;
+	// End USubsystem interface
+
+	/** Whether vehicles should register with the fleet (p.VehicleNW.FleetUpdate). */
+	static bool IsFleetUpdateEnabled();
+
+	/** Add a vehicle whose PhysX drive has been created. */
+	void RegisterVehicle(UVehicleMovementComponentNW* Vehicle);
+
+	/** Remove a vehicle before its PhysX drive is released. */
+	void UnregisterVehicle(UVehicleMovementComponentNW* Vehicle);
+
+	/** Called from UpdateSimulation of every registered vehicle. Flushes the fleet once per physics step. */
+	void StepVehicle(UVehicleMovementComponentNW* Vehicle, float DeltaTime);
+
+	int32 GetNumVehicles() const { return Vehicles.Num(); }
+
+	/**
+	 * Fill Out with the drive and wheel state of every registered vehicle in one pass, under a scene read lock.
+	 * Values come straight from the PhysX drives and the wheel query results of the last vehicle update.
+	 */
+	void GatherTelemetry(FVehicleNWFleetTelemetry& Out) const;
+
+private:
+
+	/** Apply the inputs of every registered vehicle under scene read locks, then the changed substep counts. */
+	void FlushInputs(float DeltaTime);
+
+	/** Registered vehicles, FleetIndex order. */
+	UPROPERTY(Transient)
+	TArray<UVehicleMovementComponentNW*> Vehicles;
+
+#if WITH_PHYSX_VEHICLES
+	/** PhysX drives of the registered vehicles, same order as Vehicles. */
+	TArray<physx::PxVehicleDriveNW*> Drives;
+#endif // WITH_PHYSX_VEHICLES
+
+	/** Set for every vehicle when the fleet is flushed, cleared when the vehicle ticks. A tick on a cleared vehicle starts a new step. */
+	TBitArray<> PendingStep;
+
+	/** Scratch for FlushInputs: vehicles to wake before their inputs are applied. */
+	TArray<int32> WakingVehicles;
+};
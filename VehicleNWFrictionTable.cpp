@@ -0,0 +1,103 @@
+// Copyright Unreal Engine Community.
+
+#include "VehicleNWFrictionTable.h"
+#include "PhysXIncludes.h"
+#include "PhysXPublic.h"
+#include "PhysicalMaterials/PhysicalMaterial.h"
+#include "TireConfig.h"
+#include "Misc/CoreDelegates.h"
+#include "VehicleNWStats.h"
+
+DECLARE_CYCLE_STAT(TEXT("Build Friction Table"), STAT_VehicleNW_BuildFrictionTable, STATGROUP_VehicleNW);
+
+#if WITH_PHYSX_VEHICLES
+
+FVehicleNWFrictionTable& FVehicleNWFrictionTable::Get()
+{
+	static FVehicleNWFrictionTable Table;
+	return Table;
+}
+
+FVehicleNWFrictionTable::FVehicleNWFrictionTable()
+	: FrictionPairs(nullptr)
+	, NumMaterials(0)
+	, NumTireConfigs(0)
+	, bDirty(true)
+{
+	// PhysX is gone by the time statics are destroyed.
+	FCoreDelegates::OnPreExit.AddRaw(this, &FVehicleNWFrictionTable::Empty);
+}
+
+FVehicleNWFrictionTable::~FVehicleNWFrictionTable()
+{
+	check(FrictionPairs == nullptr);
+}
+
+const PxVehicleDrivableSurfaceToTireFrictionPairs* FVehicleNWFrictionTable::GetFrictionPairs()
+{
+	if (bDirty || FrictionPairs == nullptr || NumMaterials != GPhysXSDK->getNbMaterials() || NumTireConfigs != UTireConfig::AllTireConfigs.Num())
+	{
+		Build();
+	}
+	return FrictionPairs;
+}
+
+UPhysicalMaterial* FVehicleNWFrictionTable::GetSurfaceMaterial(uint32 SurfaceType)
+{
+	GetFrictionPairs();
+	return SurfaceMaterials.IsValidIndex(SurfaceType) ? SurfaceMaterials[SurfaceType].Get() : nullptr;
+}
+
+void FVehicleNWFrictionTable::Empty()
+{
+	if (FrictionPairs)
+	{
+		FrictionPairs->release();
+		FrictionPairs = nullptr;
+	}
+	SurfaceMaterials.Empty();
+	bDirty = true;
+}
+
+void FVehicleNWFrictionTable::Build()
+{
+	SCOPE_CYCLE_COUNTER(STAT_VehicleNW_BuildFrictionTable);
+
+	Empty();
+
+	NumMaterials = FMath::Min<uint32>(GPhysXSDK->getNbMaterials(), PxVehicleDrivableSurfaceToTireFrictionPairs::eMAX_NB_SURFACE_TYPES);
+	NumTireConfigs = UTireConfig::AllTireConfigs.Num();
+
+	TArray<PxMaterial*> Materials;
+	Materials.AddZeroed(NumMaterials);
+	GPhysXSDK->getMaterials(Materials.GetData(), NumMaterials);
+
+	TArray<PxVehicleDrivableSurfaceType> SurfaceTypes;
+	SurfaceTypes.AddUninitialized(NumMaterials);
+	for (uint32 MaterialIdx = 0; MaterialIdx < NumMaterials; MaterialIdx++)
+	{
+		SurfaceTypes[MaterialIdx].mType = MaterialIdx;
+	}
+
+	// At least one tire type, for vehicles using the default tire config before it registered.
+	const uint32 NumTireTypes = FMath::Max(NumTireConfigs, 1);
+	FrictionPairs = PxVehicleDrivableSurfaceToTireFrictionPairs::allocate(NumTireTypes, NumMaterials);
+	FrictionPairs->setup(NumTireTypes, NumMaterials, (const PxMaterial**)Materials.GetData(), SurfaceTypes.GetData());
+
+	SurfaceMaterials.SetNum(NumMaterials);
+	for (uint32 MaterialIdx = 0; MaterialIdx < NumMaterials; MaterialIdx++)
+	{
+		UPhysicalMaterial* PhysMat = FPhysxUserData::Get<UPhysicalMaterial>(Materials[MaterialIdx]->userData);
+		SurfaceMaterials[MaterialIdx] = PhysMat;
+		for (uint32 TireIdx = 0; TireIdx < NumTireTypes; TireIdx++)
+		{
+			UTireConfig* TireConfig = UTireConfig::AllTireConfigs.IsValidIndex(TireIdx) ? UTireConfig::AllTireConfigs[TireIdx].Get() : nullptr;
+			const float Friction = (TireConfig && PhysMat) ? TireConfig->GetTireFriction(PhysMat) : 1.f;
+			FrictionPairs->setTypePairFriction(MaterialIdx, TireIdx, Friction);
+		}
+	}
+
+	bDirty = false;
+}
+
+#endif // WITH_PHYSX_VEHICLES
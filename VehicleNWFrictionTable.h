@@ -0,0 +1,61 @@
+// Copyright Unreal Engine Community.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+#if WITH_PHYSX_VEHICLES
+
+class UPhysicalMaterial;
+
+namespace physx
+{
+	class PxVehicleDrivableSurfaceToTireFrictionPairs;
+}
+
+/**
+ * Tire friction for every (PhysX material, UTireConfig) pair, laid out like the table FPhysXVehicleManager builds for
+ * the scene: the drivable surface type of a material is its index in the SDK material list and the tire type of a
+ * wheel is its UTireConfig id.
+ *
+ * Used to step vehicles outside of the vehicle manager (resimulation), and to name the surface types found in wheel
+ * query results. Rebuilt when materials or tire configs are added, or after MarkDirty. Game thread only.
+ */
+class MYVEHICLEPROJECT_API FVehicleNWFrictionTable
+{
+public:
+
+	static FVehicleNWFrictionTable& Get();
+
+	~FVehicleNWFrictionTable();
+
+	/** The friction pairs, rebuilt first if out of date. */
+	const physx::PxVehicleDrivableSurfaceToTireFrictionPairs* GetFrictionPairs();
+
+	/** Physical material of a drivable surface type, e.g. PxWheelQueryResult::tireSurfaceType. Null if unknown. */
+	UPhysicalMaterial* GetSurfaceMaterial(uint32 SurfaceType);
+
+	/** Force a rebuild, e.g. after a tire config friction changed. */
+	void MarkDirty() { bDirty = true; }
+
+	void Empty();
+
+private:
+
+	FVehicleNWFrictionTable();
+
+	void Build();
+
+	physx::PxVehicleDrivableSurfaceToTireFrictionPairs* FrictionPairs;
+
+	// Physical material of each surface type.
+	TArray<TWeakObjectPtr<UPhysicalMaterial>> SurfaceMaterials;
+
+	// Counts the table was built for.
+	uint32 NumMaterials;
+	int32 NumTireConfigs;
+
+	bool bDirty;
+};
+
+#endif // WITH_PHYSX_VEHICLES
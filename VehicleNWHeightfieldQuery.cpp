@@ -0,0 +1,402 @@
+// Copyright Unreal Engine Community.
+
+#include "VehicleNWHeightfieldQuery.h"
+#include "PhysXIncludes.h"
+#include "PhysXPublic.h"
+#include "PhysicsFiltering.h"
+#include "Physics/PhysicsInterfaceCore.h"
+#include "Engine/World.h"
+#include "UObject/UObjectIterator.h"
+#include "VehicleMovementComponentNW.h"
+#include "VehicleNWStats.h"
+
+DECLARE_CYCLE_STAT(TEXT("Heightfield Suspension"), STAT_VehicleNW_HeightfieldSuspension, STATGROUP_VehicleNW);
+
+#if WITH_PHYSX_VEHICLES
+
+// Sign changes looked for along each ray before refining, rays cross at most a couple of heightfield cells.
+static const int32 RaySegments = 4;
+static const int32 MaxRefineSteps = 12;
+// Height difference (cm) at which a crossing is taken as found.
+static const float HeightTolerance = 0.01f;
+
+/** Same rules as WheelRaycastPreFilter in VehicleNWSnapshot.cpp, given the shape instead of its filter data. */
+static bool IsSuspensionBlocker(const PxFilterData& SuspensionData, const PxShape& Shape)
+{
+	const PxFilterData HitData = Shape.getQueryFilterData();
+	if (SuspensionData.word0 == HitData.word0)
+	{
+		return false;
+	}
+
+	const PxU32 CommonFlags = (SuspensionData.word3 & 0xFFFFFF) & (HitData.word3 & 0xFFFFFF);
+	if (!(CommonFlags & (EPDF_SimpleCollision | EPDF_ComplexCollision)))
+	{
+		return false;
+	}
+
+	const ECollisionChannel SuspensionChannel = (ECollisionChannel)(SuspensionData.word3 >> 24);
+	return (ECC_TO_BITFIELD(SuspensionChannel) & HitData.word1) != 0;
+}
+
+/** Looks through the shapes in reach of the suspension rays for a single heightfield, stops at anything else. */
+class FHeightfieldOverlapFilter : public PxQueryFilterCallback
+{
+public:
+
+	const PxShape* HeightfieldShape = nullptr;
+	const PxRigidActor* HeightfieldActor = nullptr;
+	bool bFoundOther = false;
+
+	virtual PxQueryHitType::Enum preFilter(const PxFilterData& FilterData, const PxShape* Shape, const PxRigidActor* Actor, PxHitFlags& QueryFlags) override
+	{
+		if (!IsSuspensionBlocker(FilterData, *Shape))
+		{
+			return PxQueryHitType::eNONE;
+		}
+
+		if (Shape->getGeometryType() == PxGeometryType::eHEIGHTFIELD && (HeightfieldShape == nullptr || HeightfieldShape == Shape))
+		{
+			HeightfieldShape = Shape;
+			HeightfieldActor = Actor;
+			return PxQueryHitType::eNONE;
+		}
+
+		bFoundOther = true;
+		return PxQueryHitType::eBLOCK;
+	}
+
+	virtual PxQueryHitType::Enum postFilter(const PxFilterData& FilterData, const PxQueryHit& Hit) override
+	{
+		return PxQueryHitType::eBLOCK;
+	}
+};
+
+/** Suspension filtering for single scene raycasts. */
+class FSuspensionRaycastFilter : public PxQueryFilterCallback
+{
+public:
+
+	virtual PxQueryHitType::Enum preFilter(const PxFilterData& FilterData, const PxShape* Shape, const PxRigidActor* Actor, PxHitFlags& QueryFlags) override
+	{
+		return IsSuspensionBlocker(FilterData, *Shape) ? PxQueryHitType::eBLOCK : PxQueryHitType::eNONE;
+	}
+
+	virtual PxQueryHitType::Enum postFilter(const PxFilterData& FilterData, const PxQueryHit& Hit) override
+	{
+		return PxQueryHitType::eBLOCK;
+	}
+};
+
+FVehicleNWHeightfieldQuery::FVehicleNWHeightfieldQuery()
+	: Shape(nullptr)
+	, Actor(nullptr)
+	, HeightField(nullptr)
+	, Rotation(FQuat::Identity)
+	, Translation(FVector::ZeroVector)
+	, RowScale(1.f)
+	, ColumnScale(1.f)
+	, HeightScale(1.f)
+{
+}
+
+bool FVehicleNWHeightfieldQuery::GetSuspensionRays_AssumesLocked(const PxVehicleWheels& Vehicle, FRayArray& OutRays)
+{
+	const PxVehicleWheelsSimData& WheelsSimData = Vehicle.mWheelsSimData;
+	const PxRigidDynamic* PRigidDynamic = Vehicle.getRigidDynamicActor();
+	const PxTransform ChassisPose = PRigidDynamic->getGlobalPose().transform(PRigidDynamic->getCMassLocalPose());
+
+	OutRays.Reset();
+	for (PxU32 WheelIdx = 0; WheelIdx < WheelsSimData.getNbWheels(); ++WheelIdx)
+	{
+		// Disabled wheels shift the results PxVehicleSuspensionRaycasts writes, leave those vehicles to it.
+		if (WheelsSimData.getIsWheelDisabled(WheelIdx))
+		{
+			return false;
+		}
+
+		// As computed by PxVehicleSuspensionRaycasts.
+		const float Radius = WheelsSimData.getWheelData(WheelIdx).mRadius;
+		const PxVehicleSuspensionData& Suspension = WheelsSimData.getSuspensionData(WheelIdx);
+		const PxVec3 Direction = ChassisPose.rotate(WheelsSimData.getSuspTravelDirection(WheelIdx));
+		const PxVec3 Origin = ChassisPose.transform(WheelsSimData.getWheelCentreOffset(WheelIdx)) - Direction * (Radius + Suspension.mMaxCompression);
+
+		FVehicleNWSuspensionRay& Ray = OutRays.AddDefaulted_GetRef();
+		Ray.Origin = P2UVector(Origin);
+		Ray.Direction = P2UVector(Direction);
+		// The ray reaches a radius past the bottom of the wheel at full droop.
+		Ray.Length = 3.f * Radius + Suspension.mMaxCompression + Suspension.mMaxDroop;
+	}
+	return true;
+}
+
+bool FVehicleNWHeightfieldQuery::Bind_AssumesLocked(const PxVehicleWheels& Vehicle, const FRayArray& Rays)
+{
+	Shape = nullptr;
+	Actor = nullptr;
+	HeightField = nullptr;
+
+	const PxRigidDynamic* PRigidDynamic = Vehicle.getRigidDynamicActor();
+	PxScene* PScene = PRigidDynamic ? PRigidDynamic->getScene() : nullptr;
+	if (PScene == nullptr || Rays.Num() == 0)
+	{
+		return false;
+	}
+
+	FBox Bounds(ForceInit);
+	for (const FVehicleNWSuspensionRay& Ray : Rays)
+	{
+		Bounds += Ray.Origin;
+		Bounds += Ray.Origin + Ray.Direction * Ray.Length;
+	}
+	Bounds = Bounds.ExpandBy(1.f);
+
+	// Every wheel of a vehicle shares the suspension filter data.
+	FHeightfieldOverlapFilter Filter;
+	PxOverlapBuffer Overlap;
+	const PxQueryFilterData FilterData(Vehicle.mWheelsSimData.getSceneQueryFilterData(0), PxQueryFlag::eSTATIC | PxQueryFlag::eDYNAMIC | PxQueryFlag::ePREFILTER | PxQueryFlag::eANY_HIT);
+	PScene->overlap(PxBoxGeometry(U2PVector(Bounds.GetExtent())), PxTransform(U2PVector(Bounds.GetCenter())), Overlap, FilterData, &Filter);
+
+	if (Filter.bFoundOther || Filter.HeightfieldShape == nullptr)
+	{
+		return false;
+	}
+
+	PxHeightFieldGeometry Geometry;
+	Filter.HeightfieldShape->getHeightFieldGeometry(Geometry);
+	if (Geometry.heightField == nullptr || Geometry.heightScale <= 0.f || Geometry.rowScale <= 0.f || Geometry.columnScale <= 0.f)
+	{
+		return false;
+	}
+
+	Shape = const_cast<PxShape*>(Filter.HeightfieldShape);
+	Actor = const_cast<PxRigidActor*>(Filter.HeightfieldActor);
+	HeightField = Geometry.heightField;
+
+	const PxTransform Pose = PxShapeExt::getGlobalPose(*Shape, *Actor);
+	Rotation = P2UQuat(Pose.q);
+	Translation = P2UVector(Pose.p);
+	RowScale = Geometry.rowScale;
+	ColumnScale = Geometry.columnScale;
+	HeightScale = Geometry.heightScale;
+	return true;
+}
+
+bool FVehicleNWHeightfieldQuery::Raycast_AssumesLocked(const FRayArray& Rays, FHitArray& OutHits) const
+{
+	SCOPE_CYCLE_COUNTER(STAT_VehicleNW_HeightfieldSuspension);
+
+	check(HeightField);
+
+	const float MaxRow = float(HeightField->getNbRows() - 1);
+	const float MaxColumn = float(HeightField->getNbColumns() - 1);
+
+	OutHits.Reset();
+	for (const FVehicleNWSuspensionRay& Ray : Rays)
+	{
+		// Heightfield local space: Y up, rows along X, columns along Z.
+		const FVector LocalOrigin = Rotation.UnrotateVector(Ray.Origin - Translation);
+		const FVector LocalDirection = Rotation.UnrotateVector(Ray.Direction);
+
+		// Height of the ray above the surface at T, false outside of the samples.
+		auto HeightAbove = [&](float T, float& OutHeight)
+		{
+			const FVector Point = LocalOrigin + LocalDirection * T;
+			const float Row = Point.X / RowScale;
+			const float Column = Point.Z / ColumnScale;
+			if (!(Row >= 0.f && Row <= MaxRow && Column >= 0.f && Column <= MaxColumn))
+			{
+				return false;
+			}
+			OutHeight = Point.Y - HeightField->getHeight(Row, Column) * HeightScale;
+			return true;
+		};
+
+		float T0 = 0.f;
+		float H0;
+		if (!HeightAbove(T0, H0) || H0 < 0.f)
+		{
+			return false;
+		}
+
+		float T1 = T0;
+		float H1 = H0;
+		for (int32 Segment = 1; Segment <= RaySegments && H1 > 0.f; ++Segment)
+		{
+			T0 = T1;
+			H0 = H1;
+			T1 = Ray.Length * Segment / RaySegments;
+			if (!HeightAbove(T1, H1))
+			{
+				return false;
+			}
+		}
+
+		FVehicleNWGroundHit& Hit = OutHits.AddZeroed_GetRef();
+		if (H1 > 0.f)
+		{
+			// Ground is out of reach, the wheel hangs at full droop.
+			continue;
+		}
+
+		// Regula falsi between the last sample above and the first below the surface.
+		float T = T1;
+		for (int32 Step = 0; Step < MaxRefineSteps && H1 < 0.f; ++Step)
+		{
+			T = T0 + (T1 - T0) * H0 / (H0 - H1);
+			// Stays between two points inside the samples.
+			float H = 0.f;
+			HeightAbove(T, H);
+			if (FMath::Abs(H) < HeightTolerance)
+			{
+				break;
+			}
+			if (H > 0.f)
+			{
+				T0 = T;
+				H0 = H;
+			}
+			else
+			{
+				T1 = T;
+				H1 = H;
+			}
+		}
+
+		// Triangle under the crossing, split along the diagonal its tessellation flag picks.
+		const FVector LocalPoint = LocalOrigin + LocalDirection * T;
+		const float Row = LocalPoint.X / RowScale;
+		const float Column = LocalPoint.Z / ColumnScale;
+		const uint32 CellRow = FMath::Min((uint32)Row, HeightField->getNbRows() - 2);
+		const uint32 CellColumn = FMath::Min((uint32)Column, HeightField->getNbColumns() - 2);
+		const float FracRow = Row - CellRow;
+		const float FracColumn = Column - CellColumn;
+		const bool bSecondTriangle = HeightField->getSample(CellRow, CellColumn).tessFlag() ? FracColumn > FracRow : FracRow + FracColumn > 1.f;
+		const uint32 TriangleIndex = ((CellRow * HeightField->getNbColumns() + CellColumn) << 1) + (bSecondTriangle ? 1 : 0);
+
+		if (HeightField->getTriangleMaterialIndex(TriangleIndex) == PxHeightFieldMaterial::eHOLE)
+		{
+			return false;
+		}
+
+		// Normal of the triangle in sample units, back to the scaled heightfield.
+		const PxVec3 SampleNormal = HeightField->getTriangleNormal(TriangleIndex);
+		FVector Normal = Rotation.RotateVector(FVector(SampleNormal.x / RowScale, SampleNormal.y / HeightScale, SampleNormal.z / ColumnScale).GetSafeNormal());
+		if ((Normal | Ray.Direction) > 0.f)
+		{
+			Normal = -Normal;
+		}
+
+		Hit.Shape = Shape;
+		Hit.Actor = Actor;
+		Hit.Position = Ray.Origin + Ray.Direction * T;
+		Hit.Normal = Normal;
+		Hit.Distance = T;
+		Hit.FaceIndex = TriangleIndex;
+	}
+	return true;
+}
+
+bool FVehicleNWHeightfieldQuery::RunComparison(UWorld* World, float Tolerance)
+{
+	// Normals within this angle (degrees) agree.
+	static const float NormalTolerance = 1.f;
+
+	int32 NumVehicles = 0;
+	int32 NumFallbacks = 0;
+	int32 NumWheels = 0;
+	int32 NumMismatches = 0;
+	float MaxDistanceError = 0.f;
+	float MaxNormalError = 0.f;
+	double SampleTime = 0.0;
+	double RaycastTime = 0.0;
+
+	for (TObjectIterator<UVehicleMovementComponentNW> It; It; ++It)
+	{
+		UVehicleMovementComponentNW* Vehicle = *It;
+		if (Vehicle->GetWorld() != World || Vehicle->IsTemplate() || Vehicle->PVehicleDrive == nullptr || Vehicle->UpdatedPrimitive == nullptr)
+		{
+			continue;
+		}
+
+		const PxVehicleWheels& PVehicle = *Vehicle->PVehicleDrive;
+		FPhysicsCommand::ExecuteRead(Vehicle->UpdatedPrimitive->GetBodyInstance()->ActorHandle, [&](const FPhysicsActorHandle&)
+		{
+			FRayArray Rays;
+			if (!GetSuspensionRays_AssumesLocked(PVehicle, Rays))
+			{
+				return;
+			}
+			++NumVehicles;
+
+			const double SampleStart = FPlatformTime::Seconds();
+			FVehicleNWHeightfieldQuery Query;
+			FHitArray Hits;
+			const bool bAnswered = Query.Bind_AssumesLocked(PVehicle, Rays) && Query.Raycast_AssumesLocked(Rays, Hits);
+			SampleTime += FPlatformTime::Seconds() - SampleStart;
+
+			if (!bAnswered)
+			{
+				++NumFallbacks;
+				return;
+			}
+
+			PxScene* PScene = PVehicle.getRigidDynamicActor()->getScene();
+			FSuspensionRaycastFilter Filter;
+			for (int32 WheelIdx = 0; WheelIdx < Rays.Num(); ++WheelIdx)
+			{
+				const FVehicleNWSuspensionRay& Ray = Rays[WheelIdx];
+				const FVehicleNWGroundHit& Hit = Hits[WheelIdx];
+
+				const double RaycastStart = FPlatformTime::Seconds();
+				PxRaycastBuffer Raycast;
+				const PxQueryFilterData FilterData(PVehicle.mWheelsSimData.getSceneQueryFilterData(WheelIdx), PxQueryFlag::eSTATIC | PxQueryFlag::eDYNAMIC | PxQueryFlag::ePREFILTER);
+				PScene->raycast(U2PVector(Ray.Origin), U2PVector(Ray.Direction), Ray.Length, Raycast, PxHitFlag::ePOSITION | PxHitFlag::eNORMAL | PxHitFlag::eDISTANCE, FilterData, &Filter);
+				RaycastTime += FPlatformTime::Seconds() - RaycastStart;
+
+				++NumWheels;
+				if (Raycast.hasBlock != (Hit.Shape != nullptr))
+				{
+					++NumMismatches;
+					continue;
+				}
+				if (!Raycast.hasBlock)
+				{
+					continue;
+				}
+
+				const PxRaycastHit& Block = Raycast.block;
+				const float DistanceError = FMath::Abs(Block.distance - Hit.Distance);
+				const float NormalError = FMath::RadiansToDegrees(FMath::Acos(FMath::Clamp(P2UVector(Block.normal) | Hit.Normal, -1.f, 1.f)));
+				MaxDistanceError = FMath::Max(MaxDistanceError, DistanceError);
+				MaxNormalError = FMath::Max(MaxNormalError, NormalError);
+
+				// The tire friction comes from the material of the face hit.
+				if (Block.shape != Hit.Shape || Block.shape->getMaterialFromInternalFaceIndex(Block.faceIndex) != Hit.Shape->getMaterialFromInternalFaceIndex(Hit.FaceIndex))
+				{
+					++NumMismatches;
+				}
+			}
+		});
+	}
+
+	const bool bPassed = NumMismatches == 0 && MaxDistanceError <= Tolerance && MaxNormalError <= NormalTolerance;
+	const int32 NumSampled = FMath::Max(NumWheels, 1);
+	UE_LOG(LogVehicleNW, Display, TEXT("HeightfieldTest: %d vehicles, %d on scene queries, %d wheels compared, sampled %.1f us per vehicle, raycast %.2f us per wheel"),
+		NumVehicles, NumFallbacks, NumWheels, SampleTime * 1e6 / FMath::Max(NumVehicles, 1), RaycastTime * 1e6 / NumSampled);
+	UE_LOG(LogVehicleNW, Display, TEXT("HeightfieldTest: max distance error %.3f cm (tolerance %.3f), max normal error %.3f deg (tolerance %.1f), %d hit or material mismatches: %s"),
+		MaxDistanceError, Tolerance, MaxNormalError, NormalTolerance, NumMismatches, bPassed ? TEXT("passed") : TEXT("FAILED"));
+	return bPassed;
+}
+
+static FAutoConsoleCommandWithWorldAndArgs VehicleNWHeightfieldTestCommand(
+	TEXT("p.VehicleNW.HeightfieldTest"),
+	TEXT("Compare sampled heightfield suspension hits with scene raycasts for every NW vehicle of the world, and time both.\n")
+	TEXT("p.VehicleNW.HeightfieldTest [Tolerance=0.5]"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& Args, UWorld* World)
+	{
+		const float Tolerance = Args.Num() > 0 ? FCString::Atof(*Args[0]) : 0.5f;
+		FVehicleNWHeightfieldQuery::RunComparison(World, Tolerance);
+	}));
+
+#endif // WITH_PHYSX_VEHICLES
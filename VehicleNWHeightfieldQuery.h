@@ -0,0 +1,98 @@
+// Copyright Unreal Engine Community.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+#if WITH_PHYSX_VEHICLES
+
+class UWorld;
+
+namespace physx
+{
+	class PxHeightField;
+	class PxRigidActor;
+	class PxShape;
+	class PxVehicleWheels;
+}
+
+/**
+ * Suspension ray of one wheel, as PxVehicleSuspensionRaycasts casts it: from the top of the wheel at full compression
+ * down to a radius past the bottom of the wheel at full droop.
+ */
+struct FVehicleNWSuspensionRay
+{
+	FVector Origin;
+	FVector Direction;
+	float Length;
+};
+
+/** Where a suspension ray meets the heightfield. Shape is null if the ray ends above the ground. */
+struct FVehicleNWGroundHit
+{
+	physx::PxShape* Shape;
+	physx::PxRigidActor* Actor;
+	FVector Position;
+	FVector Normal;
+	float Distance;
+	// Heightfield triangle, the internal face index a raycast reports.
+	uint32 FaceIndex;
+};
+
+/**
+ * Answers the suspension rays of a vehicle standing on a landscape by sampling the heightfield instead of raycasting it.
+ *
+ * Bind looks for what the rays of the vehicle can reach with one overlap of their bounds. Only when that is a single
+ * heightfield does Raycast answer them, by stepping the height along each ray and reading the normal and material
+ * of the triangle found. Anything else in reach (meshes, dynamic objects, a second landscape component) leaves the
+ * query unbound and the caller goes through scene queries. Positions are in PhysX units.
+ */
+class MYVEHICLEPROJECT_API FVehicleNWHeightfieldQuery
+{
+public:
+
+	typedef TArray<FVehicleNWSuspensionRay, TInlineAllocator<20>> FRayArray;
+	typedef TArray<FVehicleNWGroundHit, TInlineAllocator<20>> FHitArray;
+
+	FVehicleNWHeightfieldQuery();
+
+	/** Rays of the enabled wheels of Vehicle, in wheel order. False if a wheel is disabled. Scene read lock must be held. */
+	static bool GetSuspensionRays_AssumesLocked(const physx::PxVehicleWheels& Vehicle, FRayArray& OutRays);
+
+	/**
+	 * Bind to the heightfield under Rays if it is the only shape they can hit, with the filtering of the suspension
+	 * raycasts of Vehicle. Scene read lock must be held.
+	 */
+	bool Bind_AssumesLocked(const physx::PxVehicleWheels& Vehicle, const FRayArray& Rays);
+
+	bool IsBound() const { return HeightField != nullptr; }
+
+	/**
+	 * Cast Rays against the bound heightfield. False if one of them cannot be answered from the samples: it leaves
+	 * the heightfield, starts under the surface or reaches a hole. Scene read lock must be held.
+	 */
+	bool Raycast_AssumesLocked(const FRayArray& Rays, FHitArray& OutHits) const;
+
+	/**
+	 * Compare Raycast with scene raycasts for every wheel of every NW vehicle of World and log the largest distance
+	 * and normal differences, the vehicles that had to fall back and the time taken by both.
+	 */
+	static bool RunComparison(UWorld* World, float Tolerance);
+
+private:
+
+	physx::PxShape* Shape;
+	physx::PxRigidActor* Actor;
+	physx::PxHeightField* HeightField;
+
+	// World pose of the heightfield shape.
+	FQuat Rotation;
+	FVector Translation;
+
+	// Heightfield geometry scales: sample spacing along rows and columns, height per sample unit.
+	float RowScale;
+	float ColumnScale;
+	float HeightScale;
+};
+
+#endif // WITH_PHYSX_VEHICLES
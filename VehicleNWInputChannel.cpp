@@ -0,0 +1,27 @@
+// Copyright Unreal Engine Community.
+
+#include "VehicleNWInputChannel.h"
+
+FVehicleNWInputChannel::FVehicleNWInputChannel()
+	: WriteIndex(0)
+	, ReadIndex(1)
+	, Spare(2)
+{
+	FMemory::Memzero(Frames);
+}
+
+void FVehicleNWInputChannel::Publish()
+{
+	WriteIndex = Spare.Exchange(WriteIndex | FreshFlag) & IndexMask;
+}
+
+bool FVehicleNWInputChannel::Consume()
+{
+	if ((Spare.Load(EMemoryOrder::Relaxed) & FreshFlag) == 0)
+	{
+		return false;
+	}
+
+	ReadIndex = Spare.Exchange(ReadIndex) & IndexMask;
+	return true;
+}
@@ -0,0 +1,45 @@
+// Copyright Unreal Engine Community.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Templates/Atomic.h"
+#include "VehicleNWSnapshot.h"
+
+/**
+ * Hands input frames from the game thread to the physics update without locking.
+ *
+ * Triple buffered: the writer fills its own frame and swaps it with the spare one, the reader swaps the spare frame
+ * with its own when a newer one was published. Neither side waits, the reader always gets the latest complete frame,
+ * frames published between two reads are skipped. One writer thread and one reader thread.
+ */
+class MYVEHICLEPROJECT_API FVehicleNWInputChannel
+{
+public:
+
+	FVehicleNWInputChannel();
+
+	/** Frame the writer fills before Publish. Writer thread. */
+	FVehicleNWInputFrame& GetWriteFrame() { return Frames[WriteIndex]; }
+
+	/** Make the write frame the latest one. Writer thread. */
+	void Publish();
+
+	/** Take the latest published frame. False if nothing was published since the last call. Reader thread. */
+	bool Consume();
+
+	/** Frame taken by the last successful Consume. Reader thread. */
+	const FVehicleNWInputFrame& GetReadFrame() const { return Frames[ReadIndex]; }
+
+private:
+
+	static const uint32 IndexMask = 3;
+	static const uint32 FreshFlag = 4;
+
+	FVehicleNWInputFrame Frames[3];
+	uint32 WriteIndex;
+	uint32 ReadIndex;
+
+	// Index of the spare frame, with FreshFlag set while it holds a frame the reader has not taken.
+	TAtomic<uint32> Spare;
+};
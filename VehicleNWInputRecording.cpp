@@ -0,0 +1,361 @@
+// Copyright Unreal Engine Community.
+
+#include "VehicleNWInputRecording.h"
+#include "VehicleMovementComponentNW.h"
+#include "VehicleNWStats.h"
+#include "Containers/Ticker.h"
+#include "Engine/World.h"
+#include "GameFramework/Actor.h"
+#include "HAL/FileManager.h"
+#include "HAL/PlatformTime.h"
+#include "Misc/App.h"
+#include "Misc/Paths.h"
+#include "Serialization/Archive.h"
+#include "UObject/UObjectIterator.h"
+
+static const uint32 RecordingMagic = 0x524E5756; // 'VWNR'
+static const uint32 RecordingVersion = 1;
+
+// Frame flags: which values follow, and the gear buttons.
+enum EVehicleNWFrameFlags : uint8
+{
+	FrameDeltaTime = 1 << 0,
+	FrameThrottle = 1 << 1,
+	FrameSteering = 1 << 2,
+	FrameBrake = 1 << 3,
+	FrameHandbrake = 1 << 4,
+	FrameGearUp = 1 << 5,
+	FrameGearDown = 1 << 6,
+};
+
+static void WriteFloat(TArray<uint8>& Stream, float Value)
+{
+	const int32 Offset = Stream.AddUninitialized(sizeof(float));
+	FMemory::Memcpy(&Stream[Offset], &Value, sizeof(float));
+}
+
+static void WriteUint32(TArray<uint8>& Stream, uint32 Value)
+{
+	const int32 Offset = Stream.AddUninitialized(sizeof(uint32));
+	FMemory::Memcpy(&Stream[Offset], &Value, sizeof(uint32));
+}
+
+// Compared bitwise: -0 and 0, or two NaNs, must replay as they were recorded.
+static bool HasChanged(float A, float B)
+{
+	return FMemory::Memcmp(&A, &B, sizeof(float)) != 0;
+}
+
+FVehicleNWInputRecording::FVehicleNWInputRecording()
+	: NumFrames(0)
+{
+	FMemory::Memzero(InitialState);
+	InitialState.Frame = INDEX_NONE;
+	FMemory::Memzero(LastFrame);
+}
+
+void FVehicleNWInputRecording::Reset(const FVehicleNWSnapshot& InInitialState)
+{
+	InitialState = InInitialState;
+	Stream.Reset();
+	NumFrames = 0;
+	FMemory::Memzero(LastFrame);
+}
+
+void FVehicleNWInputRecording::AddFrame(const FVehicleNWInputFrame& InputFrame, uint32 StateHash)
+{
+	uint8 Flags = 0;
+	Flags |= HasChanged(InputFrame.DeltaTime, LastFrame.DeltaTime) ? FrameDeltaTime : 0;
+	Flags |= HasChanged(InputFrame.Throttle, LastFrame.Throttle) ? FrameThrottle : 0;
+	Flags |= HasChanged(InputFrame.Steering, LastFrame.Steering) ? FrameSteering : 0;
+	Flags |= HasChanged(InputFrame.Brake, LastFrame.Brake) ? FrameBrake : 0;
+	Flags |= HasChanged(InputFrame.Handbrake, LastFrame.Handbrake) ? FrameHandbrake : 0;
+	Flags |= InputFrame.bGearUp ? FrameGearUp : 0;
+	Flags |= InputFrame.bGearDown ? FrameGearDown : 0;
+
+	Stream.Add(Flags);
+	if (Flags & FrameDeltaTime)
+	{
+		WriteFloat(Stream, InputFrame.DeltaTime);
+	}
+	if (Flags & FrameThrottle)
+	{
+		WriteFloat(Stream, InputFrame.Throttle);
+	}
+	if (Flags & FrameSteering)
+	{
+		WriteFloat(Stream, InputFrame.Steering);
+	}
+	if (Flags & FrameBrake)
+	{
+		WriteFloat(Stream, InputFrame.Brake);
+	}
+	if (Flags & FrameHandbrake)
+	{
+		WriteFloat(Stream, InputFrame.Handbrake);
+	}
+	WriteUint32(Stream, StateHash);
+
+	LastFrame = InputFrame;
+	NumFrames++;
+}
+
+bool FVehicleNWInputRecording::ReadFrame(int32& InOutOffset, FVehicleNWInputFrame& InOutFrame, uint32& OutStateHash) const
+{
+	if (InOutOffset < 0 || InOutOffset >= Stream.Num())
+	{
+		return false;
+	}
+
+	const uint8 Flags = Stream[InOutOffset];
+	const int32 NumValues = FMath::CountBits(Flags & (FrameDeltaTime | FrameThrottle | FrameSteering | FrameBrake | FrameHandbrake));
+	const int32 FrameSize = 1 + (NumValues + 1) * sizeof(uint32);
+	if (InOutOffset + FrameSize > Stream.Num())
+	{
+		return false;
+	}
+
+	const uint8* Data = &Stream[InOutOffset + 1];
+	auto ReadValue = [&Data](void* Value)
+	{
+		FMemory::Memcpy(Value, Data, sizeof(uint32));
+		Data += sizeof(uint32);
+	};
+
+	if (Flags & FrameDeltaTime)
+	{
+		ReadValue(&InOutFrame.DeltaTime);
+	}
+	if (Flags & FrameThrottle)
+	{
+		ReadValue(&InOutFrame.Throttle);
+	}
+	if (Flags & FrameSteering)
+	{
+		ReadValue(&InOutFrame.Steering);
+	}
+	if (Flags & FrameBrake)
+	{
+		ReadValue(&InOutFrame.Brake);
+	}
+	if (Flags & FrameHandbrake)
+	{
+		ReadValue(&InOutFrame.Handbrake);
+	}
+	InOutFrame.bGearUp = (Flags & FrameGearUp) ? 1 : 0;
+	InOutFrame.bGearDown = (Flags & FrameGearDown) ? 1 : 0;
+	ReadValue(&OutStateHash);
+
+	InOutOffset += FrameSize;
+	return true;
+}
+
+void FVehicleNWInputRecording::Serialize(FArchive& Ar)
+{
+	uint32 Magic = RecordingMagic;
+	uint32 Version = RecordingVersion;
+	uint32 SnapshotSize = sizeof(FVehicleNWSnapshot);
+	Ar << Magic;
+	Ar << Version;
+	Ar << SnapshotSize;
+	if (Ar.IsLoading() && (Magic != RecordingMagic || Version != RecordingVersion || SnapshotSize != sizeof(FVehicleNWSnapshot)))
+	{
+		Ar.SetError();
+		return;
+	}
+
+	// The snapshot is raw memory: recordings are only replayed on the platform they were made on.
+	Ar.Serialize(&InitialState, sizeof(FVehicleNWSnapshot));
+	Ar << NumFrames;
+	Ar << Stream;
+
+	if (Ar.IsLoading())
+	{
+		// Appending after a load is not supported, the encoder state is not stored.
+		FMemory::Memzero(LastFrame);
+	}
+}
+
+bool FVehicleNWInputRecording::SaveToFile(const FString& Filename) const
+{
+	TUniquePtr<FArchive> Ar(IFileManager::Get().CreateFileWriter(*Filename));
+	if (!Ar)
+	{
+		return false;
+	}
+
+	const_cast<FVehicleNWInputRecording*>(this)->Serialize(*Ar);
+	return Ar->Close();
+}
+
+bool FVehicleNWInputRecording::LoadFromFile(const FString& Filename)
+{
+	TUniquePtr<FArchive> Ar(IFileManager::Get().CreateFileReader(*Filename));
+	if (!Ar)
+	{
+		return false;
+	}
+
+	Serialize(*Ar);
+	return !Ar->IsError() && Ar->Close();
+}
+
+static FString GetRecordingFilename(const FString& Directory, const UVehicleMovementComponentNW* Vehicle)
+{
+	return Directory / Vehicle->GetOwner()->GetName() + TEXT(".vnwrec");
+}
+
+static FString GetRecordingDirectory(const TArray<FString>& Args, int32 ArgIdx)
+{
+	return Args.IsValidIndex(ArgIdx) ? Args[ArgIdx] : FPaths::ProjectSavedDir() / TEXT("VehicleNWRecordings");
+}
+
+static FAutoConsoleCommandWithWorldAndArgs VehicleNWRecordCommand(
+	TEXT("p.VehicleNW.Record"),
+	TEXT("Record the inputs and state hashes of the NW vehicles of the world, one file per vehicle named after its actor.\n")
+	TEXT("p.VehicleNW.Record Start|Stop [Directory=Saved/VehicleNWRecordings]"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& Args, UWorld* World)
+	{
+		const bool bStart = Args.Num() == 0 || Args[0] == TEXT("Start");
+		const FString Directory = GetRecordingDirectory(Args, 1);
+
+		for (TObjectIterator<UVehicleMovementComponentNW> It; It; ++It)
+		{
+			if (It->GetWorld() != World || It->IsTemplate() || It->GetOwner() == nullptr)
+			{
+				continue;
+			}
+
+			if (bStart)
+			{
+				It->StartInputRecording();
+				continue;
+			}
+
+			TUniquePtr<FVehicleNWInputRecording> Recording = It->StopInputRecording();
+			if (Recording.IsValid())
+			{
+				const FString Filename = GetRecordingFilename(Directory, *It);
+				const bool bSaved = Recording->SaveToFile(Filename);
+				UE_LOG(LogVehicleNW, Display, TEXT("%s %s: %d frames, %d bytes"), bSaved ? TEXT("Saved") : TEXT("Failed to save"), *Filename, Recording->Num(), Recording->GetStreamSize());
+			}
+		}
+	}));
+
+/**
+ * Runs the world at the recorded steps until every vehicle replayed its recording, then reports divergences and timing.
+ * Vehicles recorded together share their step lengths, the first one still replaying sets the next step.
+ */
+class FVehicleNWInputReplay
+{
+public:
+
+	FVehicleNWInputReplay(UWorld* InWorld, const FString& Directory)
+		: World(InWorld)
+		, bWasUsingFixedTimeStep(FApp::UseFixedTimeStep())
+		, PreviousFixedDeltaTime(FApp::GetFixedDeltaTime())
+		, StartTime(FPlatformTime::Seconds())
+		, NumTicks(0)
+	{
+		float FixedDeltaTime = 0.f;
+		for (TObjectIterator<UVehicleMovementComponentNW> It; It; ++It)
+		{
+			if (It->GetWorld() != InWorld || It->IsTemplate() || It->GetOwner() == nullptr)
+			{
+				continue;
+			}
+
+			TSharedRef<FVehicleNWInputRecording> Recording = MakeShared<FVehicleNWInputRecording>();
+			const FString Filename = GetRecordingFilename(Directory, *It);
+			if (!IFileManager::Get().FileExists(*Filename) || !Recording->LoadFromFile(Filename) || !It->StartInputReplay(Recording))
+			{
+				continue;
+			}
+
+			int32 Offset = 0;
+			FVehicleNWInputFrame FirstFrame = {};
+			uint32 StateHash = 0;
+			if (FixedDeltaTime == 0.f && Recording->ReadFrame(Offset, FirstFrame, StateHash))
+			{
+				FixedDeltaTime = FirstFrame.DeltaTime;
+			}
+
+			Vehicles.Add(*It);
+		}
+
+		if (FixedDeltaTime > 0.f)
+		{
+			FApp::SetUseFixedTimeStep(true);
+			FApp::SetFixedDeltaTime(FixedDeltaTime);
+		}
+
+		UE_LOG(LogVehicleNW, Display, TEXT("Replaying %d vehicles from %s at the recorded steps, starting at %.4fs"), Vehicles.Num(), *Directory, FixedDeltaTime);
+	}
+
+	bool Tick(float DeltaTime)
+	{
+		NumTicks++;
+
+		bool bReplaying = false;
+		for (const TWeakObjectPtr<UVehicleMovementComponentNW>& Vehicle : Vehicles)
+		{
+			bReplaying |= Vehicle.IsValid() && Vehicle->IsReplayingInputs();
+		}
+
+		if (bReplaying && World.IsValid())
+		{
+			// The core ticker runs after the world tick, FApp hands this step to the next engine frame.
+			for (const TWeakObjectPtr<UVehicleMovementComponentNW>& Vehicle : Vehicles)
+			{
+				float NextDeltaTime = 0.f;
+				if (Vehicle.IsValid() && Vehicle->PeekInputReplayDeltaTime(NextDeltaTime))
+				{
+					FApp::SetFixedDeltaTime(NextDeltaTime);
+					break;
+				}
+			}
+			return true;
+		}
+
+		FApp::SetUseFixedTimeStep(bWasUsingFixedTimeStep);
+		FApp::SetFixedDeltaTime(PreviousFixedDeltaTime);
+
+		const double Elapsed = FPlatformTime::Seconds() - StartTime;
+		UE_LOG(LogVehicleNW, Display, TEXT("Replay done: %d vehicles, %d frames in %.3fs (%.3fms/frame)"),
+			Vehicles.Num(), NumTicks, Elapsed, Elapsed * 1000.0 / FMath::Max(NumTicks, 1));
+
+		for (const TWeakObjectPtr<UVehicleMovementComponentNW>& Vehicle : Vehicles)
+		{
+			if (Vehicle.IsValid())
+			{
+				const int32 DivergentFrame = Vehicle->GetInputReplayDivergentFrame();
+				UE_LOG(LogVehicleNW, Display, TEXT("  %s: %s"), *Vehicle->GetOwner()->GetName(),
+					DivergentFrame == INDEX_NONE ? TEXT("identical") : *FString::Printf(TEXT("diverged at frame %d"), DivergentFrame));
+			}
+		}
+
+		delete this;
+		return false;
+	}
+
+private:
+
+	TWeakObjectPtr<UWorld> World;
+	TArray<TWeakObjectPtr<UVehicleMovementComponentNW>> Vehicles;
+	bool bWasUsingFixedTimeStep;
+	double PreviousFixedDeltaTime;
+	double StartTime;
+	int32 NumTicks;
+};
+
+static FAutoConsoleCommandWithWorldAndArgs VehicleNWReplayCommand(
+	TEXT("p.VehicleNW.Replay"),
+	TEXT("Replay recordings made with p.VehicleNW.Record on the NW vehicles of the world at their recorded steps, and log the first divergent frame of each.\n")
+	TEXT("p.VehicleNW.Replay [Directory=Saved/VehicleNWRecordings]"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& Args, UWorld* World)
+	{
+		const FString Directory = GetRecordingDirectory(Args, 0);
+
+		FVehicleNWInputReplay* Replay = new FVehicleNWInputReplay(World, Directory);
+		FTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateRaw(Replay, &FVehicleNWInputReplay::Tick));
+	}));
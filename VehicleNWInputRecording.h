@@ -0,0 +1,51 @@
+// Copyright Unreal Engine Community.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "VehicleNWSnapshot.h"
+
+/**
+ * Input frames consumed by UVehicleMovementComponentNW::UpdateSimulation, with a hash of the simulation state each
+ * frame started from, and the snapshot the recording started from.
+ *
+ * Frames are delta encoded: a byte of flags, then only the input values that changed since the previous frame, stored
+ * unquantized so a replay feeds PhysX the exact same values, then the state hash. A steady frame takes 5 bytes.
+ */
+class MYVEHICLEPROJECT_API FVehicleNWInputRecording
+{
+public:
+
+	FVehicleNWInputRecording();
+
+	/** Drop every frame and start over from InInitialState. */
+	void Reset(const FVehicleNWSnapshot& InInitialState);
+
+	const FVehicleNWSnapshot& GetInitialState() const { return InitialState; }
+
+	int32 Num() const { return NumFrames; }
+
+	int32 GetStreamSize() const { return Stream.Num(); }
+
+	void AddFrame(const FVehicleNWInputFrame& InputFrame, uint32 StateHash);
+
+	/**
+	 * Decode the frame at InOutOffset and advance it. InOutFrame must hold the previous frame, zeroed before the first
+	 * one. False at the end of the stream.
+	 */
+	bool ReadFrame(int32& InOutOffset, FVehicleNWInputFrame& InOutFrame, uint32& OutStateHash) const;
+
+	void Serialize(FArchive& Ar);
+
+	bool SaveToFile(const FString& Filename) const;
+	bool LoadFromFile(const FString& Filename);
+
+private:
+
+	FVehicleNWSnapshot InitialState;
+	TArray<uint8> Stream;
+	int32 NumFrames;
+
+	// Last frame written, the reference for the next one.
+	FVehicleNWInputFrame LastFrame;
+};
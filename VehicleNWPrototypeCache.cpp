@@ -0,0 +1,216 @@
+// Copyright Unreal Engine Community.
+
+#include "VehicleNWPrototypeCache.h"
+#include "PhysXIncludes.h"
+#include "PhysXPublic.h"
+#include "Hash/CityHash.h"
+#include "Misc/CoreDelegates.h"
+#include "VehicleNWStats.h"
+
+DECLARE_DWORD_COUNTER_STAT(TEXT("Prototype Hits"), STAT_VehicleNW_PrototypeHits, STATGROUP_VehicleNW);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Prototype Misses"), STAT_VehicleNW_PrototypeMisses, STATGROUP_VehicleNW);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Prototypes"), STAT_VehicleNW_Prototypes, STATGROUP_VehicleNW);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Prototype Builds Pending"), STAT_VehicleNW_PrototypesPending, STATGROUP_VehicleNW);
+DECLARE_CYCLE_STAT(TEXT("Build Prototype"), STAT_VehicleNW_BuildPrototype, STATGROUP_VehicleNW);
+
+static TAutoConsoleVariable<int32> CVarVehicleNWMaxPrototypes(
+	TEXT("p.VehicleNW.MaxPrototypes"),
+	256,
+	TEXT("Max number of distinct vehicle prototypes kept. The cache is flushed when it grows past this."),
+	ECVF_Default);
+
+#if WITH_PHYSX_VEHICLES
+
+FVehicleNWPrototypeCache& FVehicleNWPrototypeCache::Get()
+{
+	static FVehicleNWPrototypeCache Cache;
+	static bool bRegisteredExit = false;
+	if (!bRegisteredExit)
+	{
+		// PhysX is gone by the time statics are destroyed.
+		FCoreDelegates::OnPreExit.AddLambda([]() { FVehicleNWPrototypeCache::Get().Empty(); });
+		bRegisteredExit = true;
+	}
+	return Cache;
+}
+
+FVehicleNWPrototypeCache::~FVehicleNWPrototypeCache()
+{
+	check(Prototypes.Num() == 0);
+}
+
+const FVehicleNWPrototype* FVehicleNWPrototypeCache::Find(uint64 Key) const
+{
+	const FVehicleNWPrototype* Prototype = Prototypes.Find(Key);
+	if (Prototype)
+	{
+		INC_DWORD_STAT(STAT_VehicleNW_PrototypeHits);
+	}
+	else
+	{
+		INC_DWORD_STAT(STAT_VehicleNW_PrototypeMisses);
+	}
+	return Prototype;
+}
+
+const FVehicleNWPrototype* FVehicleNWPrototypeCache::Add(uint64 Key, PxVehicleWheelsSimData* WheelsSimData, const PxVehicleDriveSimDataNW& DriveData)
+{
+	check(WheelsSimData && !Prototypes.Contains(Key));
+
+	if (Prototypes.Num() >= CVarVehicleNWMaxPrototypes.GetValueOnGameThread())
+	{
+		ReleasePrototypes();
+	}
+
+	FVehicleNWPrototype& Prototype = Prototypes.Add(Key);
+	Prototype.WheelsSimData = WheelsSimData;
+	Prototype.DriveData = new PxVehicleDriveSimDataNW(DriveData);
+
+	SET_DWORD_STAT(STAT_VehicleNW_Prototypes, Prototypes.Num());
+	return &Prototype;
+}
+
+FVehicleNWPendingPrototype::FVehicleNWPendingPrototype(uint64 InKey)
+	: Key(InKey)
+	, WheelsSimData(nullptr)
+	, DriveData(nullptr)
+{
+}
+
+FVehicleNWPendingPrototype::~FVehicleNWPendingPrototype()
+{
+	Wait();
+	if (WheelsSimData)
+	{
+		WheelsSimData->free();
+	}
+	delete DriveData;
+}
+
+void FVehicleNWPendingPrototype::Wait()
+{
+	if (Task.IsValid() && !Task->IsComplete())
+	{
+		FTaskGraphInterface::Get().WaitUntilTaskCompletes(Task);
+	}
+}
+
+TSharedRef<FVehicleNWPendingPrototype> FVehicleNWPrototypeCache::BuildAsync(uint64 Key, int32 NumWheels, FVehicleNWPrototypeBuilder&& Builder)
+{
+	if (TSharedRef<FVehicleNWPendingPrototype>* Existing = PendingPrototypes.Find(Key))
+	{
+		return *Existing;
+	}
+
+	TSharedRef<FVehicleNWPendingPrototype> PendingPrototype = MakeShared<FVehicleNWPendingPrototype>(Key);
+	PendingPrototype->WheelsSimData = PxVehicleWheelsSimData::allocate(NumWheels);
+	PendingPrototype->DriveData = new PxVehicleDriveSimDataNW();
+
+	// The task does not hold a reference, the pending prototype waits for it before going away.
+	FVehicleNWPendingPrototype* Data = &PendingPrototype.Get();
+	PendingPrototype->Task = FFunctionGraphTask::CreateAndDispatchWhenReady([Data, Builder = MoveTemp(Builder)]()
+	{
+		SCOPE_CYCLE_COUNTER(STAT_VehicleNW_BuildPrototype);
+		Builder(Data->WheelsSimData, *Data->DriveData);
+	}, TStatId(), nullptr, ENamedThreads::AnyBackgroundThreadNormalTask);
+
+	PendingPrototypes.Add(Key, PendingPrototype);
+	SET_DWORD_STAT(STAT_VehicleNW_PrototypesPending, PendingPrototypes.Num());
+	return PendingPrototype;
+}
+
+const FVehicleNWPrototype* FVehicleNWPrototypeCache::Resolve(FVehicleNWPendingPrototype& PendingPrototype)
+{
+	PendingPrototype.Wait();
+
+	// After Empty, another build may be pending for the same key: only this one's entry is removed.
+	const TSharedRef<FVehicleNWPendingPrototype>* Existing = PendingPrototypes.Find(PendingPrototype.Key);
+	if (Existing && &Existing->Get() == &PendingPrototype)
+	{
+		PendingPrototypes.Remove(PendingPrototype.Key);
+		SET_DWORD_STAT(STAT_VehicleNW_PrototypesPending, PendingPrototypes.Num());
+	}
+
+	// A synchronous setup added the same key first, the build is freed with the last vehicle referencing it.
+	if (const FVehicleNWPrototype* Prototype = Prototypes.Find(PendingPrototype.Key))
+	{
+		return Prototype;
+	}
+	if (PendingPrototype.WheelsSimData == nullptr)
+	{
+		return nullptr;
+	}
+
+	PxVehicleWheelsSimData* WheelsSimData = PendingPrototype.WheelsSimData;
+	PendingPrototype.WheelsSimData = nullptr;
+	return Add(PendingPrototype.Key, WheelsSimData, *PendingPrototype.DriveData);
+}
+
+void FVehicleNWPrototypeCache::Empty()
+{
+	// Builds still referenced by vehicles are discarded, they resolve to null.
+	for (TPair<uint64, TSharedRef<FVehicleNWPendingPrototype>>& Pair : PendingPrototypes)
+	{
+		FVehicleNWPendingPrototype& PendingPrototype = Pair.Value.Get();
+		PendingPrototype.Wait();
+		PendingPrototype.WheelsSimData->free();
+		PendingPrototype.WheelsSimData = nullptr;
+	}
+	PendingPrototypes.Empty();
+	SET_DWORD_STAT(STAT_VehicleNW_PrototypesPending, 0);
+
+	ReleasePrototypes();
+	WheelClassHashes.Empty();
+}
+
+void FVehicleNWPrototypeCache::ReleasePrototypes()
+{
+	for (TPair<uint64, FVehicleNWPrototype>& Pair : Prototypes)
+	{
+		Pair.Value.WheelsSimData->free();
+		delete Pair.Value.DriveData;
+	}
+
+	Prototypes.Empty();
+	SET_DWORD_STAT(STAT_VehicleNW_Prototypes, 0);
+}
+
+uint64 FVehicleNWPrototypeCache::GetWheelClassHash(const UClass* WheelClass)
+{
+#if !WITH_EDITOR
+	// Default objects can only change in the editor.
+	if (const uint64* CachedHash = WheelClassHashes.Find(WheelClass))
+	{
+		return *CachedHash;
+	}
+#endif // !WITH_EDITOR
+
+	const UObject* WheelCDO = WheelClass->GetDefaultObject();
+
+	FString WheelText = WheelClass->GetPathName();
+	for (TFieldIterator<UProperty> PropertyIt(WheelClass); PropertyIt; ++PropertyIt)
+	{
+		const UProperty* Property = *PropertyIt;
+		if (Property->HasAnyPropertyFlags(CPF_Transient))
+		{
+			continue;
+		}
+
+		for (int32 ArrayIdx = 0; ArrayIdx < Property->ArrayDim; ArrayIdx++)
+		{
+			Property->ExportText_InContainer(ArrayIdx, WheelText, WheelCDO, nullptr, nullptr, PPF_None);
+			WheelText.AppendChar(TEXT(';'));
+		}
+	}
+
+	const uint64 Hash = CityHash64(reinterpret_cast<const char*>(*WheelText), WheelText.Len() * sizeof(TCHAR));
+	WheelClassHashes.Add(WheelClass, Hash);
+	return Hash;
+}
+
+uint64 FVehicleNWKeyBuilder::GetHash() const
+{
+	return CityHash64(reinterpret_cast<const char*>(Bytes.GetData()), Bytes.Num());
+}
+
+#endif // WITH_PHYSX_VEHICLES
@@ -0,0 +1,108 @@
+// Copyright Unreal Engine Community.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Async/TaskGraphInterfaces.h"
+
+#if WITH_PHYSX_VEHICLES
+
+namespace physx
+{
+	class PxVehicleDriveSimDataNW;
+	class PxVehicleWheelsSimData;
+}
+
+/** Finished wheel and drive sim data, shared by every vehicle built from the same setup. */
+struct FVehicleNWPrototype
+{
+	physx::PxVehicleWheelsSimData* WheelsSimData;
+	physx::PxVehicleDriveSimDataNW* DriveData;
+};
+
+/** Prototype being built on a background thread. The data belongs to the task until the cache resolves it. */
+struct MYVEHICLEPROJECT_API FVehicleNWPendingPrototype
+{
+	uint64 Key;
+	physx::PxVehicleWheelsSimData* WheelsSimData;
+	physx::PxVehicleDriveSimDataNW* DriveData;
+	FGraphEventRef Task;
+
+	FVehicleNWPendingPrototype(uint64 InKey);
+	~FVehicleNWPendingPrototype();
+
+	bool IsComplete() const { return !Task.IsValid() || Task->IsComplete(); }
+
+	/** Block until the build is done. */
+	void Wait();
+};
+
+/** Fills the wheel and drive sim data of a prototype. Runs on a background thread. */
+typedef TFunction<void(physx::PxVehicleWheelsSimData*, physx::PxVehicleDriveSimDataNW&)> FVehicleNWPrototypeBuilder;
+
+/**
+ * Cache of vehicle prototypes keyed by a hash of everything SetupWheels and SetupDriveHelper read:
+ * wheel classes and resting positions, chassis mass, engine, transmission and differential setup.
+ *
+ * Spawning an already known vehicle only copies the prototype into the new PxVehicleDriveNW.
+ * Game thread only.
+ */
+class MYVEHICLEPROJECT_API FVehicleNWPrototypeCache
+{
+public:
+
+	static FVehicleNWPrototypeCache& Get();
+
+	~FVehicleNWPrototypeCache();
+
+	/** Prototype built for Key, or null. */
+	const FVehicleNWPrototype* Find(uint64 Key) const;
+
+	/** Store a prototype. Takes ownership of WheelsSimData. */
+	const FVehicleNWPrototype* Add(uint64 Key, physx::PxVehicleWheelsSimData* WheelsSimData, const physx::PxVehicleDriveSimDataNW& DriveData);
+
+	/**
+	 * Build the prototype for Key on a background thread. Vehicles asking for a Key already being built share its
+	 * build. Builder must only read data that stays valid and unchanged until the build is complete.
+	 */
+	TSharedRef<FVehicleNWPendingPrototype> BuildAsync(uint64 Key, int32 NumWheels, FVehicleNWPrototypeBuilder&& Builder);
+
+	/** Prototype of a completed build, moved into the cache by the first vehicle resolving it. Null if the build was discarded. */
+	const FVehicleNWPrototype* Resolve(FVehicleNWPendingPrototype& PendingPrototype);
+
+	/** Release every prototype. Vehicles already created keep their own copy of the data. */
+	void Empty();
+
+	int32 Num() const { return Prototypes.Num(); }
+
+	/** Hash of every editable property of a wheel class default object, cached per class outside of the editor. */
+	uint64 GetWheelClassHash(const UClass* WheelClass);
+
+private:
+
+	/** Free the finished prototypes, keeping pending builds and wheel class hashes. */
+	void ReleasePrototypes();
+
+	TMap<uint64, FVehicleNWPrototype> Prototypes;
+
+	TMap<uint64, TSharedRef<FVehicleNWPendingPrototype>> PendingPrototypes;
+
+	TMap<const UClass*, uint64> WheelClassHashes;
+};
+
+/** Accumulates raw bytes for a 64 bit hash. */
+struct FVehicleNWKeyBuilder
+{
+	TArray<uint8, TInlineAllocator<2048>> Bytes;
+
+	template<typename T>
+	void Append(const T& Value)
+	{
+		static_assert(TIsPODType<T>::Value, "Only POD values can be hashed as raw bytes.");
+		Bytes.Append(reinterpret_cast<const uint8*>(&Value), sizeof(T));
+	}
+
+	uint64 GetHash() const;
+};
+
+#endif // WITH_PHYSX_VEHICLES
@@ -0,0 +1,471 @@
+// Copyright Unreal Engine Community.
+
+#include "VehicleNWReplication.h"
+#include "VehicleMovementComponentNW.h"
+#include "VehicleNWStats.h"
+#include "Serialization/BitWriter.h"
+#include "Serialization/BitReader.h"
+#include "Containers/Ticker.h"
+#include "Engine/World.h"
+#include "GameFramework/Actor.h"
+#include "UObject/UObjectIterator.h"
+
+DECLARE_DWORD_COUNTER_STAT(TEXT("Net State Bits Written"), STAT_VehicleNW_NetBitsWritten, STATGROUP_VehicleNW);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Net States Written"), STAT_VehicleNW_NetStatesWritten, STATGROUP_VehicleNW);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Net Keyframes Written"), STAT_VehicleNW_NetKeyframesWritten, STATGROUP_VehicleNW);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Net States Dropped"), STAT_VehicleNW_NetStatesDropped, STATGROUP_VehicleNW);
+
+static TAutoConsoleVariable<int32> CVarVehicleNWNetKeyframeInterval(
+	TEXT("p.VehicleNW.NetKeyframeInterval"),
+	30,
+	TEXT("Number of states sent to a connection between two full (non delta) NW vehicle states."),
+	ECVF_Default);
+
+// Quantization steps: 1 mm, 1 mm/s, 0.1 deg/s, 0.1 rad/s, 256 wheel angles per turn.
+static const float PositionScale = 10.f;
+static const float LinearVelocityScale = 10.f;
+static const float AngularVelocityScale = 10.f;
+static const float EngineRotationSpeedScale = 10.f;
+static const float WheelRotationScale = 256.f / 360.f;
+
+// Smallest three components of a unit quaternion are within +-1/sqrt(2).
+static const float RotationScale = 32767.f * 1.41421356f;
+
+// Largest number of wheels PxVehicleDriveNW supports.
+static const uint32 MaxReplicatedWheels = 20;
+
+// Number of received states kept as delta bases on the client.
+static const int32 MaxReceivedStates = 8;
+
+static FORCEINLINE bool IsWheelRotationField(int32 FieldIdx)
+{
+	return FieldIdx >= FVehicleNWQuantizedState::NumBodyFields;
+}
+
+static FORCEINLINE uint32 ZigZagEncode(int32 Value)
+{
+	return ((uint32)Value << 1) ^ (uint32)(Value >> 31);
+}
+
+static FORCEINLINE int32 ZigZagDecode(uint32 Value)
+{
+	return (int32)(Value >> 1) ^ -(int32)(Value & 1);
+}
+
+// Wheel angles wrap around, their delta is taken the short way.
+static FORCEINLINE int32 FieldDelta(int32 FieldIdx, int32 Value, int32 BaseValue)
+{
+	const int32 Delta = Value - BaseValue;
+	return IsWheelRotationField(FieldIdx) ? (int32)(int8)(uint8)Delta : Delta;
+}
+
+static FORCEINLINE int32 ApplyFieldDelta(int32 FieldIdx, int32 BaseValue, int32 Delta)
+{
+	const int32 Value = BaseValue + Delta;
+	return IsWheelRotationField(FieldIdx) ? (Value & 0xff) : Value;
+}
+
+void FVehicleNWQuantizedState::Write(FBitWriter& Writer, const FVehicleNWQuantizedState* Base) const
+{
+	check(Base == nullptr || Base->Fields.Num() == Fields.Num());
+
+	uint32 NumWheels = GetNumWheels();
+	Writer.SerializeIntPacked(NumWheels);
+
+	for (int32 FieldIdx = 0; FieldIdx < Fields.Num(); FieldIdx++)
+	{
+		int32 Value = Fields[FieldIdx];
+		if (Base)
+		{
+			Value = FieldDelta(FieldIdx, Value, Base->Fields[FieldIdx]);
+
+			uint8 bChanged = Value != 0;
+			Writer.WriteBit(bChanged);
+			if (!bChanged)
+			{
+				continue;
+			}
+		}
+
+		uint32 Encoded = ZigZagEncode(Value);
+		Writer.SerializeIntPacked(Encoded);
+	}
+}
+
+bool FVehicleNWQuantizedState::Read(FBitReader& Reader, bool bDelta, const FVehicleNWQuantizedState* Base)
+{
+	uint32 NumWheels = 0;
+	Reader.SerializeIntPacked(NumWheels);
+	if (Reader.IsError() || NumWheels > MaxReplicatedWheels)
+	{
+		Reader.SetError();
+		return false;
+	}
+
+	Fields.SetNumUninitialized(NumBodyFields + NumWheels);
+	const bool bHasBase = Base && Base->Fields.Num() == Fields.Num();
+
+	for (int32 FieldIdx = 0; FieldIdx < Fields.Num(); FieldIdx++)
+	{
+		int32 Value = 0;
+		if (!bDelta || Reader.ReadBit())
+		{
+			uint32 Encoded = 0;
+			Reader.SerializeIntPacked(Encoded);
+			Value = ZigZagDecode(Encoded);
+		}
+
+		if (bDelta)
+		{
+			Value = bHasBase ? ApplyFieldDelta(FieldIdx, Base->Fields[FieldIdx], Value) : 0;
+		}
+		Fields[FieldIdx] = Value;
+	}
+
+	return !Reader.IsError() && (!bDelta || bHasBase);
+}
+
+FVehicleNWReplicatedState::FVehicleNWReplicatedState()
+	: Location(FVector::ZeroVector)
+	, Rotation(FQuat::Identity)
+	, LinearVelocity(FVector::ZeroVector)
+	, AngularVelocity(FVector::ZeroVector)
+	, Gear(0)
+	, EngineRotationSpeed(0.f)
+	, NextSequence(0)
+	, bNewStateReceived(false)
+{
+}
+
+void FVehicleNWReplicatedState::Quantize(FVehicleNWQuantizedState& OutState) const
+{
+	const int32 NumWheels = FMath::Min<int32>(WheelRotation.Num(), MaxReplicatedWheels);
+	TArray<int32, TInlineAllocator<FVehicleNWQuantizedState::NumBodyFields + 20>>& Fields = OutState.Fields;
+	Fields.SetNumUninitialized(FVehicleNWQuantizedState::NumBodyFields + NumWheels);
+
+	Fields[FVehicleNWQuantizedState::PositionX] = FMath::RoundToInt(Location.X * PositionScale);
+	Fields[FVehicleNWQuantizedState::PositionY] = FMath::RoundToInt(Location.Y * PositionScale);
+	Fields[FVehicleNWQuantizedState::PositionZ] = FMath::RoundToInt(Location.Z * PositionScale);
+
+	// Smallest three: drop the largest component, made positive, and send its index.
+	const FQuat Quat = Rotation.GetNormalized();
+	const float Components[4] = { Quat.X, Quat.Y, Quat.Z, Quat.W };
+	int32 Largest = 0;
+	for (int32 ComponentIdx = 1; ComponentIdx < 4; ComponentIdx++)
+	{
+		if (FMath::Abs(Components[ComponentIdx]) > FMath::Abs(Components[Largest]))
+		{
+			Largest = ComponentIdx;
+		}
+	}
+	const float Sign = Components[Largest] < 0.f ? -1.f : 1.f;
+	Fields[FVehicleNWQuantizedState::RotationLargest] = Largest;
+	int32 FieldIdx = FVehicleNWQuantizedState::RotationA;
+	for (int32 ComponentIdx = 0; ComponentIdx < 4; ComponentIdx++)
+	{
+		if (ComponentIdx != Largest)
+		{
+			Fields[FieldIdx++] = FMath::RoundToInt(Components[ComponentIdx] * Sign * RotationScale);
+		}
+	}
+
+	Fields[FVehicleNWQuantizedState::LinearVelocityX] = FMath::RoundToInt(LinearVelocity.X * LinearVelocityScale);
+	Fields[FVehicleNWQuantizedState::LinearVelocityY] = FMath::RoundToInt(LinearVelocity.Y * LinearVelocityScale);
+	Fields[FVehicleNWQuantizedState::LinearVelocityZ] = FMath::RoundToInt(LinearVelocity.Z * LinearVelocityScale);
+	Fields[FVehicleNWQuantizedState::AngularVelocityX] = FMath::RoundToInt(AngularVelocity.X * AngularVelocityScale);
+	Fields[FVehicleNWQuantizedState::AngularVelocityY] = FMath::RoundToInt(AngularVelocity.Y * AngularVelocityScale);
+	Fields[FVehicleNWQuantizedState::AngularVelocityZ] = FMath::RoundToInt(AngularVelocity.Z * AngularVelocityScale);
+	Fields[FVehicleNWQuantizedState::Gear] = Gear;
+	Fields[FVehicleNWQuantizedState::EngineRotationSpeed] = FMath::RoundToInt(EngineRotationSpeed * EngineRotationSpeedScale);
+
+	for (int32 WheelIdx = 0; WheelIdx < NumWheels; WheelIdx++)
+	{
+		Fields[FVehicleNWQuantizedState::NumBodyFields + WheelIdx] = FMath::RoundToInt(FRotator::ClampAxis(WheelRotation[WheelIdx]) * WheelRotationScale) & 0xff;
+	}
+}
+
+void FVehicleNWReplicatedState::Dequantize(const FVehicleNWQuantizedState& InState)
+{
+	const TArray<int32, TInlineAllocator<FVehicleNWQuantizedState::NumBodyFields + 20>>& Fields = InState.Fields;
+
+	Location.X = Fields[FVehicleNWQuantizedState::PositionX] / PositionScale;
+	Location.Y = Fields[FVehicleNWQuantizedState::PositionY] / PositionScale;
+	Location.Z = Fields[FVehicleNWQuantizedState::PositionZ] / PositionScale;
+
+	const int32 Largest = FMath::Clamp(Fields[FVehicleNWQuantizedState::RotationLargest], 0, 3);
+	float Components[4];
+	float SumSquares = 0.f;
+	int32 FieldIdx = FVehicleNWQuantizedState::RotationA;
+	for (int32 ComponentIdx = 0; ComponentIdx < 4; ComponentIdx++)
+	{
+		if (ComponentIdx != Largest)
+		{
+			Components[ComponentIdx] = Fields[FieldIdx++] / RotationScale;
+			SumSquares += FMath::Square(Components[ComponentIdx]);
+		}
+	}
+	Components[Largest] = FMath::Sqrt(FMath::Max(0.f, 1.f - SumSquares));
+	Rotation = FQuat(Components[0], Components[1], Components[2], Components[3]).GetNormalized();
+
+	LinearVelocity.X = Fields[FVehicleNWQuantizedState::LinearVelocityX] / LinearVelocityScale;
+	LinearVelocity.Y = Fields[FVehicleNWQuantizedState::LinearVelocityY] / LinearVelocityScale;
+	LinearVelocity.Z = Fields[FVehicleNWQuantizedState::LinearVelocityZ] / LinearVelocityScale;
+	AngularVelocity.X = Fields[FVehicleNWQuantizedState::AngularVelocityX] / AngularVelocityScale;
+	AngularVelocity.Y = Fields[FVehicleNWQuantizedState::AngularVelocityY] / AngularVelocityScale;
+	AngularVelocity.Z = Fields[FVehicleNWQuantizedState::AngularVelocityZ] / AngularVelocityScale;
+	Gear = Fields[FVehicleNWQuantizedState::Gear];
+	EngineRotationSpeed = Fields[FVehicleNWQuantizedState::EngineRotationSpeed] / EngineRotationSpeedScale;
+
+	const int32 NumWheels = InState.GetNumWheels();
+	WheelRotation.SetNumUninitialized(NumWheels);
+	for (int32 WheelIdx = 0; WheelIdx < NumWheels; WheelIdx++)
+	{
+		WheelRotation[WheelIdx] = Fields[FVehicleNWQuantizedState::NumBodyFields + WheelIdx] / WheelRotationScale;
+	}
+}
+
+bool FVehicleNWReplicatedState::NetDeltaSerialize(FNetDeltaSerializeInfo& DeltaParms)
+{
+	if (DeltaParms.Writer)
+	{
+		FVehicleNWNetBaseState* Base = static_cast<FVehicleNWNetBaseState*>(DeltaParms.OldState);
+
+		FVehicleNWQuantizedState State;
+		Quantize(State);
+
+		// Nothing moved since the last send to this connection.
+		if (Base && Base->State == State)
+		{
+			*DeltaParms.NewState = MakeShared<FVehicleNWNetBaseState>(*Base);
+			return false;
+		}
+
+		*DeltaParms.NewState = VehicleNWReplication::WriteState(*DeltaParms.Writer, State, NextSequence++, Base);
+		return true;
+	}
+
+	if (DeltaParms.Reader)
+	{
+		return VehicleNWReplication::ReadState(*DeltaParms.Reader, *this);
+	}
+
+	return false;
+}
+
+namespace VehicleNWReplication
+{
+	TSharedPtr<FVehicleNWNetBaseState> WriteState(FBitWriter& Writer, const FVehicleNWQuantizedState& State, uint16 Sequence, FVehicleNWNetBaseState* Base)
+	{
+		const int64 StartBits = Writer.GetNumBits();
+
+		// Base is what was last sent, not what was received. Once a send from it was lost, the client may not even
+		// have Base, and the deltas it already got from the lost state are useless.
+		uint8 bKeyframe = Base == nullptr
+			|| Base->bSentFrom
+			|| Base->State.Fields.Num() != State.Fields.Num()
+			|| Base->SendsSinceKeyframe + 1 >= CVarVehicleNWNetKeyframeInterval.GetValueOnAnyThread();
+		if (Base)
+		{
+			Base->bSentFrom = true;
+		}
+
+		uint32 PackedSequence = Sequence;
+		Writer.SerializeIntPacked(PackedSequence);
+		Writer.WriteBit(bKeyframe);
+		if (!bKeyframe)
+		{
+			uint32 BaseSequence = Base->Sequence;
+			Writer.SerializeIntPacked(BaseSequence);
+		}
+
+		State.Write(Writer, bKeyframe ? nullptr : &Base->State);
+
+		TSharedPtr<FVehicleNWNetBaseState> NewBase = MakeShared<FVehicleNWNetBaseState>();
+		NewBase->State = State;
+		NewBase->Sequence = Sequence;
+		NewBase->SendsSinceKeyframe = bKeyframe ? 0 : Base->SendsSinceKeyframe + 1;
+
+		INC_DWORD_STAT(STAT_VehicleNW_NetStatesWritten);
+		INC_DWORD_STAT_BY(STAT_VehicleNW_NetBitsWritten, Writer.GetNumBits() - StartBits);
+		if (bKeyframe)
+		{
+			INC_DWORD_STAT(STAT_VehicleNW_NetKeyframesWritten);
+		}
+
+		return NewBase;
+	}
+
+	bool ReadState(FBitReader& Reader, FVehicleNWReplicatedState& ReplicatedState)
+	{
+		uint32 Sequence = 0;
+		Reader.SerializeIntPacked(Sequence);
+		const bool bKeyframe = Reader.ReadBit() != 0;
+
+		const FVehicleNWQuantizedState* Base = nullptr;
+		if (!bKeyframe)
+		{
+			uint32 BaseSequence = 0;
+			Reader.SerializeIntPacked(BaseSequence);
+			for (const FVehicleNWReplicatedState::FReceivedState& Received : ReplicatedState.ReceivedStates)
+			{
+				if (Received.Sequence == (uint16)BaseSequence)
+				{
+					Base = &Received.State;
+					break;
+				}
+			}
+		}
+
+		FVehicleNWQuantizedState State;
+		if (!State.Read(Reader, !bKeyframe, Base))
+		{
+			// Base too old or never received: wait for the next keyframe.
+			INC_DWORD_STAT(STAT_VehicleNW_NetStatesDropped);
+			return !Reader.IsError();
+		}
+
+		ReplicatedState.Dequantize(State);
+		ReplicatedState.bNewStateReceived = true;
+
+		if (ReplicatedState.ReceivedStates.Num() >= MaxReceivedStates)
+		{
+			ReplicatedState.ReceivedStates.RemoveAt(0, 1, false);
+		}
+		FVehicleNWReplicatedState::FReceivedState& Received = ReplicatedState.ReceivedStates.AddDefaulted_GetRef();
+		Received.Sequence = (uint16)Sequence;
+		Received.State = MoveTemp(State);
+
+		return true;
+	}
+}
+
+/**
+ * Measures the state replication of the NW vehicles of a world without a network: every vehicle is written at its
+ * owner's NetUpdateFrequency, optionally dropped, and read back into a client copy. Like the engine, the next state
+ * is based on the last one sent, lost or not.
+ */
+class FVehicleNWNetLoopback
+{
+public:
+
+	FVehicleNWNetLoopback(UWorld* InWorld, float InDuration, int32 InLossPercent)
+		: World(InWorld)
+		, Duration(InDuration)
+		, LossPercent(InLossPercent)
+		, Elapsed(0.f)
+		, NumBits(0)
+		, NumSends(0)
+		, NumDropped(0)
+		, NumUndecoded(0)
+		, MaxPositionError(0.f)
+	{
+		for (TObjectIterator<UVehicleMovementComponentNW> It; It; ++It)
+		{
+			if (It->GetWorld() == InWorld && !It->IsTemplate())
+			{
+				FChannel& Channel = Channels.AddDefaulted_GetRef();
+				Channel.Vehicle = *It;
+				Channel.NextSendTime = 0.f;
+				Channel.Sequence = 0;
+			}
+		}
+	}
+
+	bool Tick(float DeltaTime)
+	{
+		Elapsed += DeltaTime;
+
+		for (FChannel& Channel : Channels)
+		{
+			UVehicleMovementComponentNW* Vehicle = Channel.Vehicle.Get();
+			if (Vehicle == nullptr || Vehicle->GetOwner() == nullptr || Elapsed < Channel.NextSendTime)
+			{
+				continue;
+			}
+			Channel.NextSendTime = Elapsed + 1.f / FMath::Max(Vehicle->GetOwner()->NetUpdateFrequency, 1.f);
+
+			FVehicleNWReplicatedState ServerState;
+			Vehicle->CaptureReplicatedState(ServerState);
+
+			FVehicleNWQuantizedState State;
+			ServerState.Quantize(State);
+			if (Channel.Base.IsValid() && Channel.Base->State == State)
+			{
+				continue;
+			}
+
+			FBitWriter Writer(0, true);
+			Channel.Base = VehicleNWReplication::WriteState(Writer, State, Channel.Sequence++, Channel.Base.Get());
+			NumBits += Writer.GetNumBits();
+			NumSends++;
+
+			if (FMath::RandRange(0, 99) < LossPercent)
+			{
+				NumDropped++;
+				continue;
+			}
+
+			FBitReader Reader(Writer.GetData(), Writer.GetNumBits());
+			VehicleNWReplication::ReadState(Reader, Channel.Client);
+			if (Channel.Client.bNewStateReceived)
+			{
+				Channel.Client.bNewStateReceived = false;
+				MaxPositionError = FMath::Max(MaxPositionError, FVector::Dist(Channel.Client.Location, ServerState.Location));
+			}
+			else
+			{
+				NumUndecoded++;
+			}
+		}
+
+		if (Elapsed < Duration && World.IsValid())
+		{
+			return true;
+		}
+
+		const int32 NumVehicles = FMath::Max(Channels.Num(), 1);
+		UE_LOG(LogVehicleNW, Display, TEXT("Net loopback: %d vehicles, %.1fs, %d states (%d dropped, %d without base), %.1f bytes/vehicle/s, %.1f bytes/state, max position error %.2fcm"),
+			Channels.Num(), Elapsed, NumSends, NumDropped, NumUndecoded,
+			NumBits / 8.0 / NumVehicles / FMath::Max(Elapsed, KINDA_SMALL_NUMBER),
+			NumBits / 8.0 / FMath::Max(NumSends, 1),
+			MaxPositionError);
+
+		delete this;
+		return false;
+	}
+
+private:
+
+	struct FChannel
+	{
+		TWeakObjectPtr<UVehicleMovementComponentNW> Vehicle;
+		TSharedPtr<FVehicleNWNetBaseState> Base;
+		FVehicleNWReplicatedState Client;
+		float NextSendTime;
+		uint16 Sequence;
+	};
+
+	TWeakObjectPtr<UWorld> World;
+	float Duration;
+	int32 LossPercent;
+	float Elapsed;
+	int64 NumBits;
+	int32 NumSends;
+	int32 NumDropped;
+	int32 NumUndecoded;
+	float MaxPositionError;
+	TArray<FChannel> Channels;
+};
+
+static FAutoConsoleCommandWithWorldAndArgs VehicleNWNetLoopbackCommand(
+	TEXT("p.VehicleNW.NetLoopback"),
+	TEXT("Replicate the NW vehicles of the world to themselves and log bytes per vehicle per second.\n")
+	TEXT("p.VehicleNW.NetLoopback [Seconds=10] [LossPercent=0]"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& Args, UWorld* World)
+	{
+		const float Duration = Args.Num() > 0 ? FCString::Atof(*Args[0]) : 10.f;
+		const int32 LossPercent = Args.Num() > 1 ? FCString::Atoi(*Args[1]) : 0;
+
+		FVehicleNWNetLoopback* Loopback = new FVehicleNWNetLoopback(World, Duration, LossPercent);
+		FTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateRaw(Loopback, &FVehicleNWNetLoopback::Tick));
+	}));
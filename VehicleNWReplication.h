@@ -0,0 +1,130 @@
+// Copyright Unreal Engine Community.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Engine/NetSerialization.h"
+#include "VehicleNWReplication.generated.h"
+
+class FBitWriter;
+class FBitReader;
+class UVehicleMovementComponentNW;
+
+/** Vehicle state quantized to integers, in the order it goes on the wire. */
+struct MYVEHICLEPROJECT_API FVehicleNWQuantizedState
+{
+	enum EField
+	{
+		PositionX, PositionY, PositionZ,
+		RotationLargest, RotationA, RotationB, RotationC,
+		LinearVelocityX, LinearVelocityY, LinearVelocityZ,
+		AngularVelocityX, AngularVelocityY, AngularVelocityZ,
+		Gear,
+		EngineRotationSpeed,
+		NumBodyFields,
+	};
+
+	// Body fields, followed by the rotation of each wheel.
+	TArray<int32, TInlineAllocator<NumBodyFields + 20>> Fields;
+
+	int32 GetNumWheels() const { return Fields.Num() - NumBodyFields; }
+
+	bool operator==(const FVehicleNWQuantizedState& Other) const { return Fields == Other.Fields; }
+
+	/** Write every field, or only the fields that differ from Base. */
+	void Write(FBitWriter& Writer, const FVehicleNWQuantizedState* Base) const;
+
+	/** Read what Write wrote. Base must be the state Write was given, the stream is consumed either way. */
+	bool Read(FBitReader& Reader, bool bDelta, const FVehicleNWQuantizedState* Base);
+};
+
+/**
+ * Replicated state of a UVehicleMovementComponentNW, for simulated and autonomous proxies.
+ *
+ * Serialized quantized (1 mm, 1 mm/s, 0.1 deg/s, smallest three quaternion, 8 bit wheel angles) and delta
+ * compressed against the last state sent to each connection, which the engine rolls back when that send is lost.
+ * A keyframe goes out every p.VehicleNW.NetKeyframeInterval sends, and after a loss since the client may be missing
+ * the base. Deltas whose base the client does not have are dropped until the next keyframe.
+ */
+USTRUCT()
+struct MYVEHICLEPROJECT_API FVehicleNWReplicatedState
+{
+	GENERATED_USTRUCT_BODY()
+
+	FVector Location;
+	FQuat Rotation;
+	FVector LinearVelocity;
+
+	// Degrees per second.
+	FVector AngularVelocity;
+
+	int32 Gear;
+
+	// Radians per second.
+	float EngineRotationSpeed;
+
+	// Degrees, one per wheel. Steering follows from the replicated inputs.
+	TArray<float> WheelRotation;
+
+	FVehicleNWReplicatedState();
+
+	void Quantize(FVehicleNWQuantizedState& OutState) const;
+	void Dequantize(const FVehicleNWQuantizedState& InState);
+
+	bool NetDeltaSerialize(FNetDeltaSerializeInfo& DeltaParms);
+
+	/** Sequence number of the next state written, per property (all connections). */
+	uint16 NextSequence;
+
+	/** States last received (client), to be used as delta bases. */
+	struct FReceivedState
+	{
+		uint16 Sequence;
+		FVehicleNWQuantizedState State;
+	};
+	TArray<FReceivedState, TInlineAllocator<8>> ReceivedStates;
+
+	/** Set by ReadState when a state was decoded into the fields above, cleared by whoever applies it (client). */
+	bool bNewStateReceived;
+};
+
+template<>
+struct TStructOpsTypeTraits<FVehicleNWReplicatedState> : public TStructOpsTypeTraitsBase2<FVehicleNWReplicatedState>
+{
+	enum
+	{
+		WithNetDeltaSerializer = true,
+	};
+};
+
+/** What was last sent to a connection. */
+class FVehicleNWNetBaseState : public INetDeltaBaseState
+{
+public:
+
+	FVehicleNWQuantizedState State;
+	uint16 Sequence;
+
+	// Sends since the last keyframe.
+	int32 SendsSinceKeyframe;
+
+	// A state was already written from this one: the engine went back to it because that send was lost.
+	bool bSentFrom = false;
+
+	virtual bool IsStateEqual(INetDeltaBaseState* OtherState) override
+	{
+		return State == static_cast<FVehicleNWNetBaseState*>(OtherState)->State;
+	}
+};
+
+namespace VehicleNWReplication
+{
+	/** Encode State for a connection that was last sent Base, as a keyframe if Base cannot be relied on. Returns the new base. */
+	MYVEHICLEPROJECT_API TSharedPtr<FVehicleNWNetBaseState> WriteState(FBitWriter& Writer, const FVehicleNWQuantizedState& State, uint16 Sequence, FVehicleNWNetBaseState* Base);
+
+	/**
+	 * Decode a state written by WriteState, using the states received before as bases. Sets bNewStateReceived when the
+	 * state could be decoded. False only if the stream is corrupt.
+	 */
+	MYVEHICLEPROJECT_API bool ReadState(FBitReader& Reader, FVehicleNWReplicatedState& ReplicatedState);
+}
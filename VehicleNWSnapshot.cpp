@@ -0,0 +1,239 @@
+// Copyright Unreal Engine Community.
+
+#include "VehicleNWSnapshot.h"
+#include "PhysXIncludes.h"
+#include "PhysXPublic.h"
+#include "PhysicsFiltering.h"
+#include "VehicleNWFrictionTable.h"
+#include "VehicleNWHeightfieldQuery.h"
+#include "VehicleNWStats.h"
+
+DECLARE_CYCLE_STAT(TEXT("Resim Step"), STAT_VehicleNW_ResimStep, STATGROUP_VehicleNW);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Heightfield Suspension Steps"), STAT_VehicleNW_HeightfieldSteps, STATGROUP_VehicleNW);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Heightfield Suspension Fallbacks"), STAT_VehicleNW_HeightfieldFallbacks, STATGROUP_VehicleNW);
+
+static_assert(TIsPODType<FVehicleNWSnapshot>::Value, "FVehicleNWSnapshot is copied as raw bytes.");
+
+uint32 FVehicleNWSnapshot::HashSimulationState() const
+{
+	// BodyPose to DriveDynData is one run of 32 bit words.
+	const uint8* BodyBegin = (const uint8*)BodyPose;
+	const uint8* BodyEnd = (const uint8*)(DriveDynData + DriveDynDataWords);
+	uint32 Hash = FCrc::MemCrc32(BodyBegin, BodyEnd - BodyBegin);
+
+	const int32 HashedWheels = FMath::Clamp(NumWheels, 0, MaxWheels);
+	Hash = FCrc::MemCrc32(WheelRotationSpeeds, HashedWheels * sizeof(float), Hash);
+	Hash = FCrc::MemCrc32(WheelRotationAngles, HashedWheels * sizeof(float), Hash);
+	return Hash;
+}
+
+void FVehicleNWSnapshotRing::Allocate(int32 Capacity)
+{
+	Snapshots.SetNumZeroed(FMath::Max(Capacity, 0));
+	Reset();
+}
+
+FVehicleNWSnapshot* FVehicleNWSnapshotRing::Write(int32 Frame)
+{
+	if (Snapshots.Num() == 0 || Frame < 0)
+	{
+		return nullptr;
+	}
+
+	FVehicleNWSnapshot& Snapshot = Snapshots[Frame % Snapshots.Num()];
+	Snapshot.Frame = Frame;
+	return &Snapshot;
+}
+
+const FVehicleNWSnapshot* FVehicleNWSnapshotRing::Find(int32 Frame) const
+{
+	if (Snapshots.Num() == 0 || Frame < 0)
+	{
+		return nullptr;
+	}
+
+	const FVehicleNWSnapshot& Snapshot = Snapshots[Frame % Snapshots.Num()];
+	return Snapshot.Frame == Frame ? &Snapshot : nullptr;
+}
+
+void FVehicleNWSnapshotRing::Reset()
+{
+	for (FVehicleNWSnapshot& Snapshot : Snapshots)
+	{
+		Snapshot.Frame = INDEX_NONE;
+	}
+}
+
+#if WITH_PHYSX_VEHICLES
+
+static_assert(sizeof(PxVehicleDriveDynData) <= sizeof(uint32) * FVehicleNWSnapshot::DriveDynDataWords, "FVehicleNWSnapshot::DriveDynData is too small.");
+static_assert(FVehicleNWSnapshot::MaxWheels == PX_MAX_NB_WHEELS, "Wheel count mismatch.");
+
+/**
+ * Same rules as the suspension raycasts of FPhysXVehicleManager: skip our own shapes, only hit shapes of a collision
+ * complexity the suspension queries, block on the suspension channel.
+ */
+static PxQueryHitType::Enum WheelRaycastPreFilter(PxFilterData SuspensionData, PxFilterData HitData, const void* ConstantBlock, PxU32 ConstantBlockSize, PxHitFlags& FilterFlags)
+{
+	if (SuspensionData.word0 == HitData.word0)
+	{
+		return PxQueryHitType::eNONE;
+	}
+
+	// Simple or complex, as flagged in the low 24 bits of word3. The engine's filter skips shapes with none in common.
+	const PxU32 CommonFlags = (SuspensionData.word3 & 0xFFFFFF) & (HitData.word3 & 0xFFFFFF);
+	if (!(CommonFlags & (EPDF_SimpleCollision | EPDF_ComplexCollision)))
+	{
+		return PxQueryHitType::eNONE;
+	}
+
+	const ECollisionChannel SuspensionChannel = (ECollisionChannel)(SuspensionData.word3 >> 24);
+	if (ECC_TO_BITFIELD(SuspensionChannel) & HitData.word1)
+	{
+		return PxQueryHitType::eBLOCK;
+	}
+
+	return PxQueryHitType::eNONE;
+}
+
+static PxQueryHitType::Enum RejectAllPreFilter(PxFilterData SuspensionData, PxFilterData HitData, const void* ConstantBlock, PxU32 ConstantBlockSize, PxHitFlags& FilterFlags)
+{
+	return PxQueryHitType::eNONE;
+}
+
+struct FVehicleNWResimContext::FQueryBuffers
+{
+	TArray<PxRaycastQueryResult, TInlineAllocator<FVehicleNWSnapshot::MaxWheels>> Results;
+	TArray<PxRaycastHit, TInlineAllocator<FVehicleNWSnapshot::MaxWheels>> Hits;
+
+	FVehicleNWHeightfieldQuery HeightfieldQuery;
+	FVehicleNWHeightfieldQuery::FRayArray Rays;
+	FVehicleNWHeightfieldQuery::FHitArray GroundHits;
+};
+
+static PxBatchQuery* CreateSuspensionBatchQuery(PxScene& Scene, TArray<PxRaycastQueryResult, TInlineAllocator<FVehicleNWSnapshot::MaxWheels>>& Results,
+	TArray<PxRaycastHit, TInlineAllocator<FVehicleNWSnapshot::MaxWheels>>& Hits, PxBatchQueryPreFilterShader PreFilterShader)
+{
+	PxBatchQueryDesc QueryDesc(Results.Num(), 0, 0);
+	QueryDesc.queryMemory.userRaycastResultBuffer = Results.GetData();
+	QueryDesc.queryMemory.userRaycastTouchBuffer = Hits.GetData();
+	QueryDesc.queryMemory.raycastTouchBufferSize = Hits.Num();
+	QueryDesc.preFilterShader = PreFilterShader;
+	return Scene.createBatchQuery(QueryDesc);
+}
+
+FVehicleNWResimContext::FVehicleNWResimContext(PxVehicleDriveNW& InDrive)
+	: Drive(InDrive)
+	, BatchQuery(nullptr)
+	, HeightfieldBatchQuery(nullptr)
+	, bHeightfieldSuspension(false)
+	, QueryBuffers(MakeUnique<FQueryBuffers>())
+{
+	PxRigidDynamic* PRigidDynamic = Drive.getRigidDynamicActor();
+	PxScene* PScene = PRigidDynamic ? PRigidDynamic->getScene() : nullptr;
+	if (PScene == nullptr)
+	{
+		return;
+	}
+
+	const PxU32 NumWheels = Drive.mWheelsSimData.getNbWheels();
+	QueryBuffers->Results.AddZeroed(NumWheels);
+	QueryBuffers->Hits.AddZeroed(NumWheels);
+	BatchQuery = CreateSuspensionBatchQuery(*PScene, QueryBuffers->Results, QueryBuffers->Hits, WheelRaycastPreFilter);
+}
+
+FVehicleNWResimContext::~FVehicleNWResimContext()
+{
+	if (BatchQuery)
+	{
+		BatchQuery->release();
+	}
+	if (HeightfieldBatchQuery)
+	{
+		HeightfieldBatchQuery->release();
+	}
+}
+
+void FVehicleNWResimContext::SetHeightfieldSuspension(bool bEnable)
+{
+	bHeightfieldSuspension = bEnable;
+	if (bEnable && HeightfieldBatchQuery == nullptr && BatchQuery)
+	{
+		HeightfieldBatchQuery = CreateSuspensionBatchQuery(*Drive.getRigidDynamicActor()->getScene(), QueryBuffers->Results, QueryBuffers->Hits, RejectAllPreFilter);
+	}
+}
+
+bool FVehicleNWResimContext::SampleHeightfieldSuspension()
+{
+	FQueryBuffers& Buffers = *QueryBuffers;
+	if (!FVehicleNWHeightfieldQuery::GetSuspensionRays_AssumesLocked(Drive, Buffers.Rays)
+		|| !Buffers.HeightfieldQuery.Bind_AssumesLocked(Drive, Buffers.Rays)
+		|| !Buffers.HeightfieldQuery.Raycast_AssumesLocked(Buffers.Rays, Buffers.GroundHits))
+	{
+		return false;
+	}
+
+	// Finds nothing, but leaves the vehicle pointing to the result buffers for PxVehicleUpdates.
+	PxVehicleWheels* PVehicles[1] = { &Drive };
+	PxVehicleSuspensionRaycasts(HeightfieldBatchQuery, 1, PVehicles, Buffers.Results.Num(), Buffers.Results.GetData());
+
+	for (int32 WheelIdx = 0; WheelIdx < Buffers.GroundHits.Num(); ++WheelIdx)
+	{
+		const FVehicleNWGroundHit& GroundHit = Buffers.GroundHits[WheelIdx];
+		PxRaycastQueryResult& Result = Buffers.Results[WheelIdx];
+		if (GroundHit.Shape == nullptr)
+		{
+			continue;
+		}
+
+		PxRaycastHit& Block = Result.block;
+		Block.actor = GroundHit.Actor;
+		Block.shape = GroundHit.Shape;
+		Block.faceIndex = GroundHit.FaceIndex;
+		Block.flags = PxHitFlag::ePOSITION | PxHitFlag::eNORMAL | PxHitFlag::eDISTANCE;
+		Block.position = U2PVector(GroundHit.Position);
+		Block.normal = U2PVector(GroundHit.Normal);
+		Block.distance = GroundHit.Distance;
+		Result.hasBlock = true;
+	}
+	return true;
+}
+
+void FVehicleNWResimContext::Step(float DeltaTime)
+{
+	SCOPE_CYCLE_COUNTER(STAT_VehicleNW_ResimStep);
+
+	check(BatchQuery);
+
+	PxRigidDynamic* PRigidDynamic = Drive.getRigidDynamicActor();
+	PxVehicleWheels* PVehicles[1] = { &Drive };
+
+	if (bHeightfieldSuspension && HeightfieldBatchQuery && SampleHeightfieldSuspension())
+	{
+		INC_DWORD_STAT(STAT_VehicleNW_HeightfieldSteps);
+	}
+	else
+	{
+		if (bHeightfieldSuspension)
+		{
+			INC_DWORD_STAT(STAT_VehicleNW_HeightfieldFallbacks);
+		}
+		PxVehicleSuspensionRaycasts(BatchQuery, 1, PVehicles, QueryBuffers->Results.Num(), QueryBuffers->Results.GetData());
+	}
+
+	const PxVec3 Gravity = PRigidDynamic->getScene()->getGravity();
+	PxVehicleUpdates(DeltaTime, Gravity, *FVehicleNWFrictionTable::Get().GetFrictionPairs(), 1, PVehicles, nullptr);
+
+	// What the scene simulation would do next, without contacts.
+	const PxVec3 LinearVelocity = PRigidDynamic->getLinearVelocity() + Gravity * DeltaTime;
+	const PxVec3 AngularVelocity = PRigidDynamic->getAngularVelocity();
+	PxTransform Pose = PRigidDynamic->getGlobalPose();
+	Pose.p += LinearVelocity * DeltaTime;
+	const PxQuat Spin(AngularVelocity.x, AngularVelocity.y, AngularVelocity.z, 0.f);
+	Pose.q = (Pose.q + Spin * Pose.q * (0.5f * DeltaTime)).getNormalized();
+
+	PRigidDynamic->setLinearVelocity(LinearVelocity);
+	PRigidDynamic->setGlobalPose(Pose);
+}
+
+#endif // WITH_PHYSX_VEHICLES
@@ -0,0 +1,131 @@
+// Copyright Unreal Engine Community.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+#if WITH_PHYSX_VEHICLES
+namespace physx
+{
+	class PxVehicleDriveNW;
+	class PxBatchQuery;
+}
+#endif // WITH_PHYSX_VEHICLES
+
+/** Inputs UpdateSimulation hands to PhysX for one physics step. */
+struct FVehicleNWInputFrame
+{
+	float DeltaTime;
+	float Throttle;
+	float Steering;
+	float Brake;
+	float Handbrake;
+	uint8 bGearUp;
+	uint8 bGearDown;
+};
+
+/**
+ * Simulation state of a UVehicleMovementComponentNW at the start of a physics step.
+ *
+ * Plain data, copied with memcpy. PhysX keeps suspension jounces and low speed tire timers in per wheel data it does
+ * not expose; they are rebuilt by the next update, so a restored vehicle can differ from the original by one step
+ * of suspension damping.
+ */
+struct MYVEHICLEPROJECT_API FVehicleNWSnapshot
+{
+	// PX_MAX_NB_WHEELS.
+	static const int32 MaxWheels = 20;
+
+	// Room for a raw copy of PxVehicleDriveDynData, in 32 bit words.
+	static const int32 DriveDynDataWords = 32;
+
+	// Frame the snapshot belongs to, INDEX_NONE if unused.
+	int32 Frame;
+
+	int32 NumWheels;
+
+	// Rigid body, PhysX units. Position, rotation (x, y, z, w).
+	float BodyPose[7];
+	float LinearVelocity[3];
+	float AngularVelocity[3];
+
+	// Gears, engine speed, smoothed analog inputs.
+	uint32 DriveDynData[DriveDynDataWords];
+
+	float WheelRotationSpeeds[MaxWheels];
+	float WheelRotationAngles[MaxWheels];
+
+	// Component inputs, as fed to the input smoothing.
+	FVehicleNWInputFrame Inputs;
+
+	// Reduced LOD input accumulation.
+	int32 ReducedLODStepCounter;
+	float ReducedLODAccumulatedTime;
+
+	/** Hash of the rigid body, drive and wheel state. Inputs and LOD counters are left out. */
+	uint32 HashSimulationState() const;
+};
+
+/** Fixed number of snapshots indexed by frame, allocated once. */
+class MYVEHICLEPROJECT_API FVehicleNWSnapshotRing
+{
+public:
+
+	void Allocate(int32 Capacity);
+
+	int32 GetCapacity() const { return Snapshots.Num(); }
+
+	/** Slot for Frame, overwriting the oldest one. Null if the ring is not allocated. */
+	FVehicleNWSnapshot* Write(int32 Frame);
+
+	/** Snapshot of Frame, null if it was never written or has been overwritten. */
+	const FVehicleNWSnapshot* Find(int32 Frame) const;
+
+	/** Forget every snapshot, keeps the memory. */
+	void Reset();
+
+private:
+
+	TArray<FVehicleNWSnapshot> Snapshots;
+};
+
+#if WITH_PHYSX_VEHICLES
+/**
+ * Steps a single PxVehicleDriveNW outside of FPhysXVehicleManager and the scene simulation, for resimulation:
+ * suspension raycasts through its own batch query, PxVehicleUpdates with FVehicleNWFrictionTable, then gravity and
+ * explicit integration of the chassis pose. Chassis contacts are not solved. Scene write lock must be held.
+ *
+ * With heightfield suspension on, steps where the landscape is all the wheels can reach take their suspension hits
+ * from FVehicleNWHeightfieldQuery, other steps raycast as usual.
+ */
+class MYVEHICLEPROJECT_API FVehicleNWResimContext
+{
+public:
+
+	explicit FVehicleNWResimContext(physx::PxVehicleDriveNW& InDrive);
+	~FVehicleNWResimContext();
+
+	bool IsValid() const { return BatchQuery != nullptr; }
+
+	void Step(float DeltaTime);
+
+	void SetHeightfieldSuspension(bool bEnable);
+
+private:
+
+	physx::PxVehicleDriveNW& Drive;
+	physx::PxBatchQuery* BatchQuery;
+
+	// Rejects every shape. Run when the heightfield answered, so PxVehicleSuspensionRaycasts still hands the vehicle
+	// the result buffers, which are then filled with the sampled hits. Created when heightfield suspension is first enabled.
+	physx::PxBatchQuery* HeightfieldBatchQuery;
+	bool bHeightfieldSuspension;
+
+	/** Fill the raycast results from the heightfield. False, with nothing written, if scene queries are needed. */
+	bool SampleHeightfieldSuspension();
+
+	// One raycast result and hit per wheel.
+	struct FQueryBuffers;
+	TUniquePtr<FQueryBuffers> QueryBuffers;
+};
+#endif // WITH_PHYSX_VEHICLES
@@ -0,0 +1,54 @@
+// Copyright Unreal Engine Community.
+
+#include "VehicleNWStats.h"
+
+DEFINE_STAT(STAT_VehicleNW_SetupVehicle);
+DEFINE_STAT(STAT_VehicleNW_UpdateSimulation);
+DEFINE_STAT(STAT_VehicleNW_UpdateEngineSetup);
+DEFINE_STAT(STAT_VehicleNW_UpdateTransmissionSetup);
+DEFINE_STAT(STAT_VehicleNW_UpdateDifferentialSetup);
+DEFINE_STAT(STAT_VehicleNW_ActorTick);
+DEFINE_STAT(STAT_VehicleNW_LockWait);
+DEFINE_STAT(STAT_VehicleNW_LockHold);
+DEFINE_STAT(STAT_VehicleNW_VehiclesSimulated);
+DEFINE_STAT(STAT_VehicleNW_Wheels2To4);
+DEFINE_STAT(STAT_VehicleNW_Wheels5To8);
+DEFINE_STAT(STAT_VehicleNW_Wheels9To12);
+DEFINE_STAT(STAT_VehicleNW_Wheels13To16);
+DEFINE_STAT(STAT_VehicleNW_Wheels17To20);
+
+CSV_DEFINE_CATEGORY_MODULE(MYVEHICLEPROJECT_API, VehicleNW, true);
+
+DEFINE_LOG_CATEGORY(LogVehicleNW);
+
+void VehicleNWStats::CountVehicleSimulated(int32 NumWheels)
+{
+	INC_DWORD_STAT(STAT_VehicleNW_VehiclesSimulated);
+	CSV_CUSTOM_STAT(VehicleNW, VehiclesSimulated, 1, ECsvCustomStatOp::Accumulate);
+
+	if (NumWheels <= 4)
+	{
+		INC_DWORD_STAT(STAT_VehicleNW_Wheels2To4);
+		CSV_CUSTOM_STAT(VehicleNW, Wheels2To4, 1, ECsvCustomStatOp::Accumulate);
+	}
+	else if (NumWheels <= 8)
+	{
+		INC_DWORD_STAT(STAT_VehicleNW_Wheels5To8);
+		CSV_CUSTOM_STAT(VehicleNW, Wheels5To8, 1, ECsvCustomStatOp::Accumulate);
+	}
+	else if (NumWheels <= 12)
+	{
+		INC_DWORD_STAT(STAT_VehicleNW_Wheels9To12);
+		CSV_CUSTOM_STAT(VehicleNW, Wheels9To12, 1, ECsvCustomStatOp::Accumulate);
+	}
+	else if (NumWheels <= 16)
+	{
+		INC_DWORD_STAT(STAT_VehicleNW_Wheels13To16);
+		CSV_CUSTOM_STAT(VehicleNW, Wheels13To16, 1, ECsvCustomStatOp::Accumulate);
+	}
+	else
+	{
+		INC_DWORD_STAT(STAT_VehicleNW_Wheels17To20);
+		CSV_CUSTOM_STAT(VehicleNW, Wheels17To20, 1, ECsvCustomStatOp::Accumulate);
+	}
+}
@@ -0,0 +1,80 @@
+// Copyright Unreal Engine Community.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Stats/Stats.h"
+#include "ProfilingDebugging/CsvProfiler.h"
+
+DECLARE_STATS_GROUP(TEXT("VehicleNW"), STATGROUP_VehicleNW, STATCAT_Advanced);
+
+DECLARE_CYCLE_STAT_EXTERN(TEXT("SetupVehicle"), STAT_VehicleNW_SetupVehicle, STATGROUP_VehicleNW, MYVEHICLEPROJECT_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("UpdateSimulation"), STAT_VehicleNW_UpdateSimulation, STATGROUP_VehicleNW, MYVEHICLEPROJECT_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("UpdateEngineSetup"), STAT_VehicleNW_UpdateEngineSetup, STATGROUP_VehicleNW, MYVEHICLEPROJECT_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("UpdateTransmissionSetup"), STAT_VehicleNW_UpdateTransmissionSetup, STATGROUP_VehicleNW, MYVEHICLEPROJECT_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("UpdateDifferentialSetup"), STAT_VehicleNW_UpdateDifferentialSetup, STATGROUP_VehicleNW, MYVEHICLEPROJECT_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Vehicle Actor Tick"), STAT_VehicleNW_ActorTick, STATGROUP_VehicleNW, MYVEHICLEPROJECT_API);
+
+DECLARE_FLOAT_COUNTER_STAT_EXTERN(TEXT("Physics Lock Wait (ms)"), STAT_VehicleNW_LockWait, STATGROUP_VehicleNW, MYVEHICLEPROJECT_API);
+DECLARE_FLOAT_COUNTER_STAT_EXTERN(TEXT("Physics Lock Hold (ms)"), STAT_VehicleNW_LockHold, STATGROUP_VehicleNW, MYVEHICLEPROJECT_API);
+
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Vehicles Simulated"), STAT_VehicleNW_VehiclesSimulated, STATGROUP_VehicleNW, MYVEHICLEPROJECT_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Vehicles 2-4 Wheels"), STAT_VehicleNW_Wheels2To4, STATGROUP_VehicleNW, MYVEHICLEPROJECT_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Vehicles 5-8 Wheels"), STAT_VehicleNW_Wheels5To8, STATGROUP_VehicleNW, MYVEHICLEPROJECT_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Vehicles 9-12 Wheels"), STAT_VehicleNW_Wheels9To12, STATGROUP_VehicleNW, MYVEHICLEPROJECT_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Vehicles 13-16 Wheels"), STAT_VehicleNW_Wheels13To16, STATGROUP_VehicleNW, MYVEHICLEPROJECT_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Vehicles 17-20 Wheels"), STAT_VehicleNW_Wheels17To20, STATGROUP_VehicleNW, MYVEHICLEPROJECT_API);
+
+CSV_DECLARE_CATEGORY_MODULE_EXTERN(MYVEHICLEPROJECT_API, VehicleNW);
+
+// Verbose and VeryVerbose messages are compiled out, hot path logging uses VeryVerbose.
+DECLARE_LOG_CATEGORY_EXTERN(LogVehicleNW, Log, Log);
+
+namespace VehicleNWStats
+{
+	/** Count one simulated vehicle, bucketed by its number of wheels. */
+	MYVEHICLEPROJECT_API void CountVehicleSimulated(int32 NumWheels);
+}
+
+/**
+ * Accounts the time spent waiting for a physics lock (construction until Acquired) and holding it (Acquired until destruction).
+ *
+ *	FVehicleNWLockTimer LockTimer;
+ *	FPhysicsCommand::ExecuteWrite(Actor, [&](const FPhysicsActorHandle&) { LockTimer.Acquired(); ... });
+ */
+struct FVehicleNWLockTimer
+{
+#if STATS || CSV_PROFILER
+	FVehicleNWLockTimer()
+		: RequestCycles(FPlatformTime::Cycles())
+		, AcquiredCycles(0)
+	{
+	}
+
+	void Acquired()
+	{
+		AcquiredCycles = FPlatformTime::Cycles();
+	}
+
+	~FVehicleNWLockTimer()
+	{
+		if (AcquiredCycles == 0)
+		{
+			return;
+		}
+
+		const float WaitMs = FPlatformTime::ToMilliseconds(AcquiredCycles - RequestCycles);
+		const float HoldMs = FPlatformTime::ToMilliseconds(FPlatformTime::Cycles() - AcquiredCycles);
+		INC_FLOAT_STAT_BY(STAT_VehicleNW_LockWait, WaitMs);
+		INC_FLOAT_STAT_BY(STAT_VehicleNW_LockHold, HoldMs);
+		CSV_CUSTOM_STAT(VehicleNW, LockWaitMs, WaitMs, ECsvCustomStatOp::Accumulate);
+		CSV_CUSTOM_STAT(VehicleNW, LockHoldMs, HoldMs, ECsvCustomStatOp::Accumulate);
+	}
+
+private:
+	uint32 RequestCycles;
+	uint32 AcquiredCycles;
+#else
+	void Acquired() {}
+#endif // STATS || CSV_PROFILER
+};
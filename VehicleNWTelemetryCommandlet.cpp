@@ -0,0 +1,198 @@
+// Copyright Unreal Engine Community.
+
+#include "VehicleNWTelemetryCommandlet.h"
+#include "VehicleNWTelemetryRecorder.h"
+#include "HAL/FileManager.h"
+#include "HAL/PlatformFilemanager.h"
+#include "Async/MappedFileHandle.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogVehicleNWTelemetry, Log, All);
+
+namespace VehicleNWTelemetryReader
+{
+	struct FVehicleStats
+	{
+		int64 NumRecords = 0;
+		int32 NumGearShifts = 0;
+		int32 LastGear = 0;
+		double FirstTime = 0.0;
+		double LastTime = 0.0;
+		float MaxEngineRPM = 0.f;
+		float MaxLongitudinalSlip = 0.f;
+		float MaxLateralSlip = 0.f;
+	};
+
+	/** Bytes of a file, mapped when the platform supports it, loaded otherwise. */
+	class FFileView
+	{
+	public:
+
+		bool Open(const FString& Filename)
+		{
+			MappedFile.Reset(FPlatformFileManager::Get().GetPlatformFile().OpenMapped(*Filename));
+			if (MappedFile.IsValid())
+			{
+				MappedRegion.Reset(MappedFile->MapRegion());
+			}
+			if (MappedRegion.IsValid())
+			{
+				Data = MappedRegion->GetMappedPtr();
+				Size = MappedRegion->GetMappedSize();
+				return true;
+			}
+
+			if (!FFileHelper::LoadFileToArray(LoadedData, *Filename))
+			{
+				return false;
+			}
+			Data = LoadedData.GetData();
+			Size = LoadedData.Num();
+			return true;
+		}
+
+		const uint8* Data = nullptr;
+		int64 Size = 0;
+
+	private:
+
+		TUniquePtr<IMappedFileHandle> MappedFile;
+		TUniquePtr<IMappedFileRegion> MappedRegion;
+		TArray<uint8> LoadedData;
+	};
+}
+
+UVehicleNWTelemetryCommandlet::UVehicleNWTelemetryCommandlet(const FObjectInitializer& ObjectInitializer)
+	: Super(ObjectInitializer)
+{
+	IsClient = false;
+	IsServer = false;
+	IsEditor = false;
+	LogToConsole = true;
+}
+
+int32 UVehicleNWTelemetryCommandlet::Main(const FString& Params)
+{
+	using namespace VehicleNWTelemetryReader;
+
+	FString Filename = FPaths::ProjectSavedDir() / TEXT("VehicleNWTelemetry.vnwt");
+	FParse::Value(*Params, TEXT("File="), Filename);
+
+	FString CsvFilename;
+	FParse::Value(*Params, TEXT("Csv="), CsvFilename);
+
+	FFileView File;
+	if (!File.Open(Filename) || File.Size < (int64)sizeof(FVehicleNWTelemetryFileHeader))
+	{
+		UE_LOG(LogVehicleNWTelemetry, Error, TEXT("Cannot read %s"), *Filename);
+		return 1;
+	}
+
+	const FVehicleNWTelemetryFileHeader& FileHeader = *(const FVehicleNWTelemetryFileHeader*)File.Data;
+	if (FileHeader.Magic != VehicleNWTelemetry::FileMagic || FileHeader.Version != VehicleNWTelemetry::Version
+		|| FileHeader.RecordSize != sizeof(FVehicleNWTelemetryRecord) || FileHeader.WheelSize != sizeof(FVehicleNWTelemetryWheel))
+	{
+		UE_LOG(LogVehicleNWTelemetry, Error, TEXT("%s is not a version %u telemetry file"), *Filename, VehicleNWTelemetry::Version);
+		return 1;
+	}
+
+	TUniquePtr<FArchive> CsvFile;
+	if (!CsvFilename.IsEmpty())
+	{
+		CsvFile.Reset(IFileManager::Get().CreateFileWriter(*CsvFilename));
+		if (!CsvFile)
+		{
+			UE_LOG(LogVehicleNWTelemetry, Error, TEXT("Cannot write %s"), *CsvFilename);
+			return 1;
+		}
+
+		const FTCHARToUTF8 CsvHeader(TEXT("Time,VehicleId,DeltaTime,Gear,EngineRPM,ForwardSpeed,Throttle,Steering,Brake,Handbrake,Wheel,LongitudinalSlip,LateralSlip,SuspensionOffset\n"));
+		CsvFile->Serialize((void*)CsvHeader.Get(), CsvHeader.Length());
+	}
+
+	TMap<uint32, FVehicleStats> VehicleStats;
+	int32 NumChunks = 0;
+	int64 NumRecords = 0;
+	int64 NumDropped = 0;
+
+	int64 Offset = sizeof(FVehicleNWTelemetryFileHeader);
+	while (Offset + (int64)sizeof(FVehicleNWTelemetryChunkHeader) <= File.Size)
+	{
+		const FVehicleNWTelemetryChunkHeader& ChunkHeader = *(const FVehicleNWTelemetryChunkHeader*)(File.Data + Offset);
+		const int64 PayloadOffset = Offset + sizeof(FVehicleNWTelemetryChunkHeader);
+		if (ChunkHeader.Magic != VehicleNWTelemetry::ChunkMagic || PayloadOffset + ChunkHeader.PayloadSize > File.Size)
+		{
+			UE_LOG(LogVehicleNWTelemetry, Warning, TEXT("Truncated or corrupt chunk at offset %lld, stopping"), Offset);
+			break;
+		}
+
+		NumChunks++;
+		NumDropped += ChunkHeader.NumDropped;
+
+		const uint8* Data = File.Data + PayloadOffset;
+		const uint8* DataEnd = Data + ChunkHeader.PayloadSize;
+		for (uint32 RecordIdx = 0; RecordIdx < ChunkHeader.NumRecords && Data + sizeof(FVehicleNWTelemetryRecord) <= DataEnd; RecordIdx++)
+		{
+			const FVehicleNWTelemetryRecord& Record = *(const FVehicleNWTelemetryRecord*)Data;
+			const FVehicleNWTelemetryWheel* Wheels = (const FVehicleNWTelemetryWheel*)(Data + sizeof(FVehicleNWTelemetryRecord));
+			Data += Align(sizeof(FVehicleNWTelemetryRecord) + Record.NumWheels * sizeof(FVehicleNWTelemetryWheel), 8);
+			if (Data > DataEnd)
+			{
+				break;
+			}
+
+			NumRecords++;
+
+			FVehicleStats& Stats = VehicleStats.FindOrAdd(Record.VehicleId);
+			if (Stats.NumRecords == 0)
+			{
+				Stats.FirstTime = Record.Time;
+				Stats.LastGear = Record.Gear;
+			}
+			Stats.NumRecords++;
+			Stats.NumGearShifts += Record.Gear != Stats.LastGear ? 1 : 0;
+			Stats.LastGear = Record.Gear;
+			Stats.LastTime = Record.Time;
+			Stats.MaxEngineRPM = FMath::Max(Stats.MaxEngineRPM, Record.EngineRPM);
+
+			for (int32 WheelIdx = 0; WheelIdx < Record.NumWheels; WheelIdx++)
+			{
+				const FVehicleNWTelemetryWheel& Wheel = Wheels[WheelIdx];
+				Stats.MaxLongitudinalSlip = FMath::Max(Stats.MaxLongitudinalSlip, FMath::Abs(Wheel.LongitudinalSlip));
+				Stats.MaxLateralSlip = FMath::Max(Stats.MaxLateralSlip, FMath::Abs(Wheel.LateralSlip));
+
+				if (CsvFile)
+				{
+					const FTCHARToUTF8 Row(*FString::Printf(TEXT("%.6f,%u,%.6f,%d,%.1f,%.2f,%.3f,%.3f,%.3f,%.3f,%d,%.4f,%.4f,%.3f\n"),
+						Record.Time, Record.VehicleId, Record.DeltaTime, Record.Gear, Record.EngineRPM, Record.ForwardSpeed,
+						Record.Throttle, Record.Steering, Record.Brake, Record.Handbrake,
+						WheelIdx, Wheel.LongitudinalSlip, Wheel.LateralSlip, Wheel.SuspensionOffset));
+					CsvFile->Serialize((void*)Row.Get(), Row.Length());
+				}
+			}
+		}
+
+		Offset = PayloadOffset + ChunkHeader.PayloadSize;
+	}
+
+	UE_LOG(LogVehicleNWTelemetry, Display, TEXT("%s: %lld bytes, %d chunks, %lld records, %lld dropped, %d vehicles"),
+		*Filename, File.Size, NumChunks, NumRecords, NumDropped, VehicleStats.Num());
+
+	for (const TPair<uint32, FVehicleStats>& Pair : VehicleStats)
+	{
+		const FVehicleStats& Stats = Pair.Value;
+		const double Duration = Stats.LastTime - Stats.FirstTime;
+		UE_LOG(LogVehicleNWTelemetry, Display, TEXT("  vehicle %u: %lld samples over %.2fs (%.0f Hz), %d gear shifts, max %.0f RPM, max slip %.3f long %.3f lat"),
+			Pair.Key, Stats.NumRecords, Duration, Duration > 0.0 ? Stats.NumRecords / Duration : 0.0,
+			Stats.NumGearShifts, Stats.MaxEngineRPM, Stats.MaxLongitudinalSlip, Stats.MaxLateralSlip);
+	}
+
+	if (CsvFile)
+	{
+		CsvFile->Close();
+		UE_LOG(LogVehicleNWTelemetry, Display, TEXT("Wrote %s"), *CsvFilename);
+	}
+
+	return 0;
+}
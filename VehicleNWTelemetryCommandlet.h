@@ -0,0 +1,25 @@
+// Copyright Unreal Engine Community.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "VehicleNWTelemetryCommandlet.generated.h"
+
+/**
+ * Offline reader for files written by p.VehicleNW.Telemetry.
+ *
+ * Maps the file, walks its chunks and logs per vehicle statistics (samples, gear shifts, peak RPM and slips).
+ * Optionally converts it to CSV, one row per wheel sample.
+ *
+ * UE4Editor-Cmd <Project> -run=VehicleNWTelemetry -File=<Saved/VehicleNWTelemetry.vnwt> [-Csv=<Output.csv>]
+ */
+UCLASS()
+class MYVEHICLEPROJECT_API UVehicleNWTelemetryCommandlet : public UCommandlet
+{
+	GENERATED_UCLASS_BODY()
+
+	// Begin UCommandlet interface
+	virtual int32 Main(const FString& Params) override;
+	// End UCommandlet interface
+};
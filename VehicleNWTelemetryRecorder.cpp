@@ -0,0 +1,281 @@
+// Copyright Unreal Engine Community.
+
+#include "VehicleNWTelemetryRecorder.h"
+#include "VehicleNWStats.h"
+#include "HAL/FileManager.h"
+#include "HAL/PlatformProcess.h"
+#include "HAL/PlatformTime.h"
+#include "HAL/RunnableThread.h"
+#include "Misc/CoreDelegates.h"
+#include "Misc/Paths.h"
+#include "Misc/ScopeLock.h"
+
+DECLARE_DWORD_COUNTER_STAT(TEXT("Telemetry Samples"), STAT_VehicleNW_TelemetrySamples, STATGROUP_VehicleNW);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Telemetry Samples Dropped"), STAT_VehicleNW_TelemetryDropped, STATGROUP_VehicleNW);
+
+static_assert(sizeof(FVehicleNWTelemetryFileHeader) % 8 == 0, "Telemetry headers keep records 8 byte aligned.");
+static_assert(sizeof(FVehicleNWTelemetryChunkHeader) % 8 == 0, "Telemetry headers keep records 8 byte aligned.");
+static_assert(sizeof(FVehicleNWTelemetryRecord) % 8 == 0, "FVehicleNWTelemetryRecord must keep Time 8 byte aligned.");
+static_assert(TIsPODType<FVehicleNWTelemetrySample>::Value, "Telemetry samples go through the ring by copy.");
+
+static TAutoConsoleVariable<int32> CVarVehicleNWTelemetryRingSize(
+	TEXT("p.VehicleNW.TelemetryRingSize"),
+	65536,
+	TEXT("Number of samples the telemetry ring of each world holds before dropping. Rounded up to a power of two, one sample is 288 bytes."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarVehicleNWTelemetryChunkSize(
+	TEXT("p.VehicleNW.TelemetryChunkSize"),
+	4 * 1024 * 1024,
+	TEXT("Size in bytes of the chunks telemetry is written in."),
+	ECVF_Default);
+
+// Partially filled chunks are written after this long, so a crash loses at most that much.
+static const double TelemetryMaxChunkAge = 1.0;
+
+TAtomic<FVehicleNWTelemetryRecorder*> FVehicleNWTelemetryRecorder::Active(nullptr);
+FThreadSafeCounter FVehicleNWTelemetryRecorder::NumAccesses;
+
+FVehicleNWTelemetryRecorder::FScopedAccess::FScopedAccess()
+{
+	// Counted before Active is read: StopRecording clears Active first, then waits for the count to drop.
+	NumAccesses.Increment();
+	Recorder = Active.Load();
+	if (Recorder == nullptr)
+	{
+		NumAccesses.Decrement();
+	}
+}
+
+FVehicleNWTelemetryRecorder::FScopedAccess::~FScopedAccess()
+{
+	if (Recorder)
+	{
+		NumAccesses.Decrement();
+	}
+}
+
+bool FVehicleNWTelemetryRecorder::StartRecording(const FString& Filename, int32 RingCapacity, int32 ChunkSize)
+{
+	check(IsInGameThread());
+	if (Active.Load())
+	{
+		return false;
+	}
+
+	FArchive* File = IFileManager::Get().CreateFileWriter(*Filename);
+	if (File == nullptr)
+	{
+		return false;
+	}
+
+	FVehicleNWTelemetryFileHeader Header;
+	Header.Magic = VehicleNWTelemetry::FileMagic;
+	Header.Version = VehicleNWTelemetry::Version;
+	Header.RecordSize = sizeof(FVehicleNWTelemetryRecord);
+	Header.WheelSize = sizeof(FVehicleNWTelemetryWheel);
+	File->Serialize(&Header, sizeof(Header));
+
+	// Published last, producers only see a complete recorder.
+	FVehicleNWTelemetryRecorder* Recorder = new FVehicleNWTelemetryRecorder(File, RingCapacity, ChunkSize);
+	Recorder->Thread = FRunnableThread::Create(Recorder, TEXT("VehicleNWTelemetry"), 0, TPri_BelowNormal);
+	Active.Store(Recorder);
+
+	// Close the file cleanly if the game exits while recording.
+	static FDelegateHandle PreExitHandle = FCoreDelegates::OnPreExit.AddStatic(&FVehicleNWTelemetryRecorder::StopRecording);
+	return true;
+}
+
+void FVehicleNWTelemetryRecorder::StopRecording()
+{
+	check(IsInGameThread());
+	FVehicleNWTelemetryRecorder* Recorder = Active.Exchange(nullptr);
+	if (Recorder == nullptr)
+	{
+		return;
+	}
+
+	// New scopes no longer see the recorder, wait for producers still pushing to it before the writer drains the rings.
+	while (NumAccesses.GetValue() > 0)
+	{
+		FPlatformProcess::YieldThread();
+	}
+	delete Recorder;
+}
+
+FVehicleNWTelemetryRecorder::FProducer::FProducer(const UWorld* InWorld, int32 Capacity, FThreadSafeCounter& InNumDropped)
+	: World(InWorld)
+	, Queue(FMath::Max(Capacity, 2))
+	, NumDropped(InNumDropped)
+{
+}
+
+FVehicleNWTelemetryRecorder::FVehicleNWTelemetryRecorder(FArchive* InFile, int32 InRingCapacity, int32 InChunkSize)
+	: NumProducers(0)
+	, RingCapacity(InRingCapacity)
+	, File(InFile)
+	, Thread(nullptr)
+	, ChunkSize(FMath::Max(InChunkSize, (int32)sizeof(FVehicleNWTelemetrySample)))
+	, ChunkRecords(0)
+	, LastWriteTime(FPlatformTime::Seconds())
+	, NumDroppedWritten(0)
+	, NumRecordsWritten(0)
+{
+	// Room for one sample past the chunk size, appending never reallocates.
+	Chunk.Reserve(sizeof(FVehicleNWTelemetryChunkHeader) + ChunkSize + sizeof(FVehicleNWTelemetrySample));
+	Chunk.AddZeroed(sizeof(FVehicleNWTelemetryChunkHeader));
+}
+
+FVehicleNWTelemetryRecorder::~FVehicleNWTelemetryRecorder()
+{
+	if (Thread)
+	{
+		Thread->Kill(true);
+		delete Thread;
+	}
+
+	File->Close();
+	UE_LOG(LogVehicleNW, Display, TEXT("Telemetry: %lld records written, %d dropped"), NumRecordsWritten, NumDropped.GetValue());
+}
+
+FVehicleNWTelemetryRecorder::FProducer* FVehicleNWTelemetryRecorder::GetProducer(const UWorld* World)
+{
+	// Published rings are looked up without the lock, they never move or go away while recording.
+	const int32 NumPublished = NumProducers.Load();
+	for (int32 ProducerIdx = 0; ProducerIdx < NumPublished; ProducerIdx++)
+	{
+		if (Producers[ProducerIdx]->World == World)
+		{
+			return Producers[ProducerIdx].Get();
+		}
+	}
+
+	FScopeLock Lock(&ProducersLock);
+	const int32 NumCreated = NumProducers.Load();
+	for (int32 ProducerIdx = NumPublished; ProducerIdx < NumCreated; ProducerIdx++)
+	{
+		if (Producers[ProducerIdx]->World == World)
+		{
+			return Producers[ProducerIdx].Get();
+		}
+	}
+	if (NumCreated == MaxWorlds)
+	{
+		return nullptr;
+	}
+
+	Producers[NumCreated].Reset(new FProducer(World, RingCapacity, NumDropped));
+	NumProducers.Store(NumCreated + 1);
+	return Producers[NumCreated].Get();
+}
+
+bool FVehicleNWTelemetryRecorder::FProducer::Push(const FVehicleNWTelemetrySample& Sample)
+{
+	if (!Queue.Enqueue(Sample))
+	{
+		NumDropped.Increment();
+		INC_DWORD_STAT(STAT_VehicleNW_TelemetryDropped);
+		return false;
+	}
+
+	INC_DWORD_STAT(STAT_VehicleNW_TelemetrySamples);
+	return true;
+}
+
+uint32 FVehicleNWTelemetryRecorder::Run()
+{
+	while (!bStopping)
+	{
+		if (Drain() == 0)
+		{
+			if (ChunkRecords > 0 && FPlatformTime::Seconds() - LastWriteTime > TelemetryMaxChunkAge)
+			{
+				WriteChunk();
+			}
+			FPlatformProcess::Sleep(0.001f);
+		}
+	}
+
+	// The producers are gone, take what is left.
+	Drain();
+	if (ChunkRecords > 0)
+	{
+		WriteChunk();
+	}
+	return 0;
+}
+
+void FVehicleNWTelemetryRecorder::Stop()
+{
+	bStopping = true;
+}
+
+int32 FVehicleNWTelemetryRecorder::Drain()
+{
+	int32 NumDrained = 0;
+	FVehicleNWTelemetrySample Sample;
+	const int32 NumPublished = NumProducers.Load();
+	for (int32 ProducerIdx = 0; ProducerIdx < NumPublished; ProducerIdx++)
+	{
+		TCircularQueue<FVehicleNWTelemetrySample>& Queue = Producers[ProducerIdx]->Queue;
+		while (Queue.Dequeue(Sample))
+		{
+			const int32 NumWheels = FMath::Min<int32>(Sample.Record.NumWheels, VehicleNWTelemetry::MaxWheels);
+			const int32 WheelsSize = NumWheels * sizeof(FVehicleNWTelemetryWheel);
+			const int32 RecordSize = Align(sizeof(FVehicleNWTelemetryRecord) + WheelsSize, 8);
+
+			uint8* Data = &Chunk[Chunk.AddZeroed(RecordSize)];
+			FMemory::Memcpy(Data, &Sample.Record, sizeof(FVehicleNWTelemetryRecord));
+			FMemory::Memcpy(Data + sizeof(FVehicleNWTelemetryRecord), Sample.Wheels, WheelsSize);
+			ChunkRecords++;
+			NumDrained++;
+
+			if (Chunk.Num() - (int32)sizeof(FVehicleNWTelemetryChunkHeader) >= ChunkSize)
+			{
+				WriteChunk();
+			}
+		}
+	}
+	return NumDrained;
+}
+
+void FVehicleNWTelemetryRecorder::WriteChunk()
+{
+	const int32 Dropped = NumDropped.GetValue();
+
+	FVehicleNWTelemetryChunkHeader& Header = *(FVehicleNWTelemetryChunkHeader*)Chunk.GetData();
+	Header.Magic = VehicleNWTelemetry::ChunkMagic;
+	Header.NumRecords = ChunkRecords;
+	Header.PayloadSize = Chunk.Num() - sizeof(FVehicleNWTelemetryChunkHeader);
+	Header.NumDropped = Dropped - NumDroppedWritten;
+
+	File->Serialize(Chunk.GetData(), Chunk.Num());
+	File->Flush();
+
+	NumRecordsWritten += ChunkRecords;
+	NumDroppedWritten = Dropped;
+	ChunkRecords = 0;
+	LastWriteTime = FPlatformTime::Seconds();
+	Chunk.SetNum(sizeof(FVehicleNWTelemetryChunkHeader), false);
+}
+
+static FAutoConsoleCommand VehicleNWTelemetryCommand(
+	TEXT("p.VehicleNW.Telemetry"),
+	TEXT("Stream the telemetry of every NW vehicle step to a file, read it back with -run=VehicleNWTelemetry.\n")
+	TEXT("p.VehicleNW.Telemetry Start [Filename=Saved/VehicleNWTelemetry.vnwt] | Stop"),
+	FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+	{
+		if (Args.Num() > 0 && Args[0] == TEXT("Stop"))
+		{
+			FVehicleNWTelemetryRecorder::StopRecording();
+			return;
+		}
+
+		const FString Filename = Args.Num() > 1 ? Args[1] : FPaths::ProjectSavedDir() / TEXT("VehicleNWTelemetry.vnwt");
+		if (!FVehicleNWTelemetryRecorder::StartRecording(Filename, CVarVehicleNWTelemetryRingSize.GetValueOnGameThread(), CVarVehicleNWTelemetryChunkSize.GetValueOnGameThread()))
+		{
+			UE_LOG(LogVehicleNW, Warning, TEXT("Telemetry: cannot record to %s"), *Filename);
+			return;
+		}
+		UE_LOG(LogVehicleNW, Display, TEXT("Telemetry: recording to %s"), *Filename);
+	}));
@@ -0,0 +1,183 @@
+// Copyright Unreal Engine Community.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Containers/CircularQueue.h"
+#include "HAL/CriticalSection.h"
+#include "HAL/Runnable.h"
+#include "HAL/ThreadSafeBool.h"
+#include "HAL/ThreadSafeCounter.h"
+#include "Templates/Atomic.h"
+
+class UWorld;
+
+/**
+ * Telemetry file layout. Everything is little endian and naturally aligned, so a file can be memory mapped and walked
+ * in place:
+ *
+ *   FVehicleNWTelemetryFileHeader
+ *   chunk*: FVehicleNWTelemetryChunkHeader, then NumRecords times
+ *           FVehicleNWTelemetryRecord, NumWheels times FVehicleNWTelemetryWheel, padding to 8 bytes.
+ */
+namespace VehicleNWTelemetry
+{
+	static const uint32 FileMagic = 0x544E5756; // 'VWNT'
+	static const uint32 ChunkMagic = 0x4B4E4843; // 'CHNK'
+	static const uint32 Version = 1;
+	static const int32 MaxWheels = 20;
+}
+
+struct FVehicleNWTelemetryFileHeader
+{
+	uint32 Magic;
+	uint32 Version;
+	uint32 RecordSize;
+	uint32 WheelSize;
+};
+
+struct FVehicleNWTelemetryChunkHeader
+{
+	uint32 Magic;
+	uint32 NumRecords;
+	// Bytes following this header, padding included.
+	uint32 PayloadSize;
+	uint32 NumDropped;
+};
+
+/** One simulation step of one vehicle. */
+struct FVehicleNWTelemetryRecord
+{
+	// World time (s) of the step.
+	double Time;
+	// UObject unique id of the vehicle component.
+	uint32 VehicleId;
+	float DeltaTime;
+	// -1 reverse, 0 neutral, 1+ forward.
+	int8 Gear;
+	uint8 NumWheels;
+	uint16 Pad;
+	float EngineRPM;
+	float ForwardSpeed;
+	float Throttle;
+	float Steering;
+	float Brake;
+	float Handbrake;
+	uint32 Reserved;
+};
+
+struct FVehicleNWTelemetryWheel
+{
+	float LongitudinalSlip;
+	float LateralSlip;
+	// Suspension compression from rest (cm).
+	float SuspensionOffset;
+};
+
+/** Ring buffer element: a record with room for the largest vehicle, only NumWheels wheels reach the file. */
+struct FVehicleNWTelemetrySample
+{
+	FVehicleNWTelemetryRecord Record;
+	FVehicleNWTelemetryWheel Wheels[VehicleNWTelemetry::MaxWheels];
+};
+
+/**
+ * Streams vehicle telemetry to a chunked binary file.
+ *
+ * The simulation pushes samples into fixed size single producer single consumer rings, one per world, a background
+ * thread drains them into chunks and writes them. The steps of a world's physics scene never overlap, whether they run
+ * on the game thread or a substep task, so each ring has a single producer. Memory use is the rings plus one chunk,
+ * whatever the sample rate.
+ */
+class MYVEHICLEPROJECT_API FVehicleNWTelemetryRecorder : public FRunnable
+{
+public:
+
+	/** Ring taking the samples of one world. Never allocates, drops and counts samples when full. */
+	class FProducer
+	{
+	public:
+
+		/** Queue a sample. False if the ring is full, the sample is dropped. Physics side of the producer's world. */
+		bool Push(const FVehicleNWTelemetrySample& Sample);
+
+	private:
+
+		friend class FVehicleNWTelemetryRecorder;
+
+		FProducer(const UWorld* InWorld, int32 Capacity, FThreadSafeCounter& InNumDropped);
+
+		const UWorld* World;
+		TCircularQueue<FVehicleNWTelemetrySample> Queue;
+		FThreadSafeCounter& NumDropped;
+	};
+
+	/**
+	 * The running recorder, kept alive for the lifetime of the scope: StopRecording waits for every scope that got it
+	 * before deleting it. Get() is null when not recording. Any thread.
+	 */
+	class MYVEHICLEPROJECT_API FScopedAccess
+	{
+	public:
+
+		FScopedAccess();
+		~FScopedAccess();
+
+		FVehicleNWTelemetryRecorder* Get() const { return Recorder; }
+
+	private:
+
+		FVehicleNWTelemetryRecorder* Recorder;
+	};
+
+	/** Start recording to Filename. False if a recording is running or the file cannot be created. Game thread. */
+	static bool StartRecording(const FString& Filename, int32 RingCapacity, int32 ChunkSize);
+
+	/** Stop taking samples, flush the remaining ones and close the file. Game thread. */
+	static void StopRecording();
+
+	virtual ~FVehicleNWTelemetryRecorder();
+
+	/** Ring of World, created on first use. Null if MaxWorlds worlds are already recording. Any thread. */
+	FProducer* GetProducer(const UWorld* World);
+
+	// Begin FRunnable interface
+	virtual uint32 Run() override;
+	virtual void Stop() override;
+	// End FRunnable interface
+
+private:
+
+	FVehicleNWTelemetryRecorder(FArchive* InFile, int32 RingCapacity, int32 InChunkSize);
+
+	/** Move queued samples to the chunk, writing it out when full. Writer thread. Returns the number of samples moved. */
+	int32 Drain();
+	void WriteChunk();
+
+	static TAtomic<FVehicleNWTelemetryRecorder*> Active;
+
+	// Scopes that may hold Active.
+	static FThreadSafeCounter NumAccesses;
+
+	static const int32 MaxWorlds = 8;
+
+	// Rings [0, NumProducers) are published, created under ProducersLock and never removed while recording.
+	TUniquePtr<FProducer> Producers[MaxWorlds];
+	TAtomic<int32> NumProducers;
+	FCriticalSection ProducersLock;
+	int32 RingCapacity;
+
+	TUniquePtr<FArchive> File;
+	FRunnableThread* Thread;
+	FThreadSafeBool bStopping;
+
+	// Chunk being filled by the writer thread.
+	TArray<uint8> Chunk;
+	int32 ChunkSize;
+	int32 ChunkRecords;
+	double LastWriteTime;
+
+	FThreadSafeCounter NumDropped;
+	int32 NumDroppedWritten;
+	int64 NumRecordsWritten;
+};
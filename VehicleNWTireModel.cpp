@@ -0,0 +1,322 @@
+// Copyright Unreal Engine Community.
+
+#include "VehicleNWTireModel.h"
+#include "HAL/PlatformTime.h"
+#include "Math/RandomStream.h"
+#include "VehicleNWStats.h"
+
+DECLARE_CYCLE_STAT(TEXT("Tire Model Batch"), STAT_VehicleNW_TireBatch, STATGROUP_VehicleNW);
+
+// Slips under this are treated as zero, like PhysX does.
+static const float TireMinSlip = 1e-5f;
+
+static FORCEINLINE float TireSmoothing1(float K)
+{
+	return FMath::Min(1.f, K - K * K / 3.f + K * K * K / 27.f);
+}
+
+static FORCEINLINE float TireSmoothing2(float K)
+{
+	return K - K * K + K * K * K / 3.f - K * K * K * K / 27.f;
+}
+
+void FVehicleNWTireBatch::SetNum(int32 NewNum)
+{
+	Num = NewNum;
+	const int32 PaddedNum = GetPaddedNum();
+
+	FFloatArray* Arrays[] = {
+		&LatStiffX, &LatStiffY, &LongStiffnessPerGravity, &CamberStiffnessPerGravity,
+		&Friction, &LongSlip, &LatSlip, &Camber, &WheelRadius, &RestLoad, &NormalizedLoad, &Load, &Gravity,
+		&WheelTorque, &LongForce, &LatForce, &AlignMoment };
+	for (FFloatArray* Array : Arrays)
+	{
+		Array->SetNumZeroed(PaddedNum);
+	}
+
+	// Padding tires have no slip and a valid load, they produce no force and no division by zero.
+	for (int32 Index = Num; Index < PaddedNum; Index++)
+	{
+		LatStiffX[Index] = 1.f;
+		LatStiffY[Index] = 1.f;
+		LongStiffnessPerGravity[Index] = 1.f;
+		Friction[Index] = 1.f;
+		RestLoad[Index] = 1.f;
+		NormalizedLoad[Index] = 1.f;
+		Load[Index] = 1.f;
+		Gravity[Index] = 1.f;
+	}
+}
+
+void FVehicleNWTireBatch::SetTire(int32 Index, const FVehicleNWTireParams& Params, const FVehicleNWTireInput& Input)
+{
+	LatStiffX[Index] = Params.LatStiffX;
+	LatStiffY[Index] = Params.LatStiffY;
+	LongStiffnessPerGravity[Index] = Params.LongStiffnessPerGravity;
+	CamberStiffnessPerGravity[Index] = Params.CamberStiffnessPerGravity;
+
+	Friction[Index] = Input.Friction;
+	LongSlip[Index] = Input.LongSlip;
+	LatSlip[Index] = Input.LatSlip;
+	Camber[Index] = Input.Camber;
+	WheelRadius[Index] = Input.WheelRadius;
+	RestLoad[Index] = Input.RestLoad;
+	NormalizedLoad[Index] = Input.NormalizedLoad;
+	Load[Index] = Input.Load;
+	Gravity[Index] = Input.Gravity;
+}
+
+FVehicleNWTireForces FVehicleNWTireBatch::GetForces(int32 Index) const
+{
+	FVehicleNWTireForces Forces;
+	Forces.WheelTorque = WheelTorque[Index];
+	Forces.LongForce = LongForce[Index];
+	Forces.LatForce = LatForce[Index];
+	Forces.AlignMoment = AlignMoment[Index];
+	return Forces;
+}
+
+void IVehicleNWTireModel::ComputeForcesBatch(FVehicleNWTireBatch& Batch) const
+{
+	for (int32 Index = 0; Index < Batch.Num; Index++)
+	{
+		const FVehicleNWTireParams Params = { Batch.LatStiffX[Index], Batch.LatStiffY[Index], Batch.LongStiffnessPerGravity[Index], Batch.CamberStiffnessPerGravity[Index] };
+		const FVehicleNWTireInput Input = { Batch.Friction[Index], Batch.LongSlip[Index], Batch.LatSlip[Index], Batch.Camber[Index],
+			Batch.WheelRadius[Index], Batch.RestLoad[Index], Batch.NormalizedLoad[Index], Batch.Load[Index], Batch.Gravity[Index] };
+
+		FVehicleNWTireForces Forces;
+		ComputeForces(Params, Input, Forces);
+
+		Batch.WheelTorque[Index] = Forces.WheelTorque;
+		Batch.LongForce[Index] = Forces.LongForce;
+		Batch.LatForce[Index] = Forces.LatForce;
+		Batch.AlignMoment[Index] = Forces.AlignMoment;
+	}
+}
+
+void FVehicleNWDefaultTireModel::ComputeForces(const FVehicleNWTireParams& Params, const FVehicleNWTireInput& Input, FVehicleNWTireForces& Out) const
+{
+	Out.WheelTorque = 0.f;
+	Out.LongForce = 0.f;
+	Out.LatForce = 0.f;
+	Out.AlignMoment = 0.f;
+
+	const float LongSlip = FMath::Abs(Input.LongSlip) >= TireMinSlip ? Input.LongSlip : 0.f;
+	const float LatSlip = FMath::Abs(Input.LatSlip) >= TireMinSlip ? Input.LatSlip : 0.f;
+	const float Camber = FMath::Abs(Input.Camber) >= TireMinSlip ? Input.Camber : 0.f;
+	if (LongSlip == 0.f && LatSlip == 0.f && Camber == 0.f)
+	{
+		return;
+	}
+
+	const float LatStiff = Input.RestLoad * Params.LatStiffY * TireSmoothing1(Input.NormalizedLoad * 3.f / Params.LatStiffX);
+	const float LongStiff = Params.LongStiffnessPerGravity * Input.Gravity;
+	const float CamberStiff = Params.CamberStiffnessPerGravity * Input.Gravity;
+
+	const float TEff = FMath::Tan(LatSlip - Camber * CamberStiff / LatStiff);
+	const float MaxForce = Input.Friction * Input.Load;
+	const float K = FMath::Sqrt(FMath::Square(LatStiff * TEff) + FMath::Square(LongStiff * LongSlip)) / MaxForce;
+	const float FBar = TireSmoothing1(K);
+	const float MBar = TireSmoothing2(K);
+
+	float Nu = 1.f;
+	if (K <= 2.f * PI)
+	{
+		const float LatOverLong = LatStiff / LongStiff;
+		Nu = 0.5f * (1.f + LatOverLong - (1.f - LatOverLong) * FMath::Cos(K * 0.5f));
+	}
+
+	const float FZero = MaxForce / FMath::Sqrt(FMath::Square(LongSlip) + FMath::Square(Nu * TEff));
+	Out.LongForce = LongSlip * FBar * FZero;
+	Out.LatForce = -Nu * TEff * FBar * FZero;
+	Out.AlignMoment = Nu * TEff * MBar * FZero;
+	Out.WheelTorque = -Out.LongForce * Input.WheelRadius;
+}
+
+void FVehicleNWDefaultTireModel::ComputeForcesBatch(FVehicleNWTireBatch& Batch) const
+{
+	SCOPE_CYCLE_COUNTER(STAT_VehicleNW_TireBatch);
+
+	const VectorRegister Zero = VectorZero();
+	const VectorRegister One = VectorOne();
+	const VectorRegister Half = VectorSetFloat1(0.5f);
+	const VectorRegister Three = VectorSetFloat1(3.f);
+	const VectorRegister OneThird = VectorSetFloat1(1.f / 3.f);
+	const VectorRegister OneTwentySeventh = VectorSetFloat1(1.f / 27.f);
+	const VectorRegister TwoPi = VectorSetFloat1(2.f * PI);
+	const VectorRegister MinSlip = VectorSetFloat1(TireMinSlip);
+
+	auto Smoothing1 = [&](const VectorRegister& K)
+	{
+		const VectorRegister K2 = VectorMultiply(K, K);
+		const VectorRegister K3 = VectorMultiply(K2, K);
+		return VectorMin(One, VectorMultiplyAdd(K3, OneTwentySeventh, VectorSubtract(K, VectorMultiply(K2, OneThird))));
+	};
+
+	// Square root through the accurate reciprocal square root, 0 for 0.
+	auto Sqrt = [&](const VectorRegister& X)
+	{
+		return VectorSelect(VectorCompareGT(X, Zero), VectorMultiply(X, VectorReciprocalSqrtAccurate(X)), Zero);
+	};
+
+	const int32 PaddedNum = Batch.GetPaddedNum();
+	for (int32 Index = 0; Index < PaddedNum; Index += 4)
+	{
+		VectorRegister LongSlip = VectorLoadAligned(&Batch.LongSlip[Index]);
+		VectorRegister LatSlip = VectorLoadAligned(&Batch.LatSlip[Index]);
+		VectorRegister Camber = VectorLoadAligned(&Batch.Camber[Index]);
+		LongSlip = VectorSelect(VectorCompareGE(VectorAbs(LongSlip), MinSlip), LongSlip, Zero);
+		LatSlip = VectorSelect(VectorCompareGE(VectorAbs(LatSlip), MinSlip), LatSlip, Zero);
+		Camber = VectorSelect(VectorCompareGE(VectorAbs(Camber), MinSlip), Camber, Zero);
+		const VectorRegister HasSlip = VectorBitwiseOr(VectorCompareNE(LongSlip, Zero), VectorBitwiseOr(VectorCompareNE(LatSlip, Zero), VectorCompareNE(Camber, Zero)));
+		if (VectorMaskBits(HasSlip) == 0)
+		{
+			VectorStoreAligned(Zero, &Batch.WheelTorque[Index]);
+			VectorStoreAligned(Zero, &Batch.LongForce[Index]);
+			VectorStoreAligned(Zero, &Batch.LatForce[Index]);
+			VectorStoreAligned(Zero, &Batch.AlignMoment[Index]);
+			continue;
+		}
+
+		const VectorRegister Gravity = VectorLoadAligned(&Batch.Gravity[Index]);
+		const VectorRegister LoadRatio = VectorDivide(VectorMultiply(VectorLoadAligned(&Batch.NormalizedLoad[Index]), Three), VectorLoadAligned(&Batch.LatStiffX[Index]));
+		const VectorRegister LatStiff = VectorMultiply(VectorMultiply(VectorLoadAligned(&Batch.RestLoad[Index]), VectorLoadAligned(&Batch.LatStiffY[Index])), Smoothing1(LoadRatio));
+		const VectorRegister LongStiff = VectorMultiply(VectorLoadAligned(&Batch.LongStiffnessPerGravity[Index]), Gravity);
+		const VectorRegister CamberStiff = VectorMultiply(VectorLoadAligned(&Batch.CamberStiffnessPerGravity[Index]), Gravity);
+
+		const VectorRegister TEff = VectorTan(VectorSubtract(LatSlip, VectorDivide(VectorMultiply(Camber, CamberStiff), LatStiff)));
+		const VectorRegister MaxForce = VectorMultiply(VectorLoadAligned(&Batch.Friction[Index]), VectorLoadAligned(&Batch.Load[Index]));
+		const VectorRegister LatTerm = VectorMultiply(LatStiff, TEff);
+		const VectorRegister LongTerm = VectorMultiply(LongStiff, LongSlip);
+		const VectorRegister K = VectorDivide(Sqrt(VectorMultiplyAdd(LatTerm, LatTerm, VectorMultiply(LongTerm, LongTerm))), MaxForce);
+
+		const VectorRegister K2 = VectorMultiply(K, K);
+		const VectorRegister K3 = VectorMultiply(K2, K);
+		const VectorRegister FBar = Smoothing1(K);
+		const VectorRegister MBar = VectorSubtract(VectorAdd(VectorSubtract(K, K2), VectorMultiply(K3, OneThird)), VectorMultiply(VectorMultiply(K3, K), OneTwentySeventh));
+
+		const VectorRegister LatOverLong = VectorDivide(LatStiff, LongStiff);
+		const VectorRegister NuBlend = VectorMultiply(Half, VectorSubtract(VectorAdd(One, LatOverLong), VectorMultiply(VectorSubtract(One, LatOverLong), VectorCos(VectorMultiply(K, Half)))));
+		const VectorRegister Nu = VectorSelect(VectorCompareGE(TwoPi, K), NuBlend, One);
+
+		const VectorRegister NuTEff = VectorMultiply(Nu, TEff);
+		const VectorRegister SlipLength = Sqrt(VectorMultiplyAdd(LongSlip, LongSlip, VectorMultiply(NuTEff, NuTEff)));
+		const VectorRegister FZero = VectorSelect(VectorCompareGT(SlipLength, Zero), VectorDivide(MaxForce, SlipLength), Zero);
+		const VectorRegister FBarFZero = VectorSelect(HasSlip, VectorMultiply(FBar, FZero), Zero);
+
+		const VectorRegister LongForce = VectorMultiply(LongSlip, FBarFZero);
+		VectorStoreAligned(LongForce, &Batch.LongForce[Index]);
+		VectorStoreAligned(VectorNegate(VectorMultiply(NuTEff, FBarFZero)), &Batch.LatForce[Index]);
+		VectorStoreAligned(VectorSelect(HasSlip, VectorMultiply(VectorMultiply(NuTEff, MBar), FZero), Zero), &Batch.AlignMoment[Index]);
+		VectorStoreAligned(VectorNegate(VectorMultiply(LongForce, VectorLoadAligned(&Batch.WheelRadius[Index]))), &Batch.WheelTorque[Index]);
+	}
+}
+
+static TMap<FName, const IVehicleNWTireModel*>& GetTireModelMap()
+{
+	static FVehicleNWDefaultTireModel DefaultTireModel;
+	static TMap<FName, const IVehicleNWTireModel*> TireModels;
+	if (TireModels.Num() == 0)
+	{
+		TireModels.Add(TEXT("Default"), &DefaultTireModel);
+	}
+	return TireModels;
+}
+
+void FVehicleNWTireModels::Register(FName Name, const IVehicleNWTireModel* Model)
+{
+	check(Model);
+	GetTireModelMap().Add(Name, Model);
+}
+
+void FVehicleNWTireModels::Unregister(FName Name)
+{
+	GetTireModelMap().Remove(Name);
+}
+
+const IVehicleNWTireModel* FVehicleNWTireModels::Find(FName Name)
+{
+	const IVehicleNWTireModel* const* Model = GetTireModelMap().Find(Name);
+	return Model ? *Model : nullptr;
+}
+
+static FAutoConsoleCommand VehicleNWTireModelTestCommand(
+	TEXT("p.VehicleNW.TireModelTest"),
+	TEXT("Compare the batch kernel of a tire model with its per tire path on random tires, and time both.\n")
+	TEXT("p.VehicleNW.TireModelTest [Model=Default] [NumTires=4096]"),
+	FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+	{
+		const FName ModelName = Args.Num() > 0 ? FName(*Args[0]) : FName(TEXT("Default"));
+		const int32 NumTires = Args.Num() > 1 ? FMath::Max(1, FCString::Atoi(*Args[1])) : 4096;
+
+		const IVehicleNWTireModel* Model = FVehicleNWTireModels::Find(ModelName);
+		if (Model == nullptr)
+		{
+			UE_LOG(LogVehicleNW, Warning, TEXT("TireModelTest: no tire model named %s"), *ModelName.ToString());
+			return;
+		}
+
+		// Ranges of a car to truck tire, from gentle rolling to full slides.
+		FRandomStream Random(0x7123);
+		TArray<FVehicleNWTireParams> Params;
+		TArray<FVehicleNWTireInput> Inputs;
+		FVehicleNWTireBatch Batch;
+		Batch.SetNum(NumTires);
+		for (int32 Index = 0; Index < NumTires; Index++)
+		{
+			FVehicleNWTireParams& Param = Params.AddDefaulted_GetRef();
+			Param.LatStiffX = Random.FRandRange(1.f, 3.f);
+			Param.LatStiffY = Random.FRandRange(10.f, 25.f);
+			Param.LongStiffnessPerGravity = Random.FRandRange(500.f, 1500.f);
+			Param.CamberStiffnessPerGravity = Random.FRandRange(0.f, 1.f);
+
+			FVehicleNWTireInput& Input = Inputs.AddDefaulted_GetRef();
+			Input.Friction = Random.FRandRange(0.2f, 1.2f);
+			Input.LongSlip = Index % 16 == 0 ? 0.f : Random.FRandRange(-1.f, 1.f);
+			Input.LatSlip = Index % 16 == 0 ? 0.f : Random.FRandRange(-0.8f, 0.8f);
+			Input.Camber = Random.FRandRange(-0.05f, 0.05f);
+			Input.WheelRadius = Random.FRandRange(30.f, 60.f);
+			Input.RestLoad = Random.FRandRange(2000.f, 40000.f);
+			Input.NormalizedLoad = Random.FRandRange(0.2f, 2.f);
+			Input.Load = Input.RestLoad * Input.NormalizedLoad;
+			Input.Gravity = 980.f;
+
+			Batch.SetTire(Index, Param, Input);
+		}
+
+		TArray<FVehicleNWTireForces> Reference;
+		Reference.SetNumUninitialized(NumTires);
+		const double ScalarStart = FPlatformTime::Seconds();
+		for (int32 Index = 0; Index < NumTires; Index++)
+		{
+			Model->ComputeForces(Params[Index], Inputs[Index], Reference[Index]);
+		}
+		const double ScalarTime = FPlatformTime::Seconds() - ScalarStart;
+
+		const double BatchStart = FPlatformTime::Seconds();
+		Model->ComputeForcesBatch(Batch);
+		const double BatchTime = FPlatformTime::Seconds() - BatchStart;
+
+		// Errors relative to the friction limited force of each tire.
+		float MaxError = 0.f;
+		int32 WorstTire = 0;
+		for (int32 Index = 0; Index < NumTires; Index++)
+		{
+			const FVehicleNWTireForces Forces = Batch.GetForces(Index);
+			const float Scale = Inputs[Index].Friction * Inputs[Index].Load;
+			const float Error = FMath::Max3(
+				FMath::Abs(Forces.LongForce - Reference[Index].LongForce),
+				FMath::Abs(Forces.LatForce - Reference[Index].LatForce),
+				FMath::Abs(Forces.AlignMoment - Reference[Index].AlignMoment)) / Scale;
+			if (Error > MaxError || FMath::IsNaN(Error))
+			{
+				MaxError = Error;
+				WorstTire = Index;
+			}
+		}
+
+		const bool bPassed = MaxError <= FVehicleNWDefaultTireModel::BatchTolerance;
+		UE_LOG(LogVehicleNW, Display, TEXT("TireModelTest %s: %d tires, per tire %.1f ns, batch %.1f ns, max error %.2e of friction force (tire %d), tolerance %.0e: %s"),
+			*ModelName.ToString(), NumTires, ScalarTime * 1e9 / NumTires, BatchTime * 1e9 / NumTires, MaxError, WorstTire,
+			FVehicleNWDefaultTireModel::BatchTolerance, bPassed ? TEXT("passed") : TEXT("FAILED"));
+	}));
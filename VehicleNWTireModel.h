@@ -0,0 +1,125 @@
+// Copyright Unreal Engine Community.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/** Per tire constants, taken from the PxVehicleTireData of the wheel. */
+struct FVehicleNWTireParams
+{
+	float LatStiffX;
+	float LatStiffY;
+	float LongStiffnessPerGravity;
+	float CamberStiffnessPerGravity;
+};
+
+/** What PhysX hands to a tire shader for one wheel and one substep. */
+struct FVehicleNWTireInput
+{
+	float Friction;
+	float LongSlip;
+	float LatSlip;
+	float Camber;
+	float WheelRadius;
+	float RestLoad;
+	float NormalizedLoad;
+	float Load;
+	float Gravity;
+};
+
+struct FVehicleNWTireForces
+{
+	float WheelTorque;
+	float LongForce;
+	float LatForce;
+	float AlignMoment;
+};
+
+/**
+ * Tires stored as structure of arrays. Arrays are 16 byte aligned and padded to a multiple of 4 with tires that
+ * produce no force, so batch kernels work on whole vector registers.
+ */
+struct MYVEHICLEPROJECT_API FVehicleNWTireBatch
+{
+	typedef TArray<float, TAlignedHeapAllocator<16>> FFloatArray;
+
+	int32 Num = 0;
+
+	FFloatArray LatStiffX;
+	FFloatArray LatStiffY;
+	FFloatArray LongStiffnessPerGravity;
+	FFloatArray CamberStiffnessPerGravity;
+
+	FFloatArray Friction;
+	FFloatArray LongSlip;
+	FFloatArray LatSlip;
+	FFloatArray Camber;
+	FFloatArray WheelRadius;
+	FFloatArray RestLoad;
+	FFloatArray NormalizedLoad;
+	FFloatArray Load;
+	FFloatArray Gravity;
+
+	FFloatArray WheelTorque;
+	FFloatArray LongForce;
+	FFloatArray LatForce;
+	FFloatArray AlignMoment;
+
+	/** Resize for NewNum tires, padding included. */
+	void SetNum(int32 NewNum);
+
+	int32 GetPaddedNum() const { return Align(Num, 4); }
+
+	void SetTire(int32 Index, const FVehicleNWTireParams& Params, const FVehicleNWTireInput& Input);
+	FVehicleNWTireForces GetForces(int32 Index) const;
+};
+
+/**
+ * Computes tire forces from slips and load.
+ *
+ * ComputeForces is what UVehicleMovementComponentNW::GenerateTireForces calls, once per wheel in contact and per
+ * substep, from the thread running the vehicle update. It must be thread safe and must not allocate. ComputeForcesBatch evaluates the
+ * same model over many tires, for callers that hold the wheel state themselves.
+ */
+class MYVEHICLEPROJECT_API IVehicleNWTireModel
+{
+public:
+
+	virtual ~IVehicleNWTireModel() {}
+
+	virtual void ComputeForces(const FVehicleNWTireParams& Params, const FVehicleNWTireInput& Input, FVehicleNWTireForces& Out) const = 0;
+
+	/** Every tire of Batch. Loops over ComputeForces unless overridden. */
+	virtual void ComputeForcesBatch(FVehicleNWTireBatch& Batch) const;
+};
+
+/**
+ * The PhysX default tire model (CarSimEd, appendix F), with a 4 wide batch kernel.
+ *
+ * The batch kernel uses vector approximations of tan and cos. Its forces match ComputeForces within
+ * BatchTolerance * Friction * Load, which p.VehicleNW.TireModelTest checks.
+ */
+class MYVEHICLEPROJECT_API FVehicleNWDefaultTireModel : public IVehicleNWTireModel
+{
+public:
+
+	static constexpr float BatchTolerance = 1e-3f;
+
+	virtual void ComputeForces(const FVehicleNWTireParams& Params, const FVehicleNWTireInput& Input, FVehicleNWTireForces& Out) const override;
+	virtual void ComputeForcesBatch(FVehicleNWTireBatch& Batch) const override;
+};
+
+/**
+ * Tire models selectable by name from UVehicleMovementComponentNW::TireModel. "Default" is always registered.
+ * Models are not owned, they must outlive the vehicles using them. Game thread only.
+ */
+class MYVEHICLEPROJECT_API FVehicleNWTireModels
+{
+public:
+
+	static void Register(FName Name, const IVehicleNWTireModel* Model);
+	static void Unregister(FName Name);
+
+	/** Registered model, or null. */
+	static const IVehicleNWTireModel* Find(FName Name);
+};
@@ -0,0 +1,352 @@
+// Copyright Unreal Engine Community.
+
+#include "VehicleNWTrafficSubsystem.h"
+#include "VehicleMovementComponentNW.h"
+#include "VehicleNWStats.h"
+#include "Engine/World.h"
+#include "Async/ParallelFor.h"
+#include "Algo/Sort.h"
+#include "Algo/UpperBound.h"
+
+DECLARE_CYCLE_STAT(TEXT("Traffic Tick"), STAT_VehicleNW_TrafficTick, STATGROUP_VehicleNW);
+DECLARE_CYCLE_STAT(TEXT("Traffic Gather"), STAT_VehicleNW_TrafficGather, STATGROUP_VehicleNW);
+DECLARE_CYCLE_STAT(TEXT("Traffic Drive Chunk"), STAT_VehicleNW_TrafficChunk, STATGROUP_VehicleNW);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Traffic Drivers"), STAT_VehicleNW_TrafficDrivers, STATGROUP_VehicleNW);
+
+static TAutoConsoleVariable<float> CVarVehicleNWTrafficLookAhead(
+	TEXT("p.VehicleNW.TrafficLookAhead"),
+	1500.f,
+	TEXT("Distance (cm) along the path to the point traffic drivers steer towards."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarVehicleNWTrafficMinGap(
+	TEXT("p.VehicleNW.TrafficMinGap"),
+	800.f,
+	TEXT("Distance (cm) between vehicle centers at which traffic drivers stop behind the vehicle ahead."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarVehicleNWTrafficTimeHeadway(
+	TEXT("p.VehicleNW.TrafficTimeHeadway"),
+	1.5f,
+	TEXT("Time (s) traffic drivers keep to the vehicle ahead, beyond the minimum gap."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarVehicleNWTrafficChunkSize(
+	TEXT("p.VehicleNW.TrafficChunkSize"),
+	256,
+	TEXT("Number of traffic drivers computed by one worker task. 0 computes them all on the game thread."),
+	ECVF_Default);
+
+namespace VehicleNWTraffic
+{
+	// Steering for a target 30 degrees off the nose is full lock.
+	static constexpr float SteerGain = 2.f;
+	// Speed error (cm/s) giving full throttle or full brake, 10 km/h.
+	static constexpr float SpeedBand = 277.8f;
+	// Share of the target speed given up at full lock.
+	static constexpr float CornerSlowdown = 0.5f;
+}
+
+void UVehicleNWTrafficSubsystem::Deinitialize()
+{
+	while (Drivers.Num() > 0)
+	{
+		RemoveDriverAt(Drivers.Num() - 1);
+	}
+	Paths.Reset();
+	Super::Deinitialize();
+}
+
+bool UVehicleNWTrafficSubsystem::IsTickable() const
+{
+	return Drivers.Num() > 0 && !IsTemplate();
+}
+
+TStatId UVehicleNWTrafficSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UVehicleNWTrafficSubsystem, STATGROUP_Tickables);
+}
+
+int32 UVehicleNWTrafficSubsystem::AddPath(const TArray<FVector>& Points, bool bLoop)
+{
+	FPath& Path = Paths.AddDefaulted_GetRef();
+	Path.bLoop = bLoop && Points.Num() > 2;
+	Path.Points.Reserve(Points.Num() + 1);
+	for (const FVector& Point : Points)
+	{
+		Path.Points.Add(FVector2D(Point));
+	}
+
+	// A loop ends on its first point again, so every segment is [Points[i - 1], Points[i]].
+	if (Path.bLoop)
+	{
+		Path.Points.Add(Path.Points[0]);
+	}
+
+	Path.Distances.SetNumUninitialized(Path.Points.Num());
+	float Distance = 0.f;
+	for (int32 PointIdx = 0; PointIdx < Path.Points.Num(); PointIdx++)
+	{
+		Distance += PointIdx > 0 ? FVector2D::Distance(Path.Points[PointIdx - 1], Path.Points[PointIdx]) : 0.f;
+		Path.Distances[PointIdx] = Distance;
+	}
+	Path.Length = Distance;
+
+	return Paths.Num() - 1;
+}
+
+void UVehicleNWTrafficSubsystem::RegisterDriver(UVehicleMovementComponentNW* Vehicle, int32 PathId, float TargetSpeed)
+{
+	if (Vehicle == nullptr || Vehicle->UpdatedComponent == nullptr || !Paths.IsValidIndex(PathId) || Paths[PathId].Points.Num() < 2)
+	{
+		UE_LOG(LogVehicleNW, Warning, TEXT("RegisterDriver: no vehicle or no path %d"), PathId);
+		return;
+	}
+	if (Vehicle->GetOwnerRole() == ROLE_SimulatedProxy)
+	{
+		UE_LOG(LogVehicleNW, Warning, TEXT("RegisterDriver: %s is simulated by the server, its inputs would be ignored"), *Vehicle->GetPathName());
+		return;
+	}
+	if (Drivers.Contains(Vehicle))
+	{
+		UnregisterDriver(Vehicle);
+	}
+
+	// Start on the segment ending at the closest point, GatherDrivers moves on from there.
+	const FPath& Path = Paths[PathId];
+	const FVector2D Position(Vehicle->UpdatedComponent->GetComponentLocation());
+	int32 ClosestPoint = 0;
+	float ClosestDistSquared = MAX_flt;
+	for (int32 PointIdx = 0; PointIdx < Path.Points.Num(); PointIdx++)
+	{
+		const float DistSquared = FVector2D::DistSquared(Position, Path.Points[PointIdx]);
+		if (DistSquared < ClosestDistSquared)
+		{
+			ClosestDistSquared = DistSquared;
+			ClosestPoint = PointIdx;
+		}
+	}
+
+	Vehicle->bDrivenByTraffic = true;
+	Drivers.Add(Vehicle);
+	PathIds.Add(PathId);
+	Segments.Add(FMath::Max(ClosestPoint, 1));
+	PositionX.Add(0.f);
+	PositionY.Add(0.f);
+	ForwardX.Add(1.f);
+	ForwardY.Add(0.f);
+	Speeds.Add(0.f);
+	TargetSpeeds.Add(KmHToCmS(TargetSpeed));
+	Progress.Add(0.f);
+	TargetX.Add(0.f);
+	TargetY.Add(0.f);
+	Gaps.Add(BIG_NUMBER);
+	Throttles.Add(0.f);
+	Steerings.Add(0.f);
+	Brakes.Add(0.f);
+}
+
+void UVehicleNWTrafficSubsystem::UnregisterDriver(UVehicleMovementComponentNW* Vehicle)
+{
+	const int32 DriverIdx = Drivers.Find(Vehicle);
+	if (DriverIdx != INDEX_NONE)
+	{
+		RemoveDriverAt(DriverIdx);
+	}
+}
+
+void UVehicleNWTrafficSubsystem::SetTargetSpeed(UVehicleMovementComponentNW* Vehicle, float TargetSpeed)
+{
+	const int32 DriverIdx = Drivers.Find(Vehicle);
+	if (DriverIdx != INDEX_NONE)
+	{
+		TargetSpeeds[DriverIdx] = KmHToCmS(TargetSpeed);
+	}
+}
+
+void UVehicleNWTrafficSubsystem::RemoveDriverAt(int32 DriverIdx)
+{
+	if (Drivers[DriverIdx])
+	{
+		Drivers[DriverIdx]->bDrivenByTraffic = false;
+	}
+	Drivers.RemoveAtSwap(DriverIdx, 1, false);
+	PathIds.RemoveAtSwap(DriverIdx, 1, false);
+	Segments.RemoveAtSwap(DriverIdx, 1, false);
+	PositionX.RemoveAtSwap(DriverIdx, 1, false);
+	PositionY.RemoveAtSwap(DriverIdx, 1, false);
+	ForwardX.RemoveAtSwap(DriverIdx, 1, false);
+	ForwardY.RemoveAtSwap(DriverIdx, 1, false);
+	Speeds.RemoveAtSwap(DriverIdx, 1, false);
+	TargetSpeeds.RemoveAtSwap(DriverIdx, 1, false);
+	Progress.RemoveAtSwap(DriverIdx, 1, false);
+	TargetX.RemoveAtSwap(DriverIdx, 1, false);
+	TargetY.RemoveAtSwap(DriverIdx, 1, false);
+	Gaps.RemoveAtSwap(DriverIdx, 1, false);
+	Throttles.RemoveAtSwap(DriverIdx, 1, false);
+	Steerings.RemoveAtSwap(DriverIdx, 1, false);
+	Brakes.RemoveAtSwap(DriverIdx, 1, false);
+}
+
+FVector2D UVehicleNWTrafficSubsystem::GetPointAtDistance(const FPath& Path, float Distance)
+{
+	Distance = Path.bLoop ? FMath::Fmod(FMath::Fmod(Distance, Path.Length) + Path.Length, Path.Length) : FMath::Clamp(Distance, 0.f, Path.Length);
+
+	// First point past Distance ends the segment.
+	const int32 Segment = FMath::Clamp(Algo::UpperBound(Path.Distances, Distance), 1, Path.Points.Num() - 1);
+	const float SegmentLength = Path.Distances[Segment] - Path.Distances[Segment - 1];
+	const float Alpha = SegmentLength > KINDA_SMALL_NUMBER ? (Distance - Path.Distances[Segment - 1]) / SegmentLength : 0.f;
+	return FMath::Lerp(Path.Points[Segment - 1], Path.Points[Segment], FMath::Clamp(Alpha, 0.f, 1.f));
+}
+
+void UVehicleNWTrafficSubsystem::GatherDrivers(float LookAhead)
+{
+	SCOPE_CYCLE_COUNTER(STAT_VehicleNW_TrafficGather);
+
+	for (int32 DriverIdx = Drivers.Num() - 1; DriverIdx >= 0; DriverIdx--)
+	{
+		// Destroyed vehicles leave on their own.
+		const UVehicleMovementComponentNW* Vehicle = Drivers[DriverIdx];
+		if (Vehicle == nullptr || Vehicle->IsPendingKill() || Vehicle->UpdatedComponent == nullptr)
+		{
+			RemoveDriverAt(DriverIdx);
+			continue;
+		}
+
+		const FTransform& Transform = Vehicle->UpdatedComponent->GetComponentTransform();
+		const FVector2D Position(Transform.GetLocation());
+		const FVector Forward = Transform.GetUnitAxis(EAxis::X);
+		const FVector2D Forward2D = FVector2D(Forward).GetSafeNormal();
+		PositionX[DriverIdx] = Position.X;
+		PositionY[DriverIdx] = Position.Y;
+		ForwardX[DriverIdx] = Forward2D.X;
+		ForwardY[DriverIdx] = Forward2D.Y;
+		Speeds[DriverIdx] = FVector::DotProduct(Vehicle->UpdatedComponent->GetComponentVelocity(), Forward);
+
+		// Move on to the next segments once past their start.
+		const FPath& Path = Paths[PathIds[DriverIdx]];
+		const int32 LastSegment = Path.Points.Num() - 1;
+		int32 Segment = Segments[DriverIdx];
+		float Alpha = 0.f;
+		for (int32 Step = 0; Step <= LastSegment; Step++)
+		{
+			const FVector2D Start = Path.Points[Segment - 1];
+			const FVector2D Direction = Path.Points[Segment] - Start;
+			const float LengthSquared = FMath::Max(Direction.SizeSquared(), KINDA_SMALL_NUMBER);
+			Alpha = FVector2D::DotProduct(Position - Start, Direction) / LengthSquared;
+			if (Alpha <= 1.f || (Segment == LastSegment && !Path.bLoop))
+			{
+				break;
+			}
+			Segment = Segment == LastSegment ? 1 : Segment + 1;
+		}
+		Segments[DriverIdx] = Segment;
+
+		const float SegmentLength = Path.Distances[Segment] - Path.Distances[Segment - 1];
+		Progress[DriverIdx] = Path.Distances[Segment - 1] + FMath::Clamp(Alpha, 0.f, 1.f) * SegmentLength;
+
+		const FVector2D Target = GetPointAtDistance(Path, Progress[DriverIdx] + LookAhead);
+		TargetX[DriverIdx] = Target.X;
+		TargetY[DriverIdx] = Target.Y;
+	}
+}
+
+void UVehicleNWTrafficSubsystem::ComputeGaps()
+{
+	const int32 NumDrivers = Drivers.Num();
+	SortedDrivers.SetNumUninitialized(NumDrivers, false);
+	for (int32 DriverIdx = 0; DriverIdx < NumDrivers; DriverIdx++)
+	{
+		SortedDrivers[DriverIdx] = DriverIdx;
+	}
+
+	// Drivers of a path in a row, in driving order.
+	Algo::Sort(SortedDrivers, [this](int32 A, int32 B)
+	{
+		return PathIds[A] != PathIds[B] ? PathIds[A] < PathIds[B] : Progress[A] < Progress[B];
+	});
+
+	int32 FirstOfPath = 0;
+	for (int32 SortedIdx = 0; SortedIdx < NumDrivers; SortedIdx++)
+	{
+		const int32 DriverIdx = SortedDrivers[SortedIdx];
+		const bool bLastOfPath = SortedIdx + 1 == NumDrivers || PathIds[SortedDrivers[SortedIdx + 1]] != PathIds[DriverIdx];
+		if (!bLastOfPath)
+		{
+			Gaps[DriverIdx] = Progress[SortedDrivers[SortedIdx + 1]] - Progress[DriverIdx];
+			continue;
+		}
+
+		// The front driver of a loop follows the back one, a lap ahead.
+		const FPath& Path = Paths[PathIds[DriverIdx]];
+		const int32 Leader = SortedDrivers[FirstOfPath];
+		Gaps[DriverIdx] = (Path.bLoop && Leader != DriverIdx) ? Progress[Leader] + Path.Length - Progress[DriverIdx] : BIG_NUMBER;
+		FirstOfPath = SortedIdx + 1;
+	}
+}
+
+void UVehicleNWTrafficSubsystem::DriveRange(int32 FirstDriver, int32 LastDriver, float MinGap, float TimeHeadway)
+{
+	using namespace VehicleNWTraffic;
+
+	// Branch free over the arrays, so the compiler can vectorize it.
+	const float InvTimeHeadway = 1.f / FMath::Max(TimeHeadway, KINDA_SMALL_NUMBER);
+	for (int32 DriverIdx = FirstDriver; DriverIdx < LastDriver; DriverIdx++)
+	{
+		const float DeltaX = TargetX[DriverIdx] - PositionX[DriverIdx];
+		const float DeltaY = TargetY[DriverIdx] - PositionY[DriverIdx];
+		const float InvDistance = FMath::InvSqrt(FMath::Max(DeltaX * DeltaX + DeltaY * DeltaY, 1.f));
+
+		// Sine of the angle to the target, positive to the right. Targets behind get full lock.
+		const float Lateral = (ForwardX[DriverIdx] * DeltaY - ForwardY[DriverIdx] * DeltaX) * InvDistance;
+		const float Longitudinal = (ForwardX[DriverIdx] * DeltaX + ForwardY[DriverIdx] * DeltaY) * InvDistance;
+		const float Steer = FMath::FloatSelect(Longitudinal, Lateral * SteerGain, FMath::FloatSelect(Lateral, 1.f, -1.f));
+		const float Steering = FMath::Clamp(Steer, -1.f, 1.f);
+
+		// Target speed, capped by the time to the vehicle ahead and slowed down through corners.
+		const float GapSpeed = FMath::Max(Gaps[DriverIdx] - MinGap, 0.f) * InvTimeHeadway;
+		const float DesiredSpeed = FMath::Min(TargetSpeeds[DriverIdx], GapSpeed) * (1.f - CornerSlowdown * FMath::Abs(Steering));
+
+		const float SpeedError = (DesiredSpeed - Speeds[DriverIdx]) * (1.f / SpeedBand);
+		Throttles[DriverIdx] = FMath::Clamp(SpeedError, 0.f, 1.f);
+		// Hold the vehicle once it has to stop.
+		Brakes[DriverIdx] = FMath::Max(FMath::Clamp(-SpeedError, 0.f, 1.f), FMath::FloatSelect(-DesiredSpeed, 1.f, 0.f));
+		Steerings[DriverIdx] = Steering;
+	}
+
+	for (int32 DriverIdx = FirstDriver; DriverIdx < LastDriver; DriverIdx++)
+	{
+		Drivers[DriverIdx]->SetDriverInputs(Throttles[DriverIdx], Steerings[DriverIdx], Brakes[DriverIdx]);
+	}
+}
+
+void UVehicleNWTrafficSubsystem::Tick(float DeltaTime)
+{
+	SCOPE_CYCLE_COUNTER(STAT_VehicleNW_TrafficTick);
+	CSV_SCOPED_TIMING_STAT(VehicleNW, TrafficTick);
+
+	GatherDrivers(CVarVehicleNWTrafficLookAhead.GetValueOnGameThread());
+	ComputeGaps();
+
+	const int32 NumDrivers = Drivers.Num();
+	INC_DWORD_STAT_BY(STAT_VehicleNW_TrafficDrivers, NumDrivers);
+
+	const float MinGap = CVarVehicleNWTrafficMinGap.GetValueOnGameThread();
+	const float TimeHeadway = CVarVehicleNWTrafficTimeHeadway.GetValueOnGameThread();
+	const int32 ChunkSize = CVarVehicleNWTrafficChunkSize.GetValueOnGameThread();
+	const int32 NumChunks = ChunkSize > 0 ? FMath::DivideAndRoundUp(NumDrivers, ChunkSize) : 1;
+	if (NumChunks > 1)
+	{
+		// Every driver writes only its own array slots and its own vehicle's inputs.
+		ParallelFor(NumChunks, [&](int32 ChunkIdx)
+		{
+			SCOPE_CYCLE_COUNTER(STAT_VehicleNW_TrafficChunk);
+			const int32 FirstDriver = ChunkIdx * ChunkSize;
+			DriveRange(FirstDriver, FMath::Min(FirstDriver + ChunkSize, NumDrivers), MinGap, TimeHeadway);
+		});
+	}
+	else
+	{
+		DriveRange(0, NumDrivers, MinGap, TimeHeadway);
+	}
+}
@@ -0,0 +1,114 @@
+// Copyright Unreal Engine Community.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "Tickable.h"
+#include "VehicleNWTrafficSubsystem.generated.h"
+
+class UVehicleMovementComponentNW;
+
+/**
+ * Drives NW vehicles along paths in one batched pass per frame, in place of per actor AI ticks.
+ *
+ * Each frame the position, heading and speed of every driver are gathered into arrays, drivers sharing a path are
+ * sorted along it to find the vehicle ahead, then throttle, steering and brake are computed for all drivers by straight
+ * loops over those arrays, chunked over task graph workers. The result goes into the raw inputs of each vehicle and
+ * reaches PhysX through the usual input channel on its next PreTick, which smooths them even without a local
+ * controller. Simulated proxies cannot be driven, their inputs come from the server.
+ *
+ * Paths are followed in the XY plane.
+ */
+UCLASS()
+class MYVEHICLEPROJECT_API UVehicleNWTrafficSubsystem : public UWorldSubsystem, public FTickableGameObject
+{
+	GENERATED_BODY()
+
+public:
+
+	// Begin USubsystem interface
+	virtual void Deinitialize() override;
+	// End USubsystem interface
+
+	// Begin FTickableGameObject interface
+	virtual void Tick(float DeltaTime) override;
+	virtual bool IsTickable() const override;
+	virtual TStatId GetStatId() const override;
+	virtual UWorld* GetTickableGameObjectWorld() const override { return GetWorld(); }
+	// End FTickableGameObject interface
+
+	/** Add a path through Points, closed back to the first point if bLoop. Returns its id. */
+	UFUNCTION(BlueprintCallable, Category = "Game|Components|WheeledVehicleMovement|Traffic")
+	int32 AddPath(const TArray<FVector>& Points, bool bLoop);
+
+	/** Have Vehicle follow a path at up to TargetSpeed (km/h), starting from the path point closest to it. */
+	UFUNCTION(BlueprintCallable, Category = "Game|Components|WheeledVehicleMovement|Traffic")
+	void RegisterDriver(UVehicleMovementComponentNW* Vehicle, int32 PathId, float TargetSpeed);
+
+	/** Stop driving Vehicle. Its inputs are left as they were. */
+	UFUNCTION(BlueprintCallable, Category = "Game|Components|WheeledVehicleMovement|Traffic")
+	void UnregisterDriver(UVehicleMovementComponentNW* Vehicle);
+
+	/** Change the speed (km/h) a driver aims for when the road ahead is clear. */
+	UFUNCTION(BlueprintCallable, Category = "Game|Components|WheeledVehicleMovement|Traffic")
+	void SetTargetSpeed(UVehicleMovementComponentNW* Vehicle, float TargetSpeed);
+
+	int32 GetNumDrivers() const { return Drivers.Num(); }
+
+private:
+
+	struct FPath
+	{
+		TArray<FVector2D> Points;
+		// Distance along the path to each point, and the total length, closing segment included when looping.
+		TArray<float> Distances;
+		float Length;
+		bool bLoop;
+	};
+
+	/** Point at Distance along Path, wrapped on loops and clamped to the ends otherwise. */
+	static FVector2D GetPointAtDistance(const FPath& Path, float Distance);
+
+	void RemoveDriverAt(int32 DriverIdx);
+
+	/** Read transforms and speeds, advance along the paths and pick the steering targets. Game thread. */
+	void GatherDrivers(float LookAhead);
+
+	/** Distance to the next driver along the same path. */
+	void ComputeGaps();
+
+	/** Throttle, steering and brake of drivers [FirstDriver, LastDriver), written to their vehicles. Any thread. */
+	void DriveRange(int32 FirstDriver, int32 LastDriver, float MinGap, float TimeHeadway);
+
+	TArray<FPath> Paths;
+
+	/** Registered vehicles. Every array below is indexed like this one. */
+	UPROPERTY(Transient)
+	TArray<UVehicleMovementComponentNW*> Drivers;
+
+	TArray<int32> PathIds;
+	// Index of the path point ending the segment the driver is on.
+	TArray<int32> Segments;
+
+	TArray<float> PositionX;
+	TArray<float> PositionY;
+	TArray<float> ForwardX;
+	TArray<float> ForwardY;
+	// Forward speed (cm/s) and speed aimed for on a clear road (cm/s).
+	TArray<float> Speeds;
+	TArray<float> TargetSpeeds;
+	// Distance along the path.
+	TArray<float> Progress;
+	TArray<float> TargetX;
+	TArray<float> TargetY;
+	// Distance to the vehicle ahead on the same path.
+	TArray<float> Gaps;
+
+	TArray<float> Throttles;
+	TArray<float> Steerings;
+	TArray<float> Brakes;
+
+	// Scratch for ComputeGaps.
+	TArray<int32> SortedDrivers;
+};
@@ -0,0 +1,74 @@
+// Copyright Unreal Engine Community.
+
+#include "VehicleNWWheels.h"
+#include "PhysXIncludes.h"
+#include "PhysXPublic.h"
+
+static_assert(TIsPODType<FVehicleNWWheelsBlob>::Value, "FVehicleNWWheelsBlob is copied to the worker that builds the prototype.");
+
+#if WITH_PHYSX_VEHICLES
+static_assert(FVehicleNWWheelsBlob::MaxWheels == PX_MAX_NB_WHEELS, "Wheel count mismatch.");
+
+void FVehicleNWWheelsBlob::Apply(PxVehicleWheelsSimData& WheelsSimData) const
+{
+	const PxVec3 PLocalCOM = U2PVector(LocalCOM);
+
+	PxVec3 WheelOffsets[MaxWheels];
+	for (int32 WheelIdx = 0; WheelIdx < NumWheels; ++WheelIdx)
+	{
+		WheelOffsets[WheelIdx] = U2PVector(Wheels[WheelIdx].Offset);
+	}
+
+	PxReal SprungMasses[MaxWheels];
+	PxVehicleComputeSprungMasses(NumWheels, WheelOffsets, PLocalCOM, ChassisMass, 2, SprungMasses);
+
+	for (int32 WheelIdx = 0; WheelIdx < NumWheels; ++WheelIdx)
+	{
+		const FWheel& Wheel = Wheels[WheelIdx];
+
+		PxVehicleWheelData PWheelData;
+		PWheelData.mRadius = Wheel.Radius;
+		PWheelData.mWidth = Wheel.Width;
+		PWheelData.mMaxSteer = Wheel.MaxSteer;
+		PWheelData.mMaxBrakeTorque = Wheel.MaxBrakeTorque;
+		PWheelData.mMaxHandBrakeTorque = Wheel.MaxHandBrakeTorque;
+		PWheelData.mDampingRate = Wheel.DampingRate;
+		PWheelData.mMass = Wheel.Mass;
+		PWheelData.mMOI = 0.5f * PWheelData.mMass * FMath::Square(PWheelData.mRadius);
+
+		PxVehicleTireData PTireData;
+		PTireData.mType = Wheel.TireType;
+		PTireData.mLatStiffX = Wheel.LatStiffX;
+		PTireData.mLatStiffY = Wheel.LatStiffY;
+		PTireData.mLongitudinalStiffnessPerUnitGravity = Wheel.LongStiffness;
+
+		PxVehicleSuspensionData PSuspensionData;
+		PSuspensionData.mSprungMass = SprungMasses[WheelIdx];
+		PSuspensionData.mMaxCompression = Wheel.SuspensionMaxRaise;
+		PSuspensionData.mMaxDroop = Wheel.SuspensionMaxDrop;
+		PSuspensionData.mSpringStrength = FMath::Square(Wheel.SuspensionNaturalFrequency) * PSuspensionData.mSprungMass;
+		PSuspensionData.mSpringDamperRate = Wheel.SuspensionDampingRatio * 2.0f * FMath::Sqrt(PSuspensionData.mSpringStrength * PSuspensionData.mSprungMass);
+
+		const PxVec3 PWheelCentreCMOffset = WheelOffsets[WheelIdx] - PLocalCOM;
+		const PxVec3 PSuspForceAppCMOffset(PWheelCentreCMOffset.x, PWheelCentreCMOffset.y, Wheel.SuspensionForceOffset);
+
+		WheelsSimData.setWheelData(WheelIdx, PWheelData);
+		WheelsSimData.setTireData(WheelIdx, PTireData);
+		WheelsSimData.setSuspensionData(WheelIdx, PSuspensionData);
+		WheelsSimData.setSuspTravelDirection(WheelIdx, PxVec3(0.0f, 0.0f, -1.0f));
+		WheelsSimData.setWheelCentreOffset(WheelIdx, PWheelCentreCMOffset);
+		WheelsSimData.setSuspForceAppPointOffset(WheelIdx, PSuspForceAppCMOffset);
+		WheelsSimData.setTireForceAppPointOffset(WheelIdx, PSuspForceAppCMOffset);
+
+		// Wheel shapes come after the chassis shapes.
+		WheelsSimData.setWheelShapeMapping(WheelIdx, NumShapes - NumWheels + WheelIdx);
+	}
+
+	PxVehicleTireLoadFilterData PTireLoadFilter;
+	PTireLoadFilter.mMinNormalisedLoad = MinNormalizedTireLoad;
+	PTireLoadFilter.mMinFilteredNormalisedLoad = MinNormalizedTireLoadFiltered;
+	PTireLoadFilter.mMaxNormalisedLoad = MaxNormalizedTireLoad;
+	PTireLoadFilter.mMaxFilteredNormalisedLoad = MaxNormalizedTireLoadFiltered;
+	WheelsSimData.setTireLoadFilterData(PTireLoadFilter);
+}
+#endif // WITH_PHYSX_VEHICLES
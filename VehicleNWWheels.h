@@ -0,0 +1,69 @@
+// Copyright Unreal Engine Community.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+#if WITH_PHYSX_VEHICLES
+namespace physx
+{
+	class PxVehicleWheelsSimData;
+}
+#endif // WITH_PHYSX_VEHICLES
+
+/**
+ * Everything UWheeledVehicleMovementComponent::SetupWheels reads from the wheel classes, the mesh and the rigid body,
+ * captured on the game thread so the wheels sim data can be built on any thread.
+ *
+ * Plain data, already in PhysX units. Query filter data is not part of it: it carries the owner of the wheel shapes and
+ * is set per vehicle when the drive is bound.
+ */
+struct MYVEHICLEPROJECT_API FVehicleNWWheelsBlob
+{
+	// PX_MAX_NB_WHEELS.
+	static const int32 MaxWheels = 20;
+
+	struct FWheel
+	{
+		// Resting position relative to the component (cm).
+		FVector Offset;
+
+		float Radius;
+		float Width;
+		float Mass;
+		float MaxSteer;
+		float MaxBrakeTorque;
+		float MaxHandBrakeTorque;
+		float DampingRate;
+
+		// UTireConfig id.
+		uint32 TireType;
+		float LatStiffX;
+		float LatStiffY;
+		float LongStiffness;
+
+		float SuspensionMaxRaise;
+		float SuspensionMaxDrop;
+		float SuspensionNaturalFrequency;
+		float SuspensionDampingRatio;
+		float SuspensionForceOffset;
+	};
+
+	int32 NumWheels;
+	FWheel Wheels[MaxWheels];
+
+	// Rigid body, with the wheel shapes already attached after the chassis ones.
+	float ChassisMass;
+	FVector LocalCOM;
+	int32 NumShapes;
+
+	float MinNormalizedTireLoad;
+	float MinNormalizedTireLoadFiltered;
+	float MaxNormalizedTireLoad;
+	float MaxNormalizedTireLoadFiltered;
+
+#if WITH_PHYSX_VEHICLES
+	// Fill the wheels sim data like SetupWheels does, allocated for NumWheels.
+	void Apply(physx::PxVehicleWheelsSimData& WheelsSimData) const;
+#endif // WITH_PHYSX_VEHICLES
+};
@@ -18,6 +18,8 @@
 #include "WheeledVehicleNW.h"
 #include "MyVehicleWheel.h"
 #include "Components/AudioComponent.h"
+#include "VehicleNWStats.h"
+#include "VehicleNWDisplayText.h"
 
 #ifdef HMD_INTGERATION
 // Needed for VR Headset.
@@ -41,13 +43,6 @@ AWheeledVehicleNW::AWheeledVehicleNW(const FObjectInitializer& ObjectInitializer
 //	static ConstructorHelpers::FClassFinder<UObject> AnimBPClass(TEXT("/Game/VehicleAdv/Vehicle/VehicleAnimationBlueprint"));
 //	GetMesh()->SetAnimationMode(EAnimationMode::AnimationBlueprint);
 //	GetMesh()->SetAnimInstanceClass(AnimBPClass.Class);
-//
-//	// Setup friction materials.
-//	static ConstructorHelpers::FObjectFinder<UPhysicalMaterial> SlipperyMat(TEXT("/Game/Content/Slippery.uasset"));
-//	SlipperyMaterial = SlipperyMat.Object;
-//
-//	static ConstructorHelpers::FObjectFinder<UPhysicalMaterial> NonSlipperyMat(TEXT("/Game/Content/NonSlippery.uasset"));
-//	NonSlipperyMaterial = NonSlipperyMat.Object;
 
 	UVehicleMovementComponentNW* VehicleNW = CastChecked<UVehicleMovementComponentNW>(GetVehicleMovementComponent());
 
@@ -107,11 +102,17 @@ AWheeledVehicleNW::AWheeledVehicleNW(const FObjectInitializer& ObjectInitializer
 	// Set the inertia scale. This controls how the mass of the vehicle is distributed.
 	VehicleNW->InertiaTensorScale = FVector(1.0f, 1.333f, 1.2f);
 
+	// Engine sound, the cue is set on the blueprint.
+	EngineSoundComponent = CreateDefaultSubobject<UAudioComponent>(TEXT("EngineSound"));
+	EngineSoundComponent->SetupAttachment(GetMesh());
+
 	// Colors for the in-car gear display. One for normal one for reverse.
 	GearDisplayReverseColor = FColor(255, 0, 0, 255);
 	GearDisplayColor = FColor(255, 255, 255, 255);
 
 	bIsLowFriction = false;
+	LowFrictionWheels = 0;
+	LowFriction = 0.5f;
 	bInReverseGear = false;
 }
 
@@ -126,7 +127,7 @@ void AWheeledVehicleNW::SetupPlayerInputComponent(class UInputComponent* Input)
 
 void AWheeledVehicleNW::MoveForward(float Val)
 {
-	UE_LOG(LogTemp, Warning, TEXT("MoveForward %f"), Val);
+	UE_LOG(LogVehicleNW, VeryVerbose, TEXT("MoveForward %f"), Val);
 	GetVehicleMovementComponent()->SetThrottleInput(Val);
 }
 
@@ -156,18 +157,24 @@ void AWheeledVehicleNW::EnableIncarView(const bool bState)
 
 void AWheeledVehicleNW::Tick(float Delta)
 {
-	Super::Tick(Delta);
-
-	// Setup the flag to say we are in reverse gear.
-	bInReverseGear = GetVehicleMovementComponent()->GetCurrentGear() < 0;
+	SCOPE_CYCLE_COUNTER(STAT_VehicleNW_ActorTick);
+	CSV_SCOPED_TIMING_STAT(VehicleNW, ActorTick);
 
-	// Update physics material.
-	UpdatePhysicsMaterial();
+	Super::Tick(Delta);
 }
 
 void AWheeledVehicleNW::BeginPlay()
 {
 	Super::BeginPlay();
+
+	// Surfaces and display values are reported by the vehicle movement when they change, nothing to poll.
+	UVehicleMovementComponentNW* VehicleNW = CastChecked<UVehicleMovementComponentNW>(GetVehicleMovementComponent());
+	VehicleNW->OnWheelSurfaceChanged.AddUniqueDynamic(this, &AWheeledVehicleNW::OnWheelSurfaceChanged);
+	VehicleNW->OnGearChanged.AddUniqueDynamic(this, &AWheeledVehicleNW::OnGearChanged);
+	VehicleNW->OnSpeedChanged.AddUniqueDynamic(this, &AWheeledVehicleNW::OnSpeedChanged);
+	VehicleNW->OnEngineRPMChanged.AddUniqueDynamic(this, &AWheeledVehicleNW::OnEngineRPMChanged);
+
+	SetupInCarHUD();
 }
 
 void AWheeledVehicleNW::OnResetVR()
@@ -184,25 +191,45 @@ void AWheeledVehicleNW::OnResetVR()
 
 void AWheeledVehicleNW::UpdateHUDStrings()
 {
+	const UVehicleMovementComponentNW* VehicleNW = CastChecked<UVehicleMovementComponentNW>(GetVehicleMovementComponent());
+	SpeedDisplayString = FVehicleNWDisplayText::GetSpeedText(VehicleNW->GetPublishedSpeed());
+	GearDisplayString = FVehicleNWDisplayText::GetGearText(VehicleNW->GetPublishedGear());
+	bInReverseGear = VehicleNW->GetPublishedGear() < 0;
 }
 
 void AWheeledVehicleNW::SetupInCarHUD()
 {
+	// Strings for the values published so far, later changes come through the delegates.
+	UpdateHUDStrings();
+}
+
+void AWheeledVehicleNW::OnGearChanged(int32 Gear)
+{
+	GearDisplayString = FVehicleNWDisplayText::GetGearText(Gear);
+	bInReverseGear = Gear < 0;
+}
+
+void AWheeledVehicleNW::OnSpeedChanged(int32 Speed)
+{
+	SpeedDisplayString = FVehicleNWDisplayText::GetSpeedText(Speed);
 }
 
-void AWheeledVehicleNW::UpdatePhysicsMaterial()
+void AWheeledVehicleNW::OnEngineRPMChanged(float EngineRPM)
 {
-	if (GetActorUpVector().Z < 0)
+	EngineSoundComponent->SetFloatParameter(EngineAudioRPM, EngineRPM);
+}
+
+void AWheeledVehicleNW::OnWheelSurfaceChanged(int32 WheelIndex, UPhysicalMaterial* Surface, float Friction)
+{
+	// Wheels in the air are not on anything slippery.
+	const uint32 WheelBit = 1u << WheelIndex;
+	if (Surface && Friction < LowFriction)
+	{
+		LowFrictionWheels |= WheelBit;
+	}
+	else
 	{
-		if (bIsLowFriction == true)
-		{
-			//GetMesh()->SetPhysMaterialOverride(NonSlipperyMaterial);
-			bIsLowFriction = false;
-		}
-		else
-		{
-			//GetMesh()->SetPhysMaterialOverride(SlipperyMaterial);
-			bIsLowFriction = true;
-		}
+		LowFrictionWheels &= ~WheelBit;
 	}
+	bIsLowFriction = LowFrictionWheels != 0;
 }
\ No newline at end of file
@@ -11,6 +11,7 @@ class UCameraComponent;
 class USpringArmComponent;
 class UTextRenderComponent;
 class UInputComponent;
+class UAudioComponent;
 
 UCLASS(config = Game)
 class MYVEHICLEPROJECT_API AWheeledVehicleNW : public AWheeledVehicle
@@ -43,6 +44,10 @@ public:
 	UPROPERTY(Category = Camera, VisibleDefaultsOnly, BlueprintReadOnly)
 		bool bInReverseGear;
 
+	/** Engine sound, its EngineAudioRPM parameter follows the published engine RPM */
+	UPROPERTY(Category = Display, VisibleDefaultsOnly, BlueprintReadOnly)
+		UAudioComponent* EngineSoundComponent;
+
 	/** Initial offset of In-Car camera */
 	FVector InternalCameraOrigin;
 
@@ -62,8 +67,17 @@ public:
 	/** Setup the strings used on the HUD. */
 	void SetupInCarHUD();
 
-	/** Update the physics material used by the vehicle mesh */
-	void UpdatePhysicsMaterial();
+	/** Display updates, bound to the change delegates of the vehicle movement */
+	UFUNCTION()
+	void OnGearChanged(int32 Gear);
+	UFUNCTION()
+	void OnSpeedChanged(int32 Speed);
+	UFUNCTION()
+	void OnEngineRPMChanged(float EngineRPM);
+
+	/** Track the wheels on slippery surfaces, bound to OnWheelSurfaceChanged of the vehicle movement */
+	UFUNCTION()
+	void OnWheelSurfaceChanged(int32 WheelIndex, UPhysicalMaterial* Surface, float Friction);
 
 	/** Handle pressing right */
 	UFUNCTION(BlueprintCallable, Category = Vehicle)
@@ -94,12 +108,16 @@ private:
 
 	/* Are we on a 'slippery' surface */
 	bool bIsLowFriction;
-	/** Slippery Material instance */
+
+	/** One bit per wheel touching a surface with less friction than LowFriction */
+	uint32 LowFrictionWheels;
 
 public:
-	UPROPERTY(EditAnywhere)
-	UPhysicalMaterial* SlipperyMaterial;
-	/** Non Slippery Material instance */
-	UPROPERTY(EditAnywhere)
-	UPhysicalMaterial* NonSlipperyMaterial;
+	/** Tire friction under which a surface counts as slippery */
+	UPROPERTY(EditAnywhere, Category = Surface)
+	float LowFriction;
+
+	/** True while any wheel is on a slippery surface */
+	UFUNCTION(BlueprintCallable, Category = Vehicle)
+	bool IsOnLowFriction() const { return bIsLowFriction; }
 };
\ No newline at end of file